@@ -3,13 +3,28 @@
 #include <vector>
 #include <fstream>
 #include <lap/lap.h>
+#include <boost/algorithm/string/predicate.hpp>
 
 using namespace lap;
 using namespace std;
 using namespace std::tr1;
 
   template <typename V>
-void getInfo(shared_ptr<V> mesh)
+void printTopology(shared_ptr<V> mesh)
+{
+  HalfEdgeMesh topology;
+  buildTopology(mesh, topology);
+  cout << "topology\n";
+  cout << "  vertices " << topology.stats().vertices << endl;
+  cout << "  faces " << topology.stats().faces << endl;
+  cout << "  edges " << topology.stats().edges << endl;
+  cout << "  boundary-edges " << topology.stats().boundaryEdges << endl;
+  cout << "  non-manifold-edges " << topology.stats().nonManifoldEdges << endl;
+  cout << "  euler-characteristic " << topology.stats().eulerCharacteristic() << endl;
+}
+
+  template <typename V>
+void getInfo(shared_ptr<V> mesh, bool topology)
 { 
   cout << "vertices " << mesh->vertices().size() << endl;
   {
@@ -36,33 +51,116 @@ void getInfo(shared_ptr<V> mesh)
         cout << bind(&Group::name, _1) << ' ');
     cout << endl;
   }
+
+  if (topology) printTopology(mesh);
+}
+
+enum InfoMode
+{
+  kWeldedInfo,
+  kStatsText,
+  kStatsJson
+};
+
+// Stats work on flat and indexed meshes alike, so neither is converted.
+  template <typename V>
+void getStats(shared_ptr<V> mesh, InfoMode mode)
+{
+  MeshStats stats;
+  meshStats(mesh, stats);
+  if (mode == kStatsJson) printStatsJson(cout, stats);
+  else printStats(cout, stats);
+}
+
+  template <typename V>
+void getPlyInfo(const string& modelFile, InfoMode mode, bool topology)
+{
+  shared_ptr<Mesh<V> > mesh = importPly<V>(modelFile);
+  if (!mesh)
+  {
+    cerr << "Error importing " << modelFile << endl;
+    return;
+  }
+  if (mode != kWeldedInfo) getStats(mesh, mode);
+  else getInfo(meshFromIndexedMesh(mesh), topology);
+}
+
+struct PlyInfo
+{
+  string modelFile;
+  InfoMode mode;
+  bool topology;
+
+  template <typename V> void apply()const { getPlyInfo<V>(modelFile, mode, topology); }
+};
+
+struct ObjInfo
+{
+  obj::ModelPtr model;
+  InfoMode mode;
+  bool topology;
+
+  template <typename V> void apply()const 
+  { 
+    if (mode != kWeldedInfo) getStats(meshFromObj<V>(model), mode);
+    else getInfo(meshFromObj<V>(model), topology); 
+  }
+};
+
+bool hasFlag(int argc, char **argv, const string& flag)
+{
+  for (int i = 2; i < argc; ++i) 
+  {
+    if (flag == argv[i]) return true;
+  }
+  return false;
 }
 
 int main(int argc, char **argv)
 {
   if (argc < 2)
   {
-    cerr << "Usage: lapinfo <obj-file>\n";
+    cerr << "Usage: lapinfo <obj-or-ply-file> [--topology] [--stats] [--json]\n"
+      "  --topology : also print half-edge topology counts\n"
+      "  --stats : counts, bounds, area, closed volume and degenerates in one parallel\n"
+      "    pass, without welding. Volume is per geometry group: a group counts only if\n"
+      "    all its triangles form closed shells\n"
+      "  --json : --stats as JSON\n";
     return 1;
   }
   const string modelFile = argv[1];
+  const bool topology = hasFlag(argc, argv, "--topology");
+  const InfoMode mode = hasFlag(argc, argv, "--json") ? kStatsJson :
+    hasFlag(argc, argv, "--stats") ? kStatsText : kWeldedInfo;
+  // JSON output is the document alone.
+  ostream& header = mode == kStatsJson ? cerr : cout;
+
+  if (boost::algorithm::iends_with(modelFile, ".ply"))
+  {
+    const obj::VertexFormat vertexFormat = plyVertexFormat(modelFile);
+    header << "ModelFile: " << modelFile << endl;
+    header << "vertexFormat: " << vertexFormat << endl;
+    const PlyInfo job = { modelFile, mode, topology };
+    if (!dispatchPlyVertexFormat(vertexFormat, job))
+    {
+      cerr << "Error importing " << modelFile << endl;
+      return 1;
+    }
+    return 0;
+  }
 
-  obj::ModelPtr model = obj::ObjTranslator().importFile(modelFile);
+  obj::ObjTranslator translator;
+  translator.setPipelined(true);
+  obj::ModelPtr model = translator.importFile(modelFile);
   if (!model)
   {
     cerr << "Error importing " << modelFile << endl;
     return 1;
   }
-  cout << "ModelFile: " << modelFile << endl;
-  cout << "vertexFormat: " << model->vertexFormat() << endl;
+  header << "ModelFile: " << modelFile << endl;
+  header << "vertexFormat: " << model->vertexFormat() << endl;
 
-  switch (model->vertexFormat())
-  {
-    case obj::kPosition: getInfo(meshFromObj<VertexP>(model)); break;
-    case obj::kPositionUV: getInfo(meshFromObj<VertexPT>(model)); break;
-    case obj::kPositionNormal: getInfo(meshFromObj<VertexPN>(model)); break;
-    case obj::kPositionUVNormal: getInfo(meshFromObj<VertexPTN>(model)); break;
-    default: cerr << "Invalid vertex format" << endl; break;
-  }
+  const ObjInfo job = { model, mode, topology };
+  if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
   return 0;
 }
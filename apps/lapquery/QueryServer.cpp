@@ -0,0 +1,349 @@
+#include "QueryServer.h"
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/thread/thread.hpp>
+#include <lap/lap.h>
+
+using namespace lap;
+using namespace std;
+using namespace std::tr1;
+namespace asio = boost::asio;
+
+namespace
+{
+  const uint32_t kMaxFrame = 64 << 20;
+
+  struct RunService
+  {
+    asio::io_service* io;
+
+    void operator()()const { io->run(); }
+  };
+
+  uint32_t frameSize(const unsigned char* header)
+  {
+    return header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24;
+  }
+
+  string framed(const string& payload)
+  {
+    const uint32_t size = payload.size();
+    const char header[4] = { (char)size, (char)(size >> 8), (char)(size >> 16), (char)(size >> 24) };
+    return string(header, 4) + payload;
+  }
+
+  // A client's socket and the frame being read or written. Each step's
+  // handler holds the connection, so it closes once no step is pending.
+  struct Connection
+  {
+    Connection(QueryServer* server, asio::io_service& io):
+      server(server),
+      socket(io),
+      stop(false)
+    {}
+
+    QueryServer* server;
+    QueryServer::Socket socket;
+    unsigned char header[4];
+    string request;
+    string response;
+    bool stop;
+  };
+  typedef shared_ptr<Connection> ConnectionPtr;
+
+  void readRequest(const ConnectionPtr& connection);
+
+  struct ResponseWritten
+  {
+    ConnectionPtr connection;
+
+    void operator()(const boost::system::error_code& ec, size_t)const
+    {
+      if (ec) return;
+      if (connection->stop) connection->server->stop();
+      else readRequest(connection);
+    }
+  };
+
+  // Answered on the pool thread that completed the read.
+  struct RequestRead
+  {
+    ConnectionPtr connection;
+
+    void operator()(const boost::system::error_code& ec, size_t)const
+    {
+      if (ec) return;
+      Connection& c = *connection;
+      c.response = framed(c.server->answer(c.request, c.stop));
+      const ResponseWritten handler = { connection };
+      asio::async_write(c.socket, asio::buffer(c.response), handler);
+    }
+  };
+
+  struct HeaderRead
+  {
+    ConnectionPtr connection;
+
+    void operator()(const boost::system::error_code& ec, size_t)const
+    {
+      if (ec) return;
+      Connection& c = *connection;
+      const uint32_t size = frameSize(c.header);
+      if (size > kMaxFrame) return;
+      c.request.resize(size);
+      const RequestRead handler = { connection };
+      if (size == 0) handler(ec, 0);
+      else asio::async_read(c.socket, asio::buffer(&c.request[0], size), handler);
+    }
+  };
+
+  void readRequest(const ConnectionPtr& connection)
+  {
+    const HeaderRead handler = { connection };
+    asio::async_read(connection->socket, asio::buffer(connection->header), handler);
+  }
+
+  struct Accepted
+  {
+    QueryServer* server;
+    ConnectionPtr connection;
+
+    void operator()(const boost::system::error_code& ec)const
+    {
+      if (ec) return; // The acceptor was closed.
+      server->accept();
+      readRequest(connection);
+    }
+  };
+
+  // A model fetched once per request. Its meshes are built from it rather
+  // than from the file, which may have changed, or gone, since.
+  struct CachedFile
+  {
+    ModelCache* cache;
+    string filename;
+    obj::ModelPtr model;
+    FileStamp stamp;
+
+    template <typename V> shared_ptr<Mesh<V> > mesh()const
+    {
+      return cache->mesh<V>(filename, model, stamp);
+    }
+  };
+
+  // Each command runs on the cached mesh matching the model's vertex format.
+  struct MeshInfo
+  {
+    const CachedFile* file;
+    ostream* os;
+
+    template <typename V> void apply()const
+    {
+      shared_ptr<Mesh<V> > mesh = file->mesh<V>();
+      *os << "vertices " << mesh->_vertices.size() <<
+        "\ntriangles " << mesh->_vertices.size() / 3 <<
+        "\ngeometry-groups " << mesh->_geometryGroups.size() <<
+        "\nmaterial-groups " << mesh->_materialGroups.size() <<
+        "\nmaterials " << mesh->_materials.size() <<
+        "\nbounds " << mesh->bounds() << '\n';
+    }
+  };
+
+  struct QueryGroups
+  {
+    const CachedFile* file;
+    ostream* os;
+
+    template <typename V> void apply()const
+    {
+      shared_ptr<Mesh<V> > mesh = file->mesh<V>();
+      for (GroupConstIter g = mesh->beginGeometryGroups(); g != mesh->endGeometryGroups(); ++g)
+      {
+        *os << g->name() << ' ' << g->count() / 3 << '\n';
+      }
+    }
+  };
+
+  struct ExtractGroup
+  {
+    const CachedFile* file;
+    string group;
+    string outName;
+    bool* found;
+
+    template <typename V> void apply()const
+    {
+      // Cached, so repeated extracts skip the weld.
+      const shared_ptr<Mesh<V> > welded = file->cache->groupMesh<V>(file->filename,
+          file->model, file->stamp, group);
+      if (!welded) return;
+      obj::ObjTranslator().exportFile(objFromMesh(welded), outName);
+      *found = true;
+    }
+  };
+
+  string resolvePath(const string& cwd, const string& path)
+  {
+    return boost::filesystem::absolute(path, cwd).string();
+  }
+}
+
+QueryServer::QueryServer(const string& socketPath, uint64_t cacheBytes):
+  _socketPath(socketPath),
+  _cache(cacheBytes),
+  _acceptor(_io)
+{
+  // A stale socket from a server that didn't exit cleanly blocks bind.
+  ::unlink(socketPath.c_str());
+  const asio::local::stream_protocol::endpoint endpoint(socketPath);
+  _acceptor.open(endpoint.protocol());
+  _acceptor.bind(endpoint);
+  _acceptor.listen();
+}
+
+QueryServer::~QueryServer()
+{
+  ::unlink(_socketPath.c_str());
+}
+
+void QueryServer::run(uint32_t threads)
+{
+  accept();
+  boost::thread_group pool;
+  for (uint32_t i = 0; i < std::max(threads, 1u); ++i)
+  {
+    const RunService fn = { &_io };
+    pool.create_thread(fn);
+  }
+  pool.join_all();
+}
+
+void QueryServer::accept()
+{
+  const Accepted handler = { this, ConnectionPtr(new Connection(this, _io)) };
+  _acceptor.async_accept(handler.connection->socket, handler);
+}
+
+void QueryServer::stop()
+{
+  _io.stop();
+}
+
+string QueryServer::answer(const string& request, bool& stop)
+{
+  vector<string> lines;
+  boost::algorithm::split(lines, request, std::bind2nd(std::equal_to<char>(), '\n'));
+  stop = lines.size() > 1 && lines[1] == "stop";
+  try
+  {
+    return respond(lines);
+  }
+  catch (const std::exception& e)
+  {
+    return string("error\n") + e.what();
+  }
+}
+
+string QueryServer::respond(const vector<string>& request)
+{
+  const string command = request.size() > 1 ? request[1] : "";
+  ostringstream os;
+  if (command == "stats")
+  {
+    os << "ok\n" << _cache.stats();
+    return os.str();
+  }
+  if (command == "stop") return "ok\nstopping";
+  if (command != "info" && command != "query" && command != "extract")
+  {
+    return "error\nunknown command '" + command + "'";
+  }
+  if (request.size() < 3) return "error\n" + command + " requires an <obj-file>";
+
+  CachedFile file = { &_cache, resolvePath(request[0], request[2]) };
+  file.model = _cache.model(file.filename, &file.stamp);
+  if (!file.model) return "error\nerror importing " + file.filename;
+  const obj::VertexFormat format = file.model->vertexFormat();
+
+  os << "ok\n";
+  bool dispatched = false;
+  if (command == "info")
+  {
+    os << "vertexFormat " << format << '\n';
+    const MeshInfo job = { &file, &os };
+    dispatched = dispatchVertexFormat(format, job);
+  }
+  else if (command == "query")
+  {
+    const QueryGroups job = { &file, &os };
+    dispatched = dispatchVertexFormat(format, job);
+  }
+  else
+  {
+    if (request.size() < 5) return "error\nextract requires a <group> and an <out-file>";
+    bool found = false;
+    const ExtractGroup job = { &file, request[3], resolvePath(request[0], request[4]), &found };
+    dispatched = dispatchVertexFormat(format, job);
+    if (dispatched && !found) return "error\nno geometry-group '" + request[3] + "'";
+    os << request[3] << " written to " << job.outName << '\n';
+  }
+  if (!dispatched) return "error\ninvalid vertex format";
+  return os.str();
+}
+
+bool writeFrame(QueryServer::Socket& socket, const string& payload)
+{
+  boost::system::error_code ec;
+  asio::write(socket, asio::buffer(framed(payload)), ec);
+  return !ec;
+}
+
+bool readFrame(QueryServer::Socket& socket, string& payload)
+{
+  unsigned char header[4];
+  boost::system::error_code ec;
+  asio::read(socket, asio::buffer(header), ec);
+  if (ec) return false;
+  const uint32_t size = frameSize(header);
+  if (size > kMaxFrame) return false;
+  payload.resize(size);
+  if (size) asio::read(socket, asio::buffer(&payload[0], size), ec);
+  return !ec;
+}
+
+int sendRequest(const string& socketPath, const vector<string>& args)
+{
+  asio::io_service io;
+  QueryServer::Socket socket(io);
+  boost::system::error_code ec;
+  socket.connect(asio::local::stream_protocol::endpoint(socketPath), ec);
+  if (ec)
+  {
+    cerr << "error connecting to " << socketPath << ": " << ec.message() << endl;
+    return 1;
+  }
+
+  vector<string> lines(1, boost::filesystem::current_path().string());
+  lines.insert(lines.end(), args.begin(), args.end());
+  string response;
+  if (!writeFrame(socket, boost::algorithm::join(lines, "\n")) || !readFrame(socket, response))
+  {
+    cerr << "error talking to " << socketPath << endl;
+    return 1;
+  }
+  const string::size_type eol = response.find('\n');
+  const string status = response.substr(0, eol);
+  const string text = eol == string::npos ? "" : response.substr(eol + 1);
+  if (status != "ok")
+  {
+    cerr << text << endl;
+    return 1;
+  }
+  cout << text;
+  if (!text.empty() && text[text.size() - 1] != '\n') cout << endl;
+  return 0;
+}
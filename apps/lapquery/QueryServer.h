@@ -0,0 +1,56 @@
+#ifndef LAPQUERY_QUERY_SERVER_H
+#define LAPQUERY_QUERY_SERVER_H
+
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <lap/ModelCache.h>
+
+// Requests and responses are frames: a little-endian uint32 byte count,
+// then that many bytes. A request's lines are the client's working
+// directory, the command and its arguments; a response's first line is
+// "ok" or "error" and the rest its text.
+class QueryServer
+{
+  public:
+    typedef boost::asio::local::stream_protocol::socket Socket;
+
+    QueryServer(const std::string& socketPath, uint64_t cacheBytes);
+    ~QueryServer();
+
+    //! Serve clients on threads pool threads until a client sends stop.
+    //! Connections wait for requests with asynchronous reads, so a thread
+    //! is only taken while a request is answered and idle clients hold 
+    //! none. Returns once stopped, dropping the remaining connections.
+    void run(uint32_t threads);
+
+    //! Answer one request frame's payload. stop is set for a stop request,
+    //! whose response should be sent before calling stop().
+    std::string answer(const std::string& request, bool& stop);
+
+    //! Answer a request's lines, see the frame layout above.
+    std::string respond(const std::vector<std::string>& request);
+
+    //! Wait for the next client, served by whichever pool thread takes it.
+    void accept();
+
+    //! Make run return, abandoning queued work.
+    void stop();
+
+  private:
+    std::string _socketPath;
+    lap::ModelCache _cache;
+    boost::asio::io_service _io;
+    boost::asio::local::stream_protocol::acceptor _acceptor;
+};
+
+//! Write or read one frame on socket; false if the connection fails or
+//! the frame is implausibly large.
+bool writeFrame(QueryServer::Socket& socket, const std::string& payload);
+bool readFrame(QueryServer::Socket& socket, std::string& payload);
+
+//! Send args as one request to the server at socketPath and print its
+//! response. Returns the process exit status.
+int sendRequest(const std::string& socketPath, const std::vector<std::string>& args);
+
+#endif
@@ -1,9 +1,14 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <set>
 #include <fstream>
+#include <cstdlib>
+#include <sstream>
 #include <lap/lap.h>
+#include "QueryServer.h"
 #include <boost/function.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 using namespace lap;
 using namespace std;
@@ -11,19 +16,375 @@ using namespace std::tr1;
 
   template <typename V>
 void extractGroups(shared_ptr<V> mesh)
-{ 
+{
 
-  for (GroupConstIter iter = mesh->beginGeometryGroups(); 
+  for (GroupConstIter iter = mesh->beginGeometryGroups();
       iter != mesh->endGeometryGroups(); ++iter)
   {
     shared_ptr<V> sliced = mesh->slice(*iter)->flatten();
     cout << iter->name() << " Sliced.. ";
 
-    shared_ptr<V> welded = meshFromIndexedMesh(indexedMeshFromMesh(sliced));
+    shared_ptr<V> welded = indexedMeshFromMesh(sliced);
     cout << "welded.. ";
     const std::string outName = iter->name() + ".obj";
     obj::ObjTranslator().exportFile(objFromMesh(welded), outName);
-    cout << "written to " << outName << endl; 
+    cout << "written to " << outName << endl;
+  }
+}
+
+  template <typename V>
+void smoothNormals(shared_ptr<Mesh<V> > mesh, const string& outName, float creaseAngle)
+{
+  shared_ptr<Mesh<typename NormalVertex<V>::type> > smoothed =
+    generateNormals(mesh, creaseAngle);
+  cout << "normals generated for " << smoothed->vertices().size() << " vertices.. ";
+  obj::ObjTranslator().exportFile(objFromMesh(smoothed), outName);
+  cout << "written to " << outName << endl;
+}
+
+  template <typename V>
+void splitParts(shared_ptr<Mesh<V> > mesh, const string& outName, bool withinGroups, 
+    bool each)
+{
+  shared_ptr<Mesh<V> > split = splitComponents(mesh, withinGroups);
+  cout << split->_geometryGroups.size() << " components.. ";
+  obj::ObjTranslator().exportFile(objFromMesh(split), outName);
+  cout << "written to " << outName << endl;
+  if (!each) return;
+
+  for (GroupConstIter iter = split->beginGeometryGroups();
+      iter != split->endGeometryGroups(); ++iter)
+  {
+    const std::string partName = iter->name() + ".obj";
+    obj::ObjTranslator().exportFile(objFromMesh(split->slice(*iter)), partName);
+    cout << "  " << iter->name() << " written to " << partName << endl;
+  }
+}
+
+  template <typename V>
+bool writeGlb(shared_ptr<Mesh<V> > mesh, const string& outName)
+{
+  cout << mesh->vertices().size() << " vertices.. ";
+  if (!exportGlb(mesh, outName))
+  {
+    cerr << "error writing " << outName << endl;
+    return false;
+  }
+  cout << "written to " << outName << endl;
+  return true;
+}
+
+  template <typename V>
+bool writePly(shared_ptr<Mesh<V> > mesh, const string& outName)
+{
+  cout << mesh->vertices().size() << " vertices.. ";
+  if (!exportPly(mesh, outName))
+  {
+    cerr << "error writing " << outName << endl;
+    return false;
+  }
+  cout << "written to " << outName << endl;
+  return true;
+}
+
+  template <typename V>
+void reorderSpatially(shared_ptr<Mesh<V> > mesh, const string& outName)
+{
+  shared_ptr<Mesh<V> > reordered = reorderMorton(mesh);
+  cout << reordered->indices().size() / 3 << " triangles reordered.. ";
+  obj::ObjTranslator().exportFile(objFromMesh(reordered), outName);
+  cout << "written to " << outName << endl;
+}
+
+// Each command runs on the mesh layout matching the model's vertex format.
+struct SmoothNormals
+{
+  obj::ModelPtr model;
+  string outName;
+  float creaseAngle;
+
+  template <typename V> void apply()const 
+  { 
+    smoothNormals(meshFromObj<V>(model), outName, creaseAngle); 
+  }
+};
+
+struct SplitParts
+{
+  obj::ModelPtr model;
+  string outName;
+  bool withinGroups;
+  bool each;
+
+  template <typename V> void apply()const 
+  { 
+    splitParts(meshFromObj<V>(model), outName, withinGroups, each); 
+  }
+};
+
+struct WriteGlb
+{
+  WeldedObjPtr welded;
+  string outName;
+  bool* written;
+
+  template <typename V> void apply()const 
+  { 
+    *written = writeGlb(indexedMeshFromWeldedObj<V>(welded), outName); 
+  }
+};
+
+struct WritePly
+{
+  WeldedObjPtr welded;
+  string outName;
+  bool* written;
+
+  template <typename V> void apply()const 
+  { 
+    *written = writePly(indexedMeshFromWeldedObj<V>(welded), outName); 
+  }
+};
+
+struct ReorderMesh
+{
+  WeldedObjPtr welded;
+  string outName;
+
+  template <typename V> void apply()const 
+  { 
+    reorderSpatially(indexedMeshFromWeldedObj<V>(welded), outName); 
+  }
+};
+
+struct ExtractGroups
+{
+  obj::ModelPtr model;
+
+  template <typename V> void apply()const { extractGroups(meshFromObj<V>(model)); }
+};
+
+// A manifest line: <group> followed by a row-major 3x4 or 4x4 matrix, with
+// group * placing the whole mesh. Blank lines and # comments are skipped.
+struct Placement
+{
+  string group;
+  float4x4 matrix;
+};
+
+bool readPlacements(const string& filename, vector<Placement>& placements)
+{
+  ifstream in(filename.c_str());
+  if (!in) return false;
+  string line;
+  for (uint32_t lineNo = 1; getline(in, line); ++lineNo)
+  {
+    istringstream fields(line);
+    Placement p;
+    if (!(fields >> p.group) || p.group[0] == '#') continue;
+    vector<float> m;
+    float f;
+    while (fields >> f) m.push_back(f);
+    if (m.size() != 12 && m.size() != 16)
+    {
+      cerr << filename << ":" << lineNo << ": expected 12 or 16 matrix values\n";
+      return false;
+    }
+    std::copy(m.begin(), m.end(), p.matrix.m);
+    placements.push_back(p);
+  }
+  return true;
+}
+
+  template <typename V>
+void placeGroups(shared_ptr<Mesh<V> > mesh, const vector<Placement>& placements, 
+    const string& outName, const TransformOptions& options)
+{
+  for (vector<Placement>::const_iterator p = placements.begin(); p != placements.end(); ++p)
+  {
+    const bool placed = p->group == "*" ? transformMesh(mesh, p->matrix, options) :
+      transformGroups(mesh, p->group, p->matrix, options);
+    if (!placed) cerr << "skipped " << p->group << ": no such group or singular matrix\n";
+  }
+  cout << placements.size() << " placements applied.. ";
+  obj::ObjTranslator().exportFile(objFromMesh(mesh), outName);
+  cout << "written to " << outName << endl;
+}
+
+struct PlaceGroups
+{
+  obj::ModelPtr model;
+  vector<Placement> placements;
+  string outName;
+  TransformOptions options;
+
+  template <typename V> void apply()const 
+  { 
+    placeGroups(meshFromObj<V>(model), placements, outName, options); 
+  }
+};
+
+  template <typename V>
+bool writeTile(const MeshTile<V>& tile, const string& file)
+{
+  if (boost::algorithm::iends_with(file, ".glb")) return exportGlb(tile.mesh, file);
+  if (boost::algorithm::iends_with(file, ".ply")) return exportPly(tile.mesh, file);
+  return obj::ObjTranslator().exportFile(objFromMesh(tile.mesh), file);
+}
+
+// Writes <prefix>_tile_<n>.<ext> and a <prefix>.tiles manifest of tile
+// bounds. Tiles go out one at a time: the OBJ writer formats each in
+// parallel already, and threads per tile on top would multiply.
+  template <typename V>
+void writeTiles(shared_ptr<Mesh<V> > mesh, const string& prefix, uint32_t budget,
+    const string& extension)
+{
+  vector<MeshTile<V> > tiles;
+  tileMesh(mesh, budget, tiles);
+  cout << tiles.size() << " tiles.. ";
+
+  vector<string> files;
+  vector<char> failed;
+  for (uint32_t i = 0; i < tiles.size(); ++i)
+  {
+    files.push_back(prefix + "_" + tiles[i].name + extension);
+    failed.push_back(!writeTile(tiles[i], files[i]));
+  }
+
+  const string manifestName = prefix + ".tiles";
+  ofstream manifest(manifestName.c_str());
+  manifest << "# tile triangles min-x min-y min-z max-x max-y max-z file\n";
+  for (uint32_t i = 0; i < tiles.size(); ++i)
+  {
+    if (failed[i]) cerr << "error writing " << files[i] << endl;
+    const BoundingBox<float3>& b = tiles[i].bounds;
+    manifest << tiles[i].name << ' ' << tiles[i].mesh->indices().size() / 3 << ' ';
+    writeVec(manifest, b.min(), NULL, " ");
+    writeVec(manifest, b.max(), NULL, " ");
+    manifest << files[i] << '\n';
+  }
+  cout << "written to " << manifestName << endl;
+}
+
+struct TileMesh
+{
+  WeldedObjPtr welded;
+  string prefix;
+  uint32_t budget;
+  string extension;
+
+  template <typename V> void apply()const 
+  { 
+    writeTiles(indexedMeshFromWeldedObj<V>(welded), prefix, budget, extension); 
+  }
+};
+
+struct MergeModels
+{
+  vector<obj::ModelPtr> models;
+  string outName;
+
+  template <typename V> void apply()const 
+  { 
+    vector<shared_ptr<Mesh<V> > > meshes;
+    for (uint32_t i = 0; i < models.size(); ++i) meshes.push_back(meshFromObj<V>(models[i]));
+    shared_ptr<Mesh<V> > merged = mergeMeshes(meshes);
+    cout << merged->vertices().size() << " vertices, " << merged->materials().size() 
+      << " materials.. ";
+    obj::ObjTranslator().exportFile(objFromMesh(merged), outName);
+    cout << "written to " << outName << endl;
+  }
+};
+
+// OBJ allows several groups of one name. Later ones get '~<n>' appended,
+// skipping names already taken, so each name identifies one group.
+void uniqueGroupNames(vector<Group>& groups)
+{
+  set<string> taken;
+  for (GroupConstIter g = groups.begin(); g != groups.end(); ++g) taken.insert(g->name());
+  set<string> seen;
+  for (vector<Group>::iterator g = groups.begin(); g != groups.end(); ++g)
+  {
+    if (seen.insert(g->name()).second) continue;
+    string name;
+    for (uint32_t n = 2; ; ++n)
+    {
+      ostringstream os;
+      os << g->name() << '~' << n;
+      name = os.str();
+      if (taken.insert(name).second) break;
+    }
+    *g = Group(name, g->begin(), g->count());
+  }
+}
+
+// Writes the mesh without instanced copies to outName and each copy as
+// '<prototype> <instance> <3x4 row-major transform>' to outName.instances.
+// Groups sharing a name are renamed first, in the OBJ as well, so the
+// manifest's names each refer to one group.
+  template <typename V>
+void extractInstances(shared_ptr<Mesh<V> > mesh, const string& outName, float tolerance)
+{
+  uniqueGroupNames(mesh->_geometryGroups);
+  vector<GroupInstance> instances;
+  findInstances(mesh, tolerance, instances);
+  cout << instances.size() << " of " << mesh->_geometryGroups.size() << " groups instanced.. ";
+
+  const string manifestName = outName + ".instances";
+  ofstream manifest(manifestName.c_str());
+  manifest << "# prototype instance m00 m01 m02 m03 m10 m11 m12 m13 m20 m21 m22 m23\n";
+  manifest.precision(9);
+  for (vector<GroupInstance>::const_iterator i = instances.begin(); i != instances.end(); ++i)
+  {
+    manifest << mesh->_geometryGroups[i->prototype].name() << ' ' 
+      << mesh->_geometryGroups[i->group].name();
+    for (int k = 0; k < 12; ++k) manifest << ' ' << i->transform.m[k];
+    manifest << '\n';
+  }
+
+  obj::ObjTranslator().exportFile(objFromMesh(removeInstances(mesh, instances)), outName);
+  cout << "written to " << outName << " and " << manifestName << endl;
+}
+
+struct ExtractInstances
+{
+  WeldedObjPtr welded;
+  string outName;
+  float tolerance;
+
+  template <typename V> void apply()const 
+  { 
+    extractInstances(indexedMeshFromWeldedObj<V>(welded), outName, tolerance); 
+  }
+};
+
+bool hasFlag(int argc, char **argv, int first, const string& flag)
+{
+  for (int i = first; i < argc; ++i) 
+  {
+    if (flag == argv[i]) return true;
+  }
+  return false;
+}
+
+void printIndexGroups(const obj::ObjIndex& index)
+{
+  vector<uint32_t> geometry(index.geometryNames.size());
+  vector<uint32_t> material(index.materialNames.size());
+  for (vector<obj::ObjFaceRun>::const_iterator r = index.runs.begin(); r != index.runs.end(); ++r)
+  {
+    if (r->geometryGroup != obj::ObjFaceRun::kNoGroup) geometry[r->geometryGroup] += r->triangles;
+    if (r->materialGroup != obj::ObjFaceRun::kNoGroup) material[r->materialGroup] += r->triangles;
+  }
+  cout << "geometry-groups\n";
+  for (uint32_t i = 0; i < geometry.size(); ++i)
+  {
+    cout << "  " << index.geometryNames[i] << ' ' << geometry[i] << endl;
+  }
+  cout << "material-groups\n";
+  for (uint32_t i = 0; i < material.size(); ++i)
+  {
+    cout << "  " << index.materialNames[i] << ' ' << material[i] << endl;
   }
 }
 
@@ -32,12 +393,104 @@ int main(int argc, char **argv)
   // dude where's my options
   if (argc < 2)
   {
-    cerr << "Usage: lapinfo <command>\n  xg : extract all geometry-groups\n";
+    cerr << "Usage: lapquery <obj-file> [command]\n"
+      "  xg : extract all geometry-groups (default)\n"
+      "  normals <out-file> [crease-degrees] : generate smooth normals\n"
+      "  components <out-file> [--across] [--each] : one geometry-group per connected part,\n"
+      "    --across joins parts across geometry-groups, --each also writes each part\n"
+      "  glb <out-file> : export as binary glTF\n"
+      "  ply <out-file> : export as binary PLY\n"
+      "  reorder <out-file> : sort triangles by Morton code within groups and number vertices\n"
+      "    in first use order\n"
+      "  place <out-file> <manifest> [--no-renormalize] : transform groups by the manifest's\n"
+      "    '<group|*> <3x4 or 4x4 row-major matrix>' lines, --no-renormalize leaves normals\n"
+      "    unnormalized\n"
+      "  tiles <out-prefix> <triangle-budget> [--glb|--ply] : cut into spatial tiles of at most\n"
+      "    the budget, written as <out-prefix>_tile_<n>.obj with bounds in <out-prefix>.tiles\n"
+      "  merge <out-file> <obj-file>... : concatenate with more models of the same vertex format,\n"
+      "    renaming clashing materials\n"
+      "  instances <out-file> [tolerance] : replace repeated groups by their first copy, listing\n"
+      "    each repeat's transform in <out-file>.instances\n"
+      "  index : write the <obj-file>.lapidx group index and list each group's triangles\n"
+      "  load <out-file> <group>... : load only the named geometry-groups using the index\n"
+      "       lapquery --serve <socket> [cache-mb] : keep models cached and answer requests on a\n"
+      "         unix socket until sent stop, cache-mb defaults to 1024\n"
+      "       lapquery --request <socket> <request> : send one request to a server\n"
+      "  info <obj-file> : vertex, triangle and group counts\n"
+      "  query <obj-file> : each geometry-group's triangle count\n"
+      "  extract <obj-file> <group> <out-file> : write a geometry-group welded\n"
+      "  stats : cache hits, misses and size\n"
+      "  stop : stop the server\n";
     return 1;
   }
+
+  if (string(argv[1]) == "--serve" && argc > 2)
+  {
+    const uint64_t cacheMB = argc > 3 ? strtoull(argv[3], NULL, 10) : 1024;
+    QueryServer server(argv[2], cacheMB << 20);
+    cout << "serving on " << argv[2] << endl;
+    server.run(workerCount());
+    return 0;
+  }
+  if (string(argv[1]) == "--request" && argc > 3)
+  {
+    return sendRequest(argv[2], vector<string>(argv + 3, argv + argc));
+  }
   const string modelFile = argv[1];
+  const string command = argc > 2 ? argv[2] : "xg";
 
-  obj::ModelPtr model = obj::ObjTranslator().importFile(modelFile);
+  // Indexed commands parse only what they need.
+  if (command == "index" || command == "load")
+  {
+    obj::ObjIndex index;
+    if (!obj::loadObjIndex(modelFile, index))
+    {
+      cerr << "Error indexing " << modelFile << endl;
+      return 1;
+    }
+    if (command == "index")
+    {
+      printIndexGroups(index);
+      return 0;
+    }
+    if (argc < 5)
+    {
+      cerr << "load requires an <out-file> and a <group>\n";
+      return 1;
+    }
+    const vector<string> groups(argv + 4, argv + argc);
+    for (vector<string>::const_iterator g = groups.begin(); g != groups.end(); ++g)
+    {
+      if (find(index.geometryNames.begin(), index.geometryNames.end(), *g) == index.geometryNames.end())
+      {
+        cerr << "no geometry-group '" << *g << "'\n";
+        return 1;
+      }
+    }
+    obj::ModelPtr loaded = obj::importObjGroups(modelFile, index, groups);
+    if (!loaded || !obj::ObjTranslator().exportFile(loaded, argv[3]))
+    {
+      cerr << "error loading groups of " << modelFile << endl;
+      return 1;
+    }
+    cout << loaded->numTriangles() << " triangles written to " << argv[3] << endl;
+    return 0;
+  }
+
+  // Commands on an indexed mesh weld corners as faces are parsed, so the
+  // model never holds its face-indices.
+  const bool welds = command == "glb" || command == "ply" || command == "reorder" ||
+    command == "tiles" || command == "instances";
+  obj::ObjTranslator translator;
+  translator.setPipelined(true);
+  WeldedObjPtr welded;
+  obj::ModelPtr model;
+  if (welds)
+  {
+    welded = importWeldedObj(modelFile);
+    if (welded) model = welded->model;
+  }
+  else model = translator.importFile(modelFile);
   if (!model)
   {
     cerr << "Error importing " << modelFile << endl;
@@ -46,13 +499,154 @@ int main(int argc, char **argv)
   cout << "ModelFile: " << modelFile << endl;
   cout << "vertexFormat: " << model->vertexFormat() << endl;
 
-  switch (model->vertexFormat())
+  if (command == "normals")
+  {
+    if (argc < 4)
+    {
+      cerr << "normals requires an <out-file>\n";
+      return 1;
+    }
+    const string outName = argv[3];
+    const float creaseAngle = argc > 4 ? strtof(argv[4], NULL) : 180.0f;
+    const SmoothNormals job = { model, outName, creaseAngle };
+    if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
+    return 0;
+  }
+
+  if (command == "components")
+  {
+    if (argc < 4)
+    {
+      cerr << "components requires an <out-file>\n";
+      return 1;
+    }
+    const string outName = argv[3];
+    const bool withinGroups = !hasFlag(argc, argv, 4, "--across");
+    const bool each = hasFlag(argc, argv, 4, "--each");
+    const SplitParts job = { model, outName, withinGroups, each };
+    if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
+    return 0;
+  }
+
+  if (command == "glb")
+  {
+    if (argc < 4)
+    {
+      cerr << "glb requires an <out-file>\n";
+      return 1;
+    }
+    const string outName = argv[3];
+    bool written = false;
+    const WriteGlb job = { welded, outName, &written };
+    if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
+    return written ? 0 : 1;
+  }
+
+  if (command == "reorder")
   {
-    case obj::kPosition: extractGroups(meshFromObj<VertexP>(model)); break;
-    case obj::kPositionUV: extractGroups(meshFromObj<VertexPT>(model)); break;
-    case obj::kPositionNormal: extractGroups(meshFromObj<VertexPN>(model)); break;
-    case obj::kPositionUVNormal: extractGroups(meshFromObj<VertexPTN>(model)); break;
-    default: cerr << "Invalid vertex format" << endl; break;
+    if (argc < 4)
+    {
+      cerr << "reorder requires an <out-file>\n";
+      return 1;
+    }
+    const ReorderMesh job = { welded, argv[3] };
+    if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
+    return 0;
   }
+
+  if (command == "ply")
+  {
+    if (argc < 4)
+    {
+      cerr << "ply requires an <out-file>\n";
+      return 1;
+    }
+    const string outName = argv[3];
+    bool written = false;
+    const WritePly job = { welded, outName, &written };
+    if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
+    return written ? 0 : 1;
+  }
+
+  if (command == "place")
+  {
+    if (argc < 5)
+    {
+      cerr << "place requires an <out-file> and a <manifest>\n";
+      return 1;
+    }
+    PlaceGroups job = { model, vector<Placement>(), argv[3], TransformOptions() };
+    if (!readPlacements(argv[4], job.placements))
+    {
+      cerr << "error reading " << argv[4] << endl;
+      return 1;
+    }
+    job.options.renormalize = !hasFlag(argc, argv, 5, "--no-renormalize");
+    if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
+    return 0;
+  }
+
+  if (command == "tiles")
+  {
+    if (argc < 5)
+    {
+      cerr << "tiles requires an <out-prefix> and a <triangle-budget>\n";
+      return 1;
+    }
+    const uint32_t budget = strtoul(argv[4], NULL, 10);
+    if (budget == 0)
+    {
+      cerr << "invalid triangle budget '" << argv[4] << "'\n";
+      return 1;
+    }
+    const string extension = hasFlag(argc, argv, 5, "--glb") ? ".glb" : 
+      hasFlag(argc, argv, 5, "--ply") ? ".ply" : ".obj";
+    const TileMesh job = { welded, argv[3], budget, extension };
+    if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
+    return 0;
+  }
+
+  if (command == "merge")
+  {
+    if (argc < 4)
+    {
+      cerr << "merge requires an <out-file>\n";
+      return 1;
+    }
+    MergeModels job = { vector<obj::ModelPtr>(1, model), argv[3] };
+    for (int i = 4; i < argc; ++i)
+    {
+      obj::ModelPtr more = translator.importFile(argv[i]);
+      if (!more || more->vertexFormat() != model->vertexFormat())
+      {
+        cerr << "Error importing " << argv[i] << (more ? ": vertex format differs" : "") << endl;
+        return 1;
+      }
+      job.models.push_back(more);
+    }
+    if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
+    return 0;
+  }
+
+  if (command == "instances")
+  {
+    if (argc < 4)
+    {
+      cerr << "instances requires an <out-file>\n";
+      return 1;
+    }
+    const ExtractInstances job = { welded, argv[3], argc > 4 ? strtof(argv[4], NULL) : 1e-4f };
+    if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
+    return 0;
+  }
+
+  if (command != "xg")
+  {
+    cerr << "Unknown command '" << command << "'\n";
+    return 1;
+  }
+
+  const ExtractGroups job = { model };
+  if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
   return 0;
 }
@@ -69,6 +69,12 @@ void doMesh(shared_ptr<V> mesh)
   }
 }
 
+struct DumpMesh
+{
+  obj::ModelPtr model;
+
+  template <typename V> void apply()const { doMesh(meshFromObj<V>(model)); }
+};
 
 int main(int argc, char **argv)
 {
@@ -87,13 +93,7 @@ int main(int argc, char **argv)
   }
   cout << "vertexFormat: " << model->vertexFormat() << endl;
 //  processModel(model, doMesh);
-  switch (model->vertexFormat())
-  {
-    case obj::kPosition: doMesh(meshFromObj<VertexP>(model)); break;
-    case obj::kPositionUV: doMesh(meshFromObj<VertexPT>(model)); break;
-    case obj::kPositionNormal: doMesh(meshFromObj<VertexPN>(model)); break;
-    case obj::kPositionUVNormal: doMesh(meshFromObj<VertexPTN>(model)); break;
-    default: cerr << "Invalid vertex format" << endl; break;
-  }
+  const DumpMesh job = { model };
+  if (!dispatchVertexFormat(model->vertexFormat(), job)) cerr << "Invalid vertex format" << endl;
   return 0;
 }
@@ -1,7 +1,7 @@
 # This package isn't used, it's merely to show how packages are declared.
 PACKAGE_BOOST = {
   :name => "Boost",
-  :components => "system filesystem",
+  :components => "system filesystem thread iostreams",
 #  :version => "1.36.0",
   :required => true,
   :optional_cmake => ""  # Insert package-missing-handler
@@ -119,6 +119,50 @@ PROJECT =
     :install => true,
     :sources => "apps/lapquery",
     :common => 
+    {
+      :packages => [],
+      :definitions => [],
+      :include_dirs => [],
+      :link_dirs => [],
+      :libs => ["lap"]
+    }
+  }, {
+    :name => "meshlocality",
+    :type => :executable,
+    :depends => "lap",
+    :install => false,
+    :sources => "tests/meshlocality",
+    :common => 
+    {
+      :packages => [],
+      :definitions => [],
+      :include_dirs => [],
+      :link_dirs => [],
+      :libs => ["lap"]
+    }
+  }, {
+    :name => "objformat",
+    :type => :executable,
+    :depends => "lap",
+    :install => false,
+    :test => true,
+    :sources => "tests/objformat",
+    :common => 
+    {
+      :packages => [],
+      :definitions => [],
+      :include_dirs => [],
+      :link_dirs => [],
+      :libs => ["lap"]
+    }
+  }, {
+    :name => "meshweld",
+    :type => :executable,
+    :depends => "lap",
+    :install => false,
+    :test => true,
+    :sources => "tests/meshweld",
+    :common => 
     {
       :packages => [],
       :definitions => [],
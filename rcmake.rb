@@ -6,7 +6,7 @@ SCHEMES = ['Debug', 'Release']#, 'MinSizeRel']
 PLATFORMS = [:common, :linux, :apple, :windows]
 
 PROJECT_SYMBOLS = [:name, :cmake_version, :targets]
-TARGET_SYMBOLS = [:name, :type, :install, :sources].concat(PLATFORMS)
+TARGET_SYMBOLS = [:name, :type, :install, :test, :sources].concat(PLATFORMS)
 PLATFORM_SYMBOLS = [:packages, :definitions, :include_dirs, :link_dirs, :libs]
 PACKAGE_SYMBOLS = [:name, :components, :version, :required, :optional_cmake]
 
@@ -71,6 +71,10 @@ def generateDepends(name, dependsOn)
   "add_dependencies(#{name} #{dependsOn})" if dependsOn
 end
 
+def generateTest(name, isTest)
+  "add_test(#{name} #{name})" if isTest
+end
+
 def generateInstalls(sourceRoot, projectName)
   headers = []
   headers.concat findFiles(sourceRoot, %r{\.(h|hpp)$}).map {|h|
@@ -89,6 +93,7 @@ def generateCMake(project, platform, scheme)
   contents = []
   contents << "cmake_minimum_required(VERSION #{project[:cmake_version]})"
   contents << "project(#{project[:name]})"
+  contents << "enable_testing()" if project[:targets].any? {|x| x[:test] }
   project[:targets].each {|x|
     contents.concat generatePlatform(x[:common], x[:name])
     contents.concat generatePlatform(x[platform], x[:name]) if x[platform]
@@ -96,6 +101,7 @@ def generateCMake(project, platform, scheme)
     contents.concat generateSourceGroups(x[:sources])
     contents << generateTarget(x[:name], x[:type])
     contents << generateDepends(x[:name], x[:depends])
+    contents << generateTest(x[:name], x[:test]) if x[:test]
     contents.concat generatePackages(x[:common], x[:name])
     contents.concat generatePackages(x[platform], x[:name]) if x[platform]
     contents.concat generateInstalls(x[:sources], project[:name]) if x[:install]
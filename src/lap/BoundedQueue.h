@@ -0,0 +1,90 @@
+#ifndef LAP_BOUNDED_QUEUE_H
+#define LAP_BOUNDED_QUEUE_H
+
+#include <deque>
+#include <stdint.h>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace lap
+{
+  //! Blocking FIFO between pipeline stages. push waits while the queue is
+  //! full, which throttles producers to the pace of consumers. Once every 
+  //! producer has called producerDone, pop drains what's left and then 
+  //! returns false.
+  template <typename T>
+    class BoundedQueue
+    {
+      public:
+        BoundedQueue(uint32_t capacity, uint32_t producers = 1):
+          _capacity(capacity),
+          _producers(producers)
+      {}
+
+        void push(const T& item)
+        {
+          boost::mutex::scoped_lock lock(_mutex);
+          while (_items.size() >= _capacity) _notFull.wait(lock);
+          _items.push_back(item);
+          _notEmpty.notify_one();
+        }
+
+        bool pop(T& item)
+        {
+          boost::mutex::scoped_lock lock(_mutex);
+          while (_items.empty() && _producers > 0) _notEmpty.wait(lock);
+          if (_items.empty()) return false;
+          item = _items.front();
+          _items.pop_front();
+          _notFull.notify_one();
+          return true;
+        }
+
+        void producerDone()
+        {
+          boost::mutex::scoped_lock lock(_mutex);
+          if (_producers > 0 && --_producers == 0) _notEmpty.notify_all();
+        }
+
+      private:
+        std::deque<T> _items;
+        uint32_t _capacity;
+        uint32_t _producers;
+        boost::mutex _mutex;
+        boost::condition_variable _notFull;
+        boost::condition_variable _notEmpty;
+    };
+
+  //! Bounds how far a numbered stream runs ahead of an in-order consumer.
+  //! acquire waits until sequence is within size of the oldest sequence not
+  //! yet released; release advances that by one.
+  class SequenceWindow
+  {
+    public:
+      explicit SequenceWindow(uint32_t size):
+        _size(size),
+        _next(0)
+    {}
+
+      void acquire(uint32_t sequence)
+      {
+        boost::mutex::scoped_lock lock(_mutex);
+        while (sequence >= _next + _size) _advanced.wait(lock);
+      }
+
+      void release()
+      {
+        boost::mutex::scoped_lock lock(_mutex);
+        ++_next;
+        _advanced.notify_all();
+      }
+
+    private:
+      uint32_t _size;
+      uint32_t _next;
+      boost::mutex _mutex;
+      boost::condition_variable _advanced;
+  };
+}
+
+#endif
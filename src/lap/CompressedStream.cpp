@@ -0,0 +1,84 @@
+#include "CompressedStream.h"
+#include <fstream>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace io = boost::iostreams;
+
+namespace lap
+{
+  namespace
+  {
+    // Buffer between the file and the decompressor, large enough that the
+    // decompressor rather than read calls sets the pace.
+    const std::streamsize kBufferSize = 1 << 20;
+
+    Compression sniffCompression(const std::string& filename, bool* opened)
+    {
+      std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+      *opened = in.is_open();
+      unsigned char magic[4] = { 0, 0, 0, 0 };
+      in.read(reinterpret_cast<char*>(magic), sizeof(magic));
+      if (in.gcount() >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return kGzip;
+      if (in.gcount() == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && 
+          magic[2] == 0x2f && magic[3] == 0xfd) return kZstd;
+      return kUncompressed;
+    }
+  }
+
+  Compression compressionForPath(const std::string& filename)
+  {
+    if (boost::algorithm::iends_with(filename, ".gz")) return kGzip;
+    if (boost::algorithm::iends_with(filename, ".zst")) return kZstd;
+    return kUncompressed;
+  }
+
+  std::string stripCompressionExtension(const std::string& filename)
+  {
+    switch (compressionForPath(filename))
+    {
+      case kGzip: return filename.substr(0, filename.size() - 3);
+      case kZstd: return filename.substr(0, filename.size() - 4);
+      default: return filename;
+    }
+  }
+
+  IStreamPtr openInput(const std::string& filename)
+  {
+    bool opened;
+    const Compression compression = sniffCompression(filename, &opened);
+    if (!opened) return IStreamPtr();
+    if (compression == kUncompressed)
+    {
+      return IStreamPtr(new std::ifstream(filename.c_str(), std::ios::in | std::ios::binary));
+    }
+
+    std::tr1::shared_ptr<io::filtering_istream> in(new io::filtering_istream());
+    if (compression == kGzip) in->push(io::gzip_decompressor(io::gzip::default_window_bits, kBufferSize));
+    else in->push(io::zstd_decompressor(kBufferSize));
+    in->push(io::file_source(filename, std::ios::in | std::ios::binary), kBufferSize);
+    return in;
+  }
+
+  OStreamPtr openOutput(const std::string& filename)
+  {
+    const Compression compression = compressionForPath(filename);
+    if (compression == kUncompressed)
+    {
+      std::tr1::shared_ptr<std::ofstream> out(new std::ofstream(filename.c_str()));
+      if (!out->is_open()) return OStreamPtr();
+      return out;
+    }
+
+    io::file_sink sink(filename, std::ios::out | std::ios::binary);
+    if (!sink.is_open()) return OStreamPtr();
+    std::tr1::shared_ptr<io::filtering_ostream> out(new io::filtering_ostream());
+    if (compression == kGzip) out->push(io::gzip_compressor(io::gzip_params(), kBufferSize));
+    else out->push(io::zstd_compressor(io::zstd_params(), kBufferSize));
+    out->push(sink, kBufferSize);
+    return out;
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef LAP_COMPRESSED_STREAM_H
+#define LAP_COMPRESSED_STREAM_H
+
+#include <iosfwd>
+#include <string>
+#include <tr1/memory>
+
+namespace lap
+{
+  enum Compression
+  {
+    kUncompressed,
+    kGzip,
+    kZstd
+  };
+
+  //! Compression named by a trailing .gz or .zst.
+  Compression compressionForPath(const std::string& filename);
+
+  //! filename without a trailing .gz or .zst, eg. mesh.obj for mesh.obj.gz.
+  std::string stripCompressionExtension(const std::string& filename);
+
+  typedef std::tr1::shared_ptr<std::istream> IStreamPtr;
+  typedef std::tr1::shared_ptr<std::ostream> OStreamPtr;
+
+  //! Open filename for reading, decompressing gzip or zstd as it's read.
+  //! The format is detected from the leading magic bytes, not the name. 
+  //! Returns null if the file can't be opened.
+  IStreamPtr openInput(const std::string& filename);
+
+  //! Open filename for writing, compressed per compressionForPath. The 
+  //! compressed stream is finished when the last reference is released.
+  //! Returns null if the file can't be created.
+  OStreamPtr openOutput(const std::string& filename);
+}
+
+#endif
@@ -0,0 +1,134 @@
+#include "Dedup.h"
+#include "Parallel.h"
+#include "RadixSort.h"
+#include <boost/lambda/bind.hpp>
+#include <boost/lambda/lambda.hpp>
+
+using namespace boost::lambda;
+
+namespace lap
+{
+  namespace
+  {
+    // Works over the sorted (key, position) pairs of a radix dedup.
+    struct SortedRuns
+    {
+      const uint64_t* keys;
+      const uint32_t* order;
+      uint32_t count;
+      std::vector<uint8_t> leaders; // Indexed by original position.
+      std::vector<uint32_t> ids; // Exclusive scan of leaders.
+      std::vector<uint32_t> chunkSums;
+      uint32_t* indices;
+      uint32_t* firsts;
+
+      bool startsRun(uint32_t i)const { return i == 0 || keys[i] != keys[i-1]; }
+
+      void markLeaders(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+          if (startsRun(i)) leaders[order[i]] = 1;
+        }
+      }
+
+      void sumLeaders(uint32_t chunk, uint32_t begin, uint32_t end)
+      {
+        uint32_t sum = 0;
+        for (uint32_t i = begin; i < end; ++i) sum += leaders[i];
+        chunkSums[chunk] = sum;
+      }
+
+      void scanLeaders(uint32_t chunk, uint32_t begin, uint32_t end)
+      {
+        uint32_t id = chunkSums[chunk];
+        for (uint32_t i = begin; i < end; ++i)
+        {
+          ids[i] = id;
+          id += leaders[i];
+        }
+      }
+
+      // Stable sort means a run's first pair is its first occurrence; chunks
+      // starting mid-run walk back to find it.
+      void assign(uint32_t begin, uint32_t end)
+      {
+        if (begin == end) return;
+        uint32_t leader = begin;
+        while (!startsRun(leader)) --leader;
+        for (uint32_t i = begin; i < end; ++i)
+        {
+          if (startsRun(i)) 
+          {
+            leader = i;
+            firsts[ids[order[i]]] = order[i];
+          }
+          indices[order[i]] = ids[order[leader]];
+        }
+      }
+    };
+  }
+
+  uint32_t hashDedupKeys(const std::vector<uint64_t>& keys,
+      std::vector<uint32_t>& indices, std::vector<uint32_t>& firsts)
+  {
+    FlatIndexMap<uint64_t> map(keys.size());
+    indices.resize(keys.size());
+    firsts.clear();
+    for (uint32_t i = 0; i < keys.size(); ++i)
+    {
+      std::pair<uint32_t, bool> pib = map.insert(keys[i], firsts.size());
+      if (pib.second) firsts.push_back(i);
+      indices[i] = pib.first;
+    }
+    return firsts.size();
+  }
+
+  uint32_t radixDedupKeys(const std::vector<uint64_t>& keys, uint32_t keyBits,
+      std::vector<uint32_t>& indices, std::vector<uint32_t>& firsts)
+  {
+    const uint32_t count = keys.size();
+    std::vector<uint64_t> sorted(keys);
+    std::vector<uint32_t> order(count);
+    for (uint32_t i = 0; i < count; ++i) order[i] = i;
+    radixSortPairs(sorted, order, keyBits);
+
+    SortedRuns runs;
+    runs.keys = count ? &sorted[0] : NULL;
+    runs.order = count ? &order[0] : NULL;
+    runs.count = count;
+    runs.leaders.assign(count, 0);
+    runs.ids.resize(count);
+    parallelFor(count, bind(&SortedRuns::markLeaders, &runs, _1, _2));
+
+    // Number unique keys by the position of their first occurrence.
+    const uint32_t chunks = chunkCount(count, 1 << 16);
+    runs.chunkSums.resize(chunks);
+    parallelChunks(count, chunks, bind(&SortedRuns::sumLeaders, &runs, _1, _2, _3));
+    uint32_t unique = 0;
+    for (uint32_t c = 0; c < chunks; ++c)
+    {
+      uint32_t n = runs.chunkSums[c];
+      runs.chunkSums[c] = unique;
+      unique += n;
+    }
+    parallelChunks(count, chunks, bind(&SortedRuns::scanLeaders, &runs, _1, _2, _3));
+
+    indices.resize(count);
+    firsts.resize(unique);
+    runs.indices = count ? &indices[0] : NULL;
+    runs.firsts = unique ? &firsts[0] : NULL;
+    parallelFor(count, bind(&SortedRuns::assign, &runs, _1, _2));
+    return unique;
+  }
+
+  uint32_t dedupKeys(const std::vector<uint64_t>& keys, uint32_t keyBits,
+      std::vector<uint32_t>& indices, std::vector<uint32_t>& firsts)
+  {
+    if (keys.size() >= kRadixDedupThreshold && workerCount() > 1)
+    {
+      return radixDedupKeys(keys, keyBits, indices, firsts);
+    }
+    return hashDedupKeys(keys, indices, firsts);
+  }
+}
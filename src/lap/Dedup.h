@@ -0,0 +1,133 @@
+#ifndef LAP_DEDUP_H
+#define LAP_DEDUP_H
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include <tr1/unordered_map>
+#include "MeshMath.h"
+
+namespace lap
+{
+  //! Finalizer from MurmurHash3, spreads weak hashes (eg. identity) over all bits.
+  inline uint64_t mixHash(uint64_t h)
+  {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  //! Open-addressing key -> index table with linear probing. Keys and values
+  //! live in two flat arrays, so there's no allocation per entry. Size it up
+  //! front with the expected entry count; it doubles if that's exceeded.
+  template <typename K, typename H = std::tr1::hash<K> >
+    class FlatIndexMap
+    {
+      public:
+        static const uint32_t kEmpty = ~0u;
+
+        explicit FlatIndexMap(uint32_t expected = 0):
+          _size(0)
+        { 
+          reserve(expected); 
+        }
+
+        uint32_t size()const { return _size; }
+
+        void reserve(uint32_t expected)
+        {
+          uint32_t capacity = 16;
+          while (capacity < 2 * (uint64_t)expected) capacity *= 2;
+          if (capacity > _values.size()) rehash(capacity);
+        }
+
+        //! Find key, inserting it mapped to value if absent. Returns the mapped
+        //! value and whether it was inserted. value must not be kEmpty.
+        std::pair<uint32_t, bool> insert(const K& key, uint32_t value)
+        {
+          if (2 * (_size + 1) > _values.size()) rehash(2 * _values.size());
+          const uint32_t mask = _values.size() - 1;
+          for (uint32_t slot = slotFor(key, mask); ; slot = (slot + 1) & mask)
+          {
+            if (_values[slot] == kEmpty)
+            {
+              _keys[slot] = key;
+              _values[slot] = value;
+              ++_size;
+              return std::make_pair(value, true);
+            }
+            if (_keys[slot] == key) return std::make_pair(_values[slot], false);
+          }
+        }
+
+      private:
+        std::vector<K> _keys;
+        std::vector<uint32_t> _values;
+        uint32_t _size;
+        H _hasher;
+
+        uint32_t slotFor(const K& key, uint32_t mask)const
+        {
+          return mixHash(_hasher(key)) & mask;
+        }
+
+        void rehash(uint32_t capacity)
+        {
+          std::vector<K> keys(capacity);
+          std::vector<uint32_t> values(capacity, kEmpty);
+          keys.swap(_keys);
+          values.swap(_values);
+          _size = 0;
+          for (uint32_t i = 0; i < values.size(); ++i)
+          {
+            if (values[i] != kEmpty) insert(keys[i], values[i]);
+          }
+        }
+    };
+
+  template <typename K, typename H>
+    const uint32_t FlatIndexMap<K, H>::kEmpty;
+
+  //! Ids of the distinct vertex positions, numbered in first-seen order.
+  //! Returns the number of distinct positions.
+  template <typename V>
+    uint32_t weldPositions(const std::vector<V>& vertices, 
+        std::vector<uint32_t>& ids, std::vector<float3>& unique)
+    {
+      FlatIndexMap<float3> map(vertices.size());
+      ids.resize(vertices.size());
+      unique.clear();
+      for (uint32_t i = 0; i < vertices.size(); ++i)
+      {
+        std::pair<uint32_t, bool> pib = map.insert(vertices[i].position, unique.size());
+        if (pib.second) unique.push_back(vertices[i].position);
+        ids[i] = pib.first;
+      }
+      return unique.size();
+    }
+
+  //! Below this many keys dedupKeys uses the flat hash, above it the 
+  //! parallel radix sort (given more than one worker).
+  const uint32_t kRadixDedupThreshold = 1 << 22;
+
+  //! Assigns each key a dense index in order of first appearance, so 
+  //! indices[i] is the id of keys[i] and firsts[id] the position of its
+  //! first occurrence. Only the low keyBits of each key are significant.
+  //! Returns the number of unique keys.
+  uint32_t dedupKeys(const std::vector<uint64_t>& keys, uint32_t keyBits,
+      std::vector<uint32_t>& indices, std::vector<uint32_t>& firsts);
+
+  //! dedupKeys using a single-threaded open-addressing table.
+  uint32_t hashDedupKeys(const std::vector<uint64_t>& keys,
+      std::vector<uint32_t>& indices, std::vector<uint32_t>& firsts);
+
+  //! dedupKeys using a parallel radix-sort-and-unique. Same results as 
+  //! hashDedupKeys.
+  uint32_t radixDedupKeys(const std::vector<uint64_t>& keys, uint32_t keyBits,
+      std::vector<uint32_t>& indices, std::vector<uint32_t>& firsts);
+}
+
+#endif
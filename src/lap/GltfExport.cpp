@@ -0,0 +1,391 @@
+#include "GltfExport.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace lap
+{
+  namespace
+  {
+    const uint32_t kGlbMagic = 0x46546C67; // "glTF"
+    const uint32_t kGlbVersion = 2;
+    const uint32_t kChunkJson = 0x4E4F534A;
+    const uint32_t kChunkBin = 0x004E4942;
+
+    const uint32_t kFloat = 5126;
+    const uint32_t kUnsignedShort = 5123;
+    const uint32_t kUnsignedInt = 5125;
+    const uint32_t kArrayBuffer = 34962;
+    const uint32_t kElementArrayBuffer = 34963;
+
+    // glTF forbids the largest value of an index type, it's reserved for
+    // primitive restart.
+    const uint32_t kMaxShortIndex = 0xfffe;
+
+    struct Primitive
+    {
+      uint32_t mesh;
+      uint32_t begin; // First index
+      uint32_t count;
+      int material;
+      bool shortIndices;
+      uint32_t byteOffset; // Within its index view
+      uint32_t minIndex; // Start of its vertex span, its indices are relative to it
+      uint32_t span; // Index of its first attribute accessor / attribute count
+    };
+
+    // The vertices [begin, end) some primitives use.
+    struct Span
+    {
+      uint32_t begin;
+      uint32_t end;
+    };
+
+    inline uint32_t padded(uint32_t bytes) { return (bytes + 3) & ~3u; }
+
+    std::string quoted(const std::string& s)
+    {
+      std::ostringstream os;
+      os << '"';
+      for (std::string::const_iterator c = s.begin(); c != s.end(); ++c)
+      {
+        if (*c == '"' || *c == '\\') os << '\\' << *c;
+        else if ((unsigned char)*c < 0x20)
+          os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)*c << std::dec;
+        else os << *c;
+      }
+      os << '"';
+      return os.str();
+    }
+
+    template <typename T>
+      void writeArray(std::ostream& os, const T* values, uint32_t count)
+      {
+        os << '[';
+        for (uint32_t i = 0; i < count; ++i) os << (i ? "," : "") << values[i];
+        os << ']';
+      }
+
+    void writeVec3(std::ostream& os, const float3& v)
+    {
+      const float values[3] = { v[0], v[1], v[2] };
+      writeArray(os, values, 3);
+    }
+
+    void writeUint32(std::ostream& os, uint32_t v)
+    {
+      const unsigned char bytes[4] = { (unsigned char)(v & 0xff), (unsigned char)((v >> 8) & 0xff),
+        (unsigned char)((v >> 16) & 0xff), (unsigned char)(v >> 24) };
+      os.write(reinterpret_cast<const char*>(bytes), 4);
+    }
+
+    void writePadding(std::ostream& os, uint32_t bytes, char pad)
+    {
+      for (uint32_t i = bytes; i < padded(bytes); ++i) os.put(pad);
+    }
+
+    const char* accessorType(uint32_t components)
+    {
+      switch (components)
+      {
+        case 2: return "VEC2";
+        case 3: return "VEC3";
+        case 4: return "VEC4";
+        default: return "SCALAR";
+      }
+    }
+
+    // Split each geometry-group by material-group, covering gaps without a
+    // material so no triangle is lost. Groups without a triangle are left
+    // out, a glTF mesh needs at least one primitive.
+    void buildPrimitives(const GlbMesh& mesh, std::vector<Group>& meshes,
+        std::vector<Primitive>& primitives, std::vector<std::string>& materialNames)
+    {
+      const uint32_t indexCount = mesh.indices->size();
+      for (GroupConstIter g = mesh.geometryGroups->begin(); g != mesh.geometryGroups->end(); ++g)
+      {
+        if (g->count() >= 3) meshes.push_back(*g);
+      }
+      if (meshes.empty()) meshes.push_back(Group("default", 0, indexCount));
+
+      std::vector<Group> materialGroups = *mesh.materialGroups;
+      std::sort(materialGroups.begin(), materialGroups.end());
+      std::map<std::string, int> materialIds;
+
+      for (uint32_t m = 0; m < meshes.size(); ++m)
+      {
+        const Group& g = meshes[m];
+        uint32_t at = g.begin();
+        for (GroupConstIter i = materialGroups.begin(); i <= materialGroups.end(); ++i)
+        {
+          const bool done = i == materialGroups.end();
+          const uint32_t begin = done ? g.end() : std::max(i->begin(), at);
+          const uint32_t end = done ? g.end() : std::min(i->end(), g.end());
+          if (std::min(begin, g.end()) > at)
+          {
+            Primitive gap = { m, at, std::min(begin, g.end()) - at, -1, false, 0, 0, 0 };
+            primitives.push_back(gap);
+            at = gap.begin + gap.count;
+          }
+          if (done) break;
+          if (end <= begin) continue;
+
+          std::map<std::string, int>::iterator id = materialIds.find(i->name());
+          if (id == materialIds.end())
+          {
+            id = materialIds.insert(std::make_pair(i->name(), (int)materialNames.size())).first;
+            materialNames.push_back(i->name());
+          }
+          Primitive p = { m, begin, end - begin, id->second, false, 0, 0, 0 };
+          primitives.push_back(p);
+          at = end;
+        }
+      }
+    }
+
+    // Phong exponent to GGX roughness, as in Walter et al. 2007.
+    float roughnessFromNs(float Ns)
+    {
+      return std::min(1.0f, std::max(0.0f, sqrtf(2.0f / (std::max(Ns, 0.0f) + 2.0f))));
+    }
+
+    int textureFor(const std::string& path, std::vector<std::string>& images)
+    {
+      if (path.empty()) return -1;
+      std::vector<std::string>::iterator i = std::find(images.begin(), images.end(), path);
+      if (i != images.end()) return i - images.begin();
+      images.push_back(path);
+      return images.size() - 1;
+    }
+
+    // KHR_materials_specular is only needed for a specular colour other than
+    // its default of white.
+    bool usesSpecular(const Material& m)
+    {
+      return !m.map_Ks.empty() || m.Ks[0] != 1.0f || m.Ks[1] != 1.0f || m.Ks[2] != 1.0f;
+    }
+
+    void writeMaterial(std::ostream& os, const Material& m, std::vector<std::string>& images)
+    {
+      const float baseColor[4] = { m.Kd[0], m.Kd[1], m.Kd[2], m.d };
+      const int baseTexture = textureFor(m.map_Kd, images);
+      const int specularTexture = textureFor(m.map_Ks, images);
+
+      os << "{\"name\":" << quoted(m.name())
+        << ",\"pbrMetallicRoughness\":{\"baseColorFactor\":";
+      writeArray(os, baseColor, 4);
+      os << ",\"metallicFactor\":0,\"roughnessFactor\":" << roughnessFromNs(m.Ns);
+      if (baseTexture >= 0) os << ",\"baseColorTexture\":{\"index\":" << baseTexture << '}';
+      os << '}';
+      if (m.d < 1.0f) os << ",\"alphaMode\":\"BLEND\"";
+
+      if (usesSpecular(m))
+      {
+        os << ",\"extensions\":{\"KHR_materials_specular\":{\"specularColorFactor\":";
+        writeVec3(os, m.Ks);
+        if (specularTexture >= 0)
+          os << ",\"specularColorTexture\":{\"index\":" << specularTexture << '}';
+        os << "}}";
+      }
+      os << '}';
+    }
+  }
+
+  bool writeGlb(const GlbMesh& mesh, const std::string& filename)
+  {
+    if (mesh.vertexCount == 0 || mesh.indices->empty()) return false;
+
+    std::vector<Group> meshes;
+    std::vector<Primitive> primitives;
+    std::vector<std::string> materialNames;
+    buildPrimitives(mesh, meshes, primitives, materialNames);
+
+    // Lay out the binary chunk: vertices, 32-bit indices, then 16-bit.
+    const std::vector<uint32_t>& indices = *mesh.indices;
+    std::vector<Span> spans;
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> spanIds;
+    uint32_t longBytes = 0;
+    uint32_t shortBytes = 0;
+    for (std::vector<Primitive>::iterator p = primitives.begin(); p != primitives.end(); ++p)
+    {
+      const uint32_t* first = &indices[p->begin];
+      const Span span = { *std::min_element(first, first + p->count),
+        *std::max_element(first, first + p->count) + 1 };
+      p->minIndex = span.begin;
+      p->span = spanIds.insert(std::make_pair(std::make_pair(span.begin, span.end), spans.size())).first->second;
+      if (p->span == spans.size()) spans.push_back(span);
+      p->shortIndices = span.end - 1 - span.begin <= kMaxShortIndex;
+      uint32_t& bytes = p->shortIndices ? shortBytes : longBytes;
+      p->byteOffset = bytes;
+      bytes += p->count * (p->shortIndices ? 2 : 4);
+    }
+    const uint32_t vertexBytes = mesh.vertexCount * mesh.stride;
+    const uint32_t longOffset = padded(vertexBytes);
+    const uint32_t shortOffset = longOffset + longBytes;
+    const uint32_t binBytes = padded(shortOffset + shortBytes);
+    const int longView = longBytes ? 1 : -1;
+    const int shortView = shortBytes ? (longBytes ? 2 : 1) : -1;
+
+    std::vector<Material> materials;
+    bool specular = false;
+    for (std::vector<std::string>::const_iterator n = materialNames.begin(); n != materialNames.end(); ++n)
+    {
+      MaterialMap::const_iterator found = mesh.materials->find(*n);
+      materials.push_back(found == mesh.materials->end() ? Material(*n) : found->second);
+      specular = specular || usesSpecular(materials.back());
+    }
+
+    std::ostringstream json;
+    json << std::setprecision(9);
+    json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"lap\"}";
+    if (specular) json << ",\"extensionsUsed\":[\"KHR_materials_specular\"]";
+    json << ",\"buffers\":[{\"byteLength\":" << binBytes << "}]";
+
+    json << ",\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << vertexBytes
+      << ",\"byteStride\":" << mesh.stride << ",\"target\":" << kArrayBuffer << '}';
+    if (longBytes) json << ",{\"buffer\":0,\"byteOffset\":" << longOffset
+      << ",\"byteLength\":" << longBytes << ",\"target\":" << kElementArrayBuffer << '}';
+    if (shortBytes) json << ",{\"buffer\":0,\"byteOffset\":" << shortOffset
+      << ",\"byteLength\":" << shortBytes << ",\"target\":" << kElementArrayBuffer << '}';
+    json << ']';
+
+    // Attribute accessors for each span, index accessors follow.
+    const uint32_t attributeCount = mesh.attributes.size();
+    json << ",\"accessors\":[";
+    for (uint32_t s = 0; s < spans.size(); ++s)
+    {
+      for (uint32_t a = 0; a < attributeCount; ++a)
+      {
+        const GlbAttribute& attribute = mesh.attributes[a];
+        json << (s || a ? "," : "") << "{\"bufferView\":0,\"byteOffset\":"
+          << attribute.offset + spans[s].begin * mesh.stride
+          << ",\"componentType\":" << kFloat << ",\"count\":" << spans[s].end - spans[s].begin
+          << ",\"type\":\"" << accessorType(attribute.components) << '"';
+        if (std::string(attribute.semantic) == "POSITION")
+        {
+          const BoundingBox<float3> bounds = mesh.bounds(spans[s].begin, spans[s].end);
+          json << ",\"min\":";
+          writeVec3(json, bounds.min());
+          json << ",\"max\":";
+          writeVec3(json, bounds.max());
+        }
+        json << '}';
+      }
+    }
+    for (std::vector<Primitive>::const_iterator p = primitives.begin(); p != primitives.end(); ++p)
+    {
+      json << ",{\"bufferView\":" << (p->shortIndices ? shortView : longView)
+        << ",\"byteOffset\":" << p->byteOffset
+        << ",\"componentType\":" << (p->shortIndices ? kUnsignedShort : kUnsignedInt)
+        << ",\"count\":" << p->count << ",\"type\":\"SCALAR\"}";
+    }
+    json << ']';
+
+    json << ",\"meshes\":[";
+    for (uint32_t m = 0, p = 0; m < meshes.size(); ++m)
+    {
+      json << (m ? "," : "") << "{\"name\":" << quoted(meshes[m].name()) << ",\"primitives\":[";
+      for (bool first = true; p < primitives.size() && primitives[p].mesh == m; ++p, first = false)
+      {
+        json << (first ? "" : ",") << "{\"attributes\":{";
+        for (uint32_t a = 0; a < attributeCount; ++a)
+        {
+          json << (a ? "," : "") << '"' << mesh.attributes[a].semantic << "\":"
+            << primitives[p].span * attributeCount + a;
+        }
+        json << "},\"indices\":" << spans.size() * attributeCount + p;
+        if (primitives[p].material >= 0) json << ",\"material\":" << primitives[p].material;
+        json << '}';
+      }
+      json << "]}";
+    }
+    json << ']';
+
+    json << ",\"nodes\":[";
+    for (uint32_t m = 0; m < meshes.size(); ++m) json << (m ? "," : "") << "{\"mesh\":" << m << '}';
+    json << "],\"scenes\":[{\"nodes\":[";
+    for (uint32_t m = 0; m < meshes.size(); ++m) json << (m ? "," : "") << m;
+    json << "]}],\"scene\":0";
+
+    std::vector<std::string> images;
+    if (!materials.empty())
+    {
+      json << ",\"materials\":[";
+      for (uint32_t i = 0; i < materials.size(); ++i)
+      {
+        if (i) json << ',';
+        writeMaterial(json, materials[i], images);
+      }
+      json << ']';
+    }
+    if (!images.empty())
+    {
+      json << ",\"samplers\":[{}],\"images\":[";
+      for (uint32_t i = 0; i < images.size(); ++i) json << (i ? "," : "") << "{\"uri\":" << quoted(images[i]) << '}';
+      json << "],\"textures\":[";
+      for (uint32_t i = 0; i < images.size(); ++i) json << (i ? "," : "") << "{\"sampler\":0,\"source\":" << i << '}';
+      json << ']';
+    }
+    json << '}';
+
+    const std::string header = json.str();
+    const uint32_t jsonBytes = padded(header.size());
+
+    std::ofstream os(filename.c_str(), std::ios::out | std::ios::binary);
+    if (!os.is_open()) return false;
+    writeUint32(os, kGlbMagic);
+    writeUint32(os, kGlbVersion);
+    writeUint32(os, 12 + 8 + jsonBytes + 8 + binBytes);
+    writeUint32(os, jsonBytes);
+    writeUint32(os, kChunkJson);
+    os.write(header.data(), header.size());
+    writePadding(os, header.size(), ' ');
+    writeUint32(os, binBytes);
+    writeUint32(os, kChunkBin);
+
+    mesh.writeVertices(os);
+    writePadding(os, vertexBytes, 0);
+
+    // Long indices of a span starting at 0 go out straight from the mesh,
+    // others are rebased through a small window.
+    const uint32_t kWindow = 1 << 14;
+    std::vector<uint32_t> window;
+    for (std::vector<Primitive>::const_iterator p = primitives.begin(); p != primitives.end(); ++p)
+    {
+      if (p->shortIndices) continue;
+      const uint32_t* from = &indices[p->begin];
+      if (p->minIndex == 0)
+      {
+        os.write(reinterpret_cast<const char*>(from), p->count * 4);
+        continue;
+      }
+      for (uint32_t begin = 0; begin < p->count; begin += kWindow)
+      {
+        const uint32_t end = std::min(begin + kWindow, p->count);
+        window.resize(end - begin);
+        for (uint32_t i = begin; i < end; ++i) window[i - begin] = from[i] - p->minIndex;
+        os.write(reinterpret_cast<const char*>(&window[0]), window.size() * 4);
+      }
+    }
+
+    if (shortBytes)
+    {
+      std::vector<uint16_t> shortIndices;
+      shortIndices.reserve(shortBytes / 2);
+      for (std::vector<Primitive>::const_iterator p = primitives.begin(); p != primitives.end(); ++p)
+      {
+        if (!p->shortIndices) continue;
+        for (const uint32_t* i = &indices[p->begin]; i != &indices[p->begin] + p->count; ++i)
+        {
+          shortIndices.push_back(*i - p->minIndex);
+        }
+      }
+      os.write(reinterpret_cast<const char*>(&shortIndices[0]), shortBytes);
+    }
+    writePadding(os, shortOffset + shortBytes, 0);
+    return os.good();
+  }
+}
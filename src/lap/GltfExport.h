@@ -0,0 +1,191 @@
+#ifndef LAP_GLTF_EXPORT_H
+#define LAP_GLTF_EXPORT_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include "MeshAsset.h"
+
+namespace lap
+{
+  struct GlbOptions
+  {
+    GlbOptions(): flipV(true) {}
+
+    //! OBJ uvs start bottom-left and glTF's top-left. Without a flip the
+    //! vertices are written straight from the mesh.
+    bool flipV;
+  };
+
+  //! A vertex attribute within the interleaved vertex buffer.
+  struct GlbAttribute
+  {
+    const char* semantic; // POSITION, NORMAL, TEXCOORD_0, TANGENT
+    uint32_t components;
+    uint32_t offset;
+  };
+
+  template <typename V, typename A>
+    uint32_t memberOffset(const V& v, const A& member)
+    {
+      return reinterpret_cast<const char*>(&member) - reinterpret_cast<const char*>(&v);
+    }
+
+  //! Attribute layout of V and its conversion to glTF conventions.
+  template <typename V> struct GlbVertex;
+
+  template <> struct GlbVertex<VertexP>
+  {
+    static void attributes(std::vector<GlbAttribute>& a)
+    {
+      VertexP v;
+      GlbAttribute p = { "POSITION", 3, memberOffset(v, v.position) };
+      a.push_back(p);
+    }
+    static void flipV(VertexP&) {}
+  };
+
+  template <> struct GlbVertex<VertexPN>
+  {
+    static void attributes(std::vector<GlbAttribute>& a)
+    {
+      VertexPN v;
+      GlbAttribute p = { "POSITION", 3, memberOffset(v, v.position) };
+      GlbAttribute n = { "NORMAL", 3, memberOffset(v, v.normal) };
+      a.push_back(p); a.push_back(n);
+    }
+    static void flipV(VertexPN&) {}
+  };
+
+  template <> struct GlbVertex<VertexPT>
+  {
+    static void attributes(std::vector<GlbAttribute>& a)
+    {
+      VertexPT v;
+      GlbAttribute p = { "POSITION", 3, memberOffset(v, v.position) };
+      GlbAttribute t = { "TEXCOORD_0", 2, memberOffset(v, v.uv) };
+      a.push_back(p); a.push_back(t);
+    }
+    static void flipV(VertexPT& v) { v.uv[1] = 1.0f - v.uv[1]; }
+  };
+
+  template <> struct GlbVertex<VertexPTN>
+  {
+    static void attributes(std::vector<GlbAttribute>& a)
+    {
+      VertexPTN v;
+      GlbAttribute p = { "POSITION", 3, memberOffset(v, v.position) };
+      GlbAttribute t = { "TEXCOORD_0", 2, memberOffset(v, v.uv) };
+      GlbAttribute n = { "NORMAL", 3, memberOffset(v, v.normal) };
+      a.push_back(p); a.push_back(t); a.push_back(n);
+    }
+    static void flipV(VertexPTN& v) { v.uv[1] = 1.0f - v.uv[1]; }
+  };
+
+  template <> struct GlbVertex<VertexPTNT>
+  {
+    static void attributes(std::vector<GlbAttribute>& a)
+    {
+      VertexPTNT v;
+      GlbAttribute p = { "POSITION", 3, memberOffset(v, v.position) };
+      GlbAttribute t = { "TEXCOORD_0", 2, memberOffset(v, v.uv) };
+      GlbAttribute n = { "NORMAL", 3, memberOffset(v, v.normal) };
+      GlbAttribute tn = { "TANGENT", 4, memberOffset(v, v.tangent) };
+      a.push_back(p); a.push_back(t); a.push_back(n); a.push_back(tn);
+    }
+    // Flipping v mirrors the bitangent.
+    static void flipV(VertexPTNT& v) { v.uv[1] = 1.0f - v.uv[1]; v.tangent[3] = -v.tangent[3]; }
+  };
+
+  //! Everything writeGlb needs from an indexed mesh, independent of V.
+  struct GlbMesh
+  {
+    std::string name;
+    uint32_t vertexCount;
+    uint32_t stride;
+    std::vector<GlbAttribute> attributes;
+    boost::function<BoundingBox<float3> (uint32_t, uint32_t)> bounds; // Of vertices [begin, end)
+    boost::function<void (std::ostream&)> writeVertices; // vertexCount * stride bytes
+    const std::vector<uint32_t>* indices;
+    const std::vector<Group>* geometryGroups;
+    const std::vector<Group>* materialGroups;
+    const MaterialMap* materials;
+  };
+
+  //! Write mesh as binary glTF 2.0: one interleaved vertex buffer view,
+  //! one glTF mesh per geometry-group and one primitive per material-group
+  //! within it. Each primitive's attribute accessors cover only the span of
+  //! vertices it uses, shared with primitives of the same span, and its
+  //! indices are rebased to the span's start; 16-bit indices are used when
+  //! the span allows. Materials map to metallic-roughness PBR with
+  //! KHR_materials_specular for Ks.
+  bool writeGlb(const GlbMesh& mesh, const std::string& filename);
+
+  template <typename V>
+    struct WriteGlbVertices
+    {
+      const std::vector<V>* vertices;
+      bool flipV;
+
+      void operator()(std::ostream& os)const
+      {
+        if (vertices->empty()) return;
+        if (!flipV)
+        {
+          os.write(reinterpret_cast<const char*>(&(*vertices)[0]),
+              vertices->size() * sizeof(V));
+          return;
+        }
+        // Convert through a small window rather than copying the mesh.
+        const uint32_t kWindow = 1 << 14;
+        std::vector<V> window;
+        for (uint32_t begin = 0; begin < vertices->size(); begin += kWindow)
+        {
+          const uint32_t end = std::min<uint32_t>(begin + kWindow, vertices->size());
+          window.assign(vertices->begin() + begin, vertices->begin() + end);
+          std::for_each(window.begin(), window.end(), &GlbVertex<V>::flipV);
+          os.write(reinterpret_cast<const char*>(&window[0]), window.size() * sizeof(V));
+        }
+      }
+    };
+
+  template <typename V>
+    struct GlbVertexBounds
+    {
+      const std::vector<V>* vertices;
+
+      BoundingBox<float3> operator()(uint32_t begin, uint32_t end)const
+      {
+        BoundingBox<float3> b;
+        for (uint32_t i = begin; i < end; ++i) b.unionPoint((*vertices)[i].position);
+        return b;
+      }
+    };
+
+  //! Export an indexed mesh to filename.glb, see writeGlb. Flat meshes are
+  //! indexed first.
+  template <typename V>
+    bool exportGlb(shared_ptr<Mesh<V> > mesh, const std::string& filename,
+        const GlbOptions& options = GlbOptions())
+    {
+      if (!mesh) return false;
+      if (mesh->_indices.empty()) mesh = indexedMeshFromMesh(mesh);
+
+      GlbMesh glb;
+      glb.vertexCount = mesh->_vertices.size();
+      glb.stride = sizeof(V);
+      GlbVertex<V>::attributes(glb.attributes);
+      GlbVertexBounds<V> bounds = { &mesh->_vertices };
+      glb.bounds = bounds;
+      WriteGlbVertices<V> writer = { &mesh->_vertices, options.flipV };
+      glb.writeVertices = writer;
+      glb.indices = &mesh->_indices;
+      glb.geometryGroups = &mesh->_geometryGroups;
+      glb.materialGroups = &mesh->_materialGroups;
+      glb.materials = &mesh->_materials;
+      return writeGlb(glb, filename);
+    }
+}
+
+#endif
@@ -19,5 +19,11 @@ namespace lap {
     return os;
   }
 
+  bool sameAppearance(const Material& lhs, const Material& rhs)
+  {
+    return lhs.Kd == rhs.Kd && lhs.Ni == rhs.Ni && lhs.Ka == rhs.Ka && 
+      lhs.d == rhs.d && lhs.Tf == rhs.Tf && lhs.Ns == rhs.Ns && lhs.Ks == rhs.Ks &&
+      lhs.map_Ka == rhs.map_Ka && lhs.map_Kd == rhs.map_Kd && lhs.map_Ks == rhs.map_Ks;
+  }
 }
 
@@ -52,6 +52,9 @@ namespace lap {
   {
     return lhs.name() == rhs.name();
   }
+
+  //! True if lhs and rhs have the same values and maps, whatever their names.
+  bool sameAppearance(const Material& lhs, const Material& rhs);
 }
 #endif
 
@@ -0,0 +1,46 @@
+#ifndef LAP_MEMO_H
+#define LAP_MEMO_H
+
+#include <boost/atomic.hpp>
+
+namespace lap
+{
+  //! A value computed on demand and published once to concurrent readers
+  //! without locking. Racing producers each compute it; the first to
+  //! publish wins and the others discard theirs. Published values are
+  //! immutable until reset, which must not race get or publish.
+  template <typename T>
+    class MemoSlot
+    {
+      public:
+        MemoSlot(): _value(NULL) {}
+        ~MemoSlot() { delete _value.load(boost::memory_order_relaxed); }
+
+        //! The published value, or null.
+        const T* get()const { return _value.load(boost::memory_order_acquire); }
+
+        //! Publish value, taking ownership, unless another thread did first.
+        //! Returns the value readers see.
+        const T* publish(T* value)
+        {
+          T* expected = NULL;
+          if (_value.compare_exchange_strong(expected, value,
+                boost::memory_order_acq_rel, boost::memory_order_acquire))
+          {
+            return value;
+          }
+          delete value;
+          return expected;
+        }
+
+        void reset() { delete _value.exchange(NULL, boost::memory_order_acq_rel); }
+
+      private:
+        MemoSlot(const MemoSlot&);
+        MemoSlot& operator=(const MemoSlot&);
+
+        boost::atomic<T*> _value;
+    };
+}
+
+#endif
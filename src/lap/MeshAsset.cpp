@@ -14,30 +14,4 @@ namespace lap
           bind(makeOffsetGroup, boost::cref(g), boost::cref(_1)));
     sort(sliced.begin(), sliced.end());
   }
-
-  std::ostream& operator<<(std::ostream& os, const VertexP& rhs)
-  {
-    os << rhs.position;
-    return os;
-  }
-
-  std::ostream& operator<<(std::ostream& os, const VertexPT& rhs)
-  {
-    os << '[' << rhs.position << ", " << rhs.uv << ']';
-    return os;
-  }
-
-  std::ostream& operator<<(std::ostream& os, const VertexPN& rhs)
-  {
-    os << '[' << rhs.position << ", " << rhs.normal << ']';
-    return os;
-  }
-
-  std::ostream& operator<<(std::ostream& os, const VertexPTN& rhs)
-  {
-    os << '[' << rhs.position << ", " << rhs.uv << ", " 
-      << rhs.normal << ']';
-    return os;
-  }
-
 }
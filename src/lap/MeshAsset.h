@@ -10,9 +10,12 @@
 #include <iterator>
 #include <tr1/memory>
 #include <tr1/unordered_map>
+#include <boost/scoped_array.hpp>
 #include "MaterialAsset.h"
+#include "Memo.h"
 #include "MeshMath.h"
 #include "ObjModel.h"
+#include "VertexLayout.h"
 
 namespace lap
 {
@@ -23,15 +26,53 @@ namespace lap
   using boost::cref;
   using std::tr1::unordered_map;
   template <typename V> struct Mesh;
-  struct VertexP; typedef shared_ptr<Mesh<VertexP> > MeshPPtr;
-  struct VertexPN; typedef shared_ptr<Mesh<VertexPN> > MeshPNPtr;
-  struct VertexPT; typedef shared_ptr<Mesh<VertexPT> > MeshPTPtr;
-  struct VertexPTN; typedef shared_ptr<Mesh<VertexPTN> > MeshPTNPtr;
+  typedef shared_ptr<Mesh<VertexP> > MeshPPtr;
+  typedef shared_ptr<Mesh<VertexPN> > MeshPNPtr;
+  typedef shared_ptr<Mesh<VertexPT> > MeshPTPtr;
+  typedef shared_ptr<Mesh<VertexPTN> > MeshPTNPtr;
+  typedef shared_ptr<Mesh<VertexPTNT> > MeshPTNTPtr;
 
   typedef vector<Group>::const_iterator GroupConstIter;
   typedef vector<Group>::iterator GroupIter;
 
+  //! Derived forms of a mesh, see Mesh::flattened. Copies start empty.
+  template <typename V>
+    struct MeshMemo
+    {
+      typedef shared_ptr<Mesh<V> > MeshPtr;
+
+      struct Slices
+      {
+        explicit Slices(uint32_t n): count(n), slots(new MemoSlot<MeshPtr>[n]) {}
+
+        uint32_t count;
+        boost::scoped_array<MemoSlot<MeshPtr> > slots;
+      };
+
+      MeshMemo(): enabled(true) {}
+      MeshMemo(const MeshMemo&): enabled(true) {}
+      MeshMemo& operator=(const MeshMemo&) { reset(); return *this; }
+
+      void reset()
+      {
+        flattened.reset();
+        indexed.reset();
+        bounds.reset();
+        slices.reset();
+      }
+
+      bool enabled;
+      MemoSlot<MeshPtr> flattened;
+      MemoSlot<MeshPtr> indexed;
+      MemoSlot<BoundingBox<float3> > bounds;
+      MemoSlot<Slices> slices;
+    };
+
   // Public 
+  //! The members are public; after changing them call touch() so memoized
+  //! forms aren't stale. transformMesh, transformGroup(s) and 
+  //! IncrementalWeld::update change a mesh in place and touch it; every 
+  //! other lap function returns a new mesh.
   template <typename V>
     class Mesh
     {
@@ -57,18 +98,43 @@ namespace lap
         GroupConstIter beginMaterialGroups()const { return _materialGroups.begin(); }
         GroupConstIter endMaterialGroups()const { return _materialGroups.end(); }
 
-        //! Extract a mesh with geometry/material groups clipped to spec.
-        MeshPtr slice(const Group& spec);
+        //! Extract a flat mesh of the corners in spec, with geometry and
+        //! material groups clipped to it.
+        MeshPtr slice(const Group& spec)const;
 
         //! Flattens the mesh into a single group with combined materials.
+        //! The result is flat.
         MeshPtr flatten()const;
 
+        //! Memoized flatten(), indexedMeshFromMesh, slice of a geometry 
+        //! group and vertex bounds. Each is computed on first use and shared
+        //! until touch(); concurrent callers never block each other. The
+        //! meshes returned are shared and mustn't be modified. Indexed 
+        //! meshes are expanded first, so indexed() re-welds them.
+        MeshPtr flattened()const;
+        MeshPtr indexed()const;
+        MeshPtr geometryGroupSlice(uint32_t group)const;
+        BoundingBox<float3> bounds()const;
+
+        //! Forget the memoized forms. Call after modifying the mesh, while no
+        //! other thread is using it.
+        void touch() { _memo.reset(); }
+
+        //! Compute flattened, indexed and geometryGroupSlice on every call
+        //! rather than keep them, for meshes whose owner accounts for their
+        //! size (see ModelCache). Call before sharing the mesh.
+        void disableMemo() { _memo.reset(); _memo.enabled = false; }
+
         std::vector<uint32_t> _indices;
         std::vector<V> _vertices;
         std::vector<Group> _geometryGroups;
         std::vector<Group> _materialGroups;
         MaterialMap _materials;
       private:
+        // Append the vertices of corners [begin, end).
+        void appendCorners(std::vector<V>& to, uint32_t begin, uint32_t end)const;
+
+        mutable MeshMemo<V> _memo;
     };
 
   template<typename V>
@@ -77,67 +143,6 @@ namespace lap
   template<typename V>
     shared_ptr<Mesh<V> > meshFromIndexedMesh(shared_ptr<Mesh<V> > indexedMesh);
 
-  struct VertexP
-  {
-    VertexP(){}
-    VertexP(const float3& p): position(p) {}
-    bool equals(const VertexP& rhs)const { return position.equals(rhs.position); }
-
-    float3 position;
-  };
-
-  std::ostream& operator<<(std::ostream& os, const VertexP& rhs);
-
-  struct VertexPN : public VertexP
-  {
-    VertexPN(){}
-    VertexPN(const float3& p, const float3& n): 
-      VertexP(p),
-      normal(n)
-    {}
-    bool equals(const VertexPN& rhs)const 
-    {
-      return position.equals(rhs.position) && normal.equals(rhs.normal); 
-    }
-
-    float3 normal;
-  };
-
-  std::ostream& operator<<(std::ostream& os, const VertexPN& rhs);
-
-  struct VertexPT : public VertexP
-  {
-    VertexPT(const float3& p, const float2& t): 
-      VertexP(p),
-      uv(t)
-    {}
-
-    bool equals(const VertexPT& rhs)const 
-    {
-      return position.equals(rhs.position) && uv.equals(rhs.uv); 
-    }
-    float2 uv;
-  };
-  std::ostream& operator<<(std::ostream& os, const VertexPT& rhs);
-
-  struct VertexPTN : public VertexP
-  {
-    VertexPTN(){}
-    VertexPTN(const float3& p, const float2& t, const float3& n): 
-      VertexP(p),
-      uv(t),
-      normal(n)
-    {}
-
-    bool equals(const VertexPTN& rhs)const 
-    {
-      return position.equals(rhs.position) && 
-        uv.equals(rhs.uv) && normal.equals(rhs.normal); 
-    }
-    float2 uv;
-    float3 normal;
-  };
-
   // Private
   //
   //
@@ -149,35 +154,45 @@ namespace lap
   void sliceGroups(const vector<Group>& src, const Group& g, vector<Group>& sliced);
 
   template <typename V>
-    shared_ptr<Mesh<V> > Mesh<V>::slice(const Group& spec)
+    void Mesh<V>::appendCorners(std::vector<V>& to, uint32_t begin, uint32_t end)const
+    {
+      if (_indices.empty())
+      {
+        to.insert(to.end(), _vertices.begin() + begin, _vertices.begin() + end);
+        return;
+      }
+      for (uint32_t c = begin; c < end; ++c) to.push_back(_vertices[_indices[c]]);
+    }
+
+  template <typename V>
+    shared_ptr<Mesh<V> > Mesh<V>::slice(const Group& spec)const
     {
-      assert(_indices.empty());
       MeshPtr mesh(new Mesh<V>());
-      mesh->_vertices.assign(_vertices.begin() + spec.begin(), 
-          _vertices.begin() + spec.end());
+      mesh->_vertices.reserve(spec.count());
+      appendCorners(mesh->_vertices, spec.begin(), spec.end());
       sliceGroups(_geometryGroups, spec, mesh->_geometryGroups);
       sliceGroups(_materialGroups, spec, mesh->_materialGroups);
       for (GroupConstIter i = beginMaterialGroups(); i != endMaterialGroups(); ++i)
       {
-        mesh->_materials[i->name()] = _materials[i->name()];
+        MaterialMap::const_iterator m = _materials.find(i->name());
+        mesh->_materials[i->name()] = m == _materials.end() ? Material() : m->second;
       }
 
       return mesh;
     }
 
-  std::ostream& operator<<(std::ostream& os, const VertexPTN& rhs);
-
   template <typename V> float3 position(const V& v) { return v.position; }
   template <typename V> float3 normal(const V& v) { return v.normal; }
   template <typename V> float2 uv(const V& v) { return v.uv; }
+  template <typename V> float4 tangent(const V& v) { return v.tangent; }
 
   template <typename V>
     shared_ptr<Mesh<V> > Mesh<V>::flatten()const
     {
-      assert(_indices.empty());
+      const uint32_t corners = triangles() * 3;
       MeshPtr mesh(new Mesh<V>());
 
-      mesh->_vertices.reserve(_vertices.size());
+      mesh->_vertices.reserve(corners);
       vector<Group> mgs = _materialGroups;
       GroupIter lower = mgs.begin();
 
@@ -190,15 +205,13 @@ namespace lap
 
         for (GroupIter iter = lower; iter != upper; ++iter)
         {
-          mesh->_vertices.insert(mesh->_vertices.end(),
-              &_vertices[iter->begin()],
-              &_vertices[iter->end()]);
+          appendCorners(mesh->_vertices, iter->begin(), iter->end());
           mg.setCount(mg.count() + iter->count());
         }
         mesh->_materialGroups.push_back(mg);
         lower = upper;
       }
-      mesh->_geometryGroups.push_back(Group("default", 0, _vertices.size()));
+      mesh->_geometryGroups.push_back(Group("default", 0, corners));
       mesh->_materials = _materials;
       return mesh;
     }
@@ -411,6 +424,61 @@ namespace lap
           bind(&Mesh<V>::vertexAtIndex, indexedMesh.get(), _1));
       return flat;
     }
+
+  struct NullDeleter
+  {
+    template <typename T> void operator()(T*)const {}
+  };
+
+  template <typename V>
+    shared_ptr<Mesh<V> > Mesh<V>::flattened()const
+    {
+      if (!_memo.enabled) return flatten();
+      if (const MeshPtr* m = _memo.flattened.get()) return *m;
+      return *_memo.flattened.publish(new MeshPtr(flatten()));
+    }
+
+  template <typename V>
+    shared_ptr<Mesh<V> > Mesh<V>::indexed()const
+    {
+      if (_memo.enabled)
+      {
+        if (const MeshPtr* m = _memo.indexed.get()) return *m;
+      }
+      // The indexer only reads the mesh it's given.
+      const MeshPtr self(const_cast<Mesh<V>*>(this), NullDeleter());
+      const MeshPtr welded = indexedMeshFromMesh(_indices.empty() ? self : 
+          meshFromIndexedMesh(self));
+      if (!_memo.enabled) return welded;
+      return *_memo.indexed.publish(new MeshPtr(welded));
+    }
+
+  template <typename V>
+    shared_ptr<Mesh<V> > Mesh<V>::geometryGroupSlice(uint32_t group)const
+    {
+      if (!_memo.enabled) return slice(_geometryGroups[group]);
+      const typename MeshMemo<V>::Slices* slices = _memo.slices.get();
+      if (!slices)
+      {
+        slices = _memo.slices.publish(new typename MeshMemo<V>::Slices(_geometryGroups.size()));
+      }
+      assert(group < slices->count);
+      MemoSlot<MeshPtr>& slot = slices->slots[group];
+      if (const MeshPtr* m = slot.get()) return *m;
+      return *slot.publish(new MeshPtr(slice(_geometryGroups[group])));
+    }
+
+  template <typename V>
+    BoundingBox<float3> Mesh<V>::bounds()const
+    {
+      if (const BoundingBox<float3>* b = _memo.bounds.get()) return *b;
+      BoundingBox<float3>* b = new BoundingBox<float3>();
+      for (typename std::vector<V>::const_iterator v = _vertices.begin(); v != _vertices.end(); ++v)
+      {
+        b->unionPoint(v->position);
+      }
+      return *_memo.bounds.publish(b);
+    }
 }
 
 #endif
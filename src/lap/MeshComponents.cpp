@@ -0,0 +1,115 @@
+#include "MeshComponents.h"
+#include "Dedup.h"
+#include "Parallel.h"
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+namespace lap
+{
+  namespace
+  {
+    typedef boost::atomic<uint32_t> AtomicIndex;
+
+    // Roots are only ever linked below smaller roots, so parents decrease 
+    // monotonically and each set ends up rooted at its smallest vertex 
+    // whatever order threads get there in.
+    struct UnionFind
+    {
+      AtomicIndex* parents;
+      const uint32_t* corners;
+      uint32_t* roots;
+
+      uint32_t find(uint32_t x)const
+      {
+        for (;;)
+        {
+          uint32_t p = parents[x].load(boost::memory_order_relaxed);
+          if (p == x) return x;
+          uint32_t gp = parents[p].load(boost::memory_order_relaxed);
+          if (p != gp) parents[x].compare_exchange_weak(p, gp, boost::memory_order_relaxed);
+          x = gp;
+        }
+      }
+
+      void unite(uint32_t a, uint32_t b)
+      {
+        for (;;)
+        {
+          a = find(a);
+          b = find(b);
+          if (a == b) return;
+          if (a < b) std::swap(a, b);
+          uint32_t expected = a;
+          if (parents[a].compare_exchange_strong(expected, b)) return;
+        }
+      }
+
+      void init(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t v = begin; v < end; ++v) parents[v].store(v, boost::memory_order_relaxed);
+      }
+
+      void uniteTriangles(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t t = begin; t < end; ++t)
+        {
+          unite(corners[3*t], corners[3*t+1]);
+          unite(corners[3*t], corners[3*t+2]);
+        }
+      }
+
+      void findRoots(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t t = begin; t < end; ++t) roots[t] = find(corners[3*t]);
+      }
+    };
+  }
+
+  uint32_t triangleComponents(const std::vector<uint32_t>& corners, 
+      uint32_t vertexCount, std::vector<uint32_t>& labels)
+  {
+    const uint32_t triangles = corners.size() / 3;
+    labels.resize(triangles);
+    if (triangles == 0) return 0;
+
+    boost::scoped_array<AtomicIndex> parents(new AtomicIndex[vertexCount]);
+    UnionFind uf = { parents.get(), &corners[0], &labels[0] };
+    parallelFor(vertexCount, bind(&UnionFind::init, &uf, _1, _2));
+    parallelFor(triangles, bind(&UnionFind::uniteTriangles, &uf, _1, _2));
+    parallelFor(triangles, bind(&UnionFind::findRoots, &uf, _1, _2));
+
+    // Number the roots by first triangle.
+    std::vector<uint32_t> rootLabels(vertexCount, ~0u);
+    uint32_t components = 0;
+    for (uint32_t t = 0; t < triangles; ++t)
+    {
+      uint32_t& label = rootLabels[labels[t]];
+      if (label == ~0u) label = components++;
+      labels[t] = label;
+    }
+    return components;
+  }
+
+  void triangleRegions(const std::vector<Group>& groups, uint32_t triangles,
+      std::vector<uint32_t>& regions)
+  {
+    regions.assign(triangles, groups.size());
+    for (uint32_t g = 0; g < groups.size(); ++g)
+    {
+      const uint32_t end = std::min(triangles, groups[g].end() / 3);
+      for (uint32_t t = groups[g].begin() / 3; t < end; ++t) regions[t] = g;
+    }
+  }
+
+  uint32_t separateRegions(std::vector<uint32_t>& corners, 
+      const std::vector<uint32_t>& regions)
+  {
+    std::vector<uint64_t> keys(corners.size());
+    for (uint32_t c = 0; c < corners.size(); ++c)
+    {
+      keys[c] = ((uint64_t)regions[c / 3] << 32) | corners[c];
+    }
+    std::vector<uint32_t> firsts;
+    return dedupKeys(keys, 64, corners, firsts);
+  }
+}
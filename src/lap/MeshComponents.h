@@ -0,0 +1,108 @@
+#ifndef LAP_MESH_COMPONENTS_H
+#define LAP_MESH_COMPONENTS_H
+
+#include <sstream>
+#include "MeshTopology.h"
+#include "RadixSort.h"
+
+namespace lap
+{
+  //! Labels triangles by connected component, where triangles sharing a 
+  //! vertex id are connected. Components are numbered in order of their 
+  //! first triangle. Runs a lock-free union-find over the vertices in 
+  //! parallel over triangles. Returns the number of components.
+  uint32_t triangleComponents(const std::vector<uint32_t>& corners, 
+      uint32_t vertexCount, std::vector<uint32_t>& labels);
+
+  //! Index of the group holding each triangle, or groups.size() for none.
+  void triangleRegions(const std::vector<Group>& groups, uint32_t triangles,
+      std::vector<uint32_t>& regions);
+
+  //! Renumber corners so regions never share a vertex id. Returns the new
+  //! vertex count.
+  uint32_t separateRegions(std::vector<uint32_t>& corners, 
+      const std::vector<uint32_t>& regions);
+
+  //! Separate a mesh into its connected pieces, one geometry group each. 
+  //! Triangles are reordered so every piece is contiguous and material 
+  //! groups are rebuilt to match. Vertices connect by position. With 
+  //! withinGroups existing geometry groups stay apart even where they touch
+  //! and pieces are named <group>_<n>, otherwise component_<n>.
+  template <typename V>
+    shared_ptr<Mesh<V> > splitComponents(const shared_ptr<Mesh<V> >& mesh, 
+        bool withinGroups = true)
+    {
+      std::vector<uint32_t> corners;
+      uint32_t vertexCount = weldedCorners(mesh, corners);
+      const uint32_t triangles = corners.size() / 3;
+      std::vector<uint32_t> regions;
+      triangleRegions(mesh->_geometryGroups, triangles, regions);
+      if (withinGroups) vertexCount = separateRegions(corners, regions);
+
+      std::vector<uint32_t> labels;
+      const uint32_t components = triangleComponents(corners, vertexCount, labels);
+      std::vector<uint32_t>().swap(corners);
+      std::vector<uint32_t> order;
+      std::vector<uint32_t> offsets;
+      bucketItems(labels, components, order, offsets);
+
+      shared_ptr<Mesh<V> > out(new Mesh<V>());
+      out->_materials = mesh->materials();
+      if (mesh->indices().empty())
+      {
+        out->_vertices.reserve(mesh->vertices().size());
+        for (uint32_t i = 0; i < triangles; ++i)
+        {
+          const V* v = &mesh->_vertices[3 * order[i]];
+          out->_vertices.insert(out->_vertices.end(), v, v + 3);
+        }
+      }
+      else
+      {
+        out->_vertices = mesh->_vertices;
+        out->_indices.reserve(mesh->indices().size());
+        for (uint32_t i = 0; i < triangles; ++i)
+        {
+          const uint32_t* idx = &mesh->_indices[3 * order[i]];
+          out->_indices.insert(out->_indices.end(), idx, idx + 3);
+        }
+      }
+
+      std::vector<uint32_t> pieces(mesh->_geometryGroups.size() + 1, 0);
+      for (uint32_t k = 0; k < components; ++k)
+      {
+        const uint32_t region = regions[order[offsets[k]]];
+        std::ostringstream name;
+        if (withinGroups && region < mesh->_geometryGroups.size())
+        {
+          name << mesh->_geometryGroups[region].name() << '_' << pieces[region]++;
+        }
+        else
+        {
+          name << "component_" << k;
+        }
+        out->_geometryGroups.push_back(Group(name.str(), 
+              3 * offsets[k], 3 * (offsets[k+1] - offsets[k])));
+      }
+
+      // Rebuild material groups from runs of equal material in the new order.
+      std::vector<uint32_t> materials;
+      triangleRegions(mesh->_materialGroups, triangles, materials);
+      for (uint32_t i = 0; i < triangles; ++i)
+      {
+        const uint32_t m = materials[order[i]];
+        if (m == mesh->_materialGroups.size()) continue;
+        if (i > 0 && materials[order[i-1]] == m)
+        {
+          out->_materialGroups.back().setCount(out->_materialGroups.back().count() + 3);
+        }
+        else
+        {
+          out->_materialGroups.push_back(Group(mesh->_materialGroups[m].name(), 3 * i, 3));
+        }
+      }
+      return out;
+    }
+}
+
+#endif
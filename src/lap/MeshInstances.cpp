@@ -0,0 +1,329 @@
+#include "MeshInstances.h"
+#include <cmath>
+#include <map>
+
+namespace lap
+{
+  uint64_t shapeFingerprint(const GroupShape& shape)
+  {
+    std::size_t seed = 0;
+    hash_combine(seed, shape.positions.size());
+    for (std::vector<uint32_t>::const_iterator c = shape.corners.begin(); c != shape.corners.end(); ++c)
+    {
+      hash_combine(seed, *c);
+    }
+    for (std::vector<uint32_t>::const_iterator m = shape.materials.begin(); m != shape.materials.end(); ++m)
+    {
+      hash_combine(seed, *m);
+    }
+    return mixHash(seed);
+  }
+
+  double shapeSpread(const GroupShape& shape)
+  {
+    if (shape.positions.empty()) return 0.0;
+    double centroid[3] = { 0.0, 0.0, 0.0 };
+    for (std::vector<float3>::const_iterator p = shape.positions.begin(); p != shape.positions.end(); ++p)
+    {
+      for (int i = 0; i < 3; ++i) centroid[i] += (*p)[i];
+    }
+    for (int i = 0; i < 3; ++i) centroid[i] /= shape.positions.size();
+    double spread = 0.0;
+    for (std::vector<float3>::const_iterator p = shape.positions.begin(); p != shape.positions.end(); ++p)
+    {
+      double d2 = 0.0;
+      for (int i = 0; i < 3; ++i) d2 += ((*p)[i] - centroid[i]) * ((*p)[i] - centroid[i]);
+      spread += std::sqrt(d2);
+    }
+    return spread / shape.positions.size();
+  }
+
+  namespace
+  {
+    // Eigen-decomposition of a symmetric 4x4 matrix by cyclic Jacobi
+    // rotations. a is diagonalized in place and the columns of v are the
+    // eigenvectors.
+    void jacobiEigen(double a[4][4], double v[4][4])
+    {
+      for (int i = 0; i < 4; ++i)
+      {
+        for (int j = 0; j < 4; ++j) v[i][j] = i == j ? 1.0 : 0.0;
+      }
+      for (int sweep = 0; sweep < 50; ++sweep)
+      {
+        double off = 0.0;
+        double scale = 0.0;
+        for (int p = 0; p < 4; ++p)
+        {
+          scale += std::fabs(a[p][p]);
+          for (int q = p + 1; q < 4; ++q) off += std::fabs(a[p][q]);
+        }
+        if (off <= 1e-15 * scale || off == 0.0) return;
+
+        for (int p = 0; p < 4; ++p)
+        {
+          for (int q = p + 1; q < 4; ++q)
+          {
+            if (a[p][q] == 0.0) continue;
+            const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+            const double t = (theta >= 0.0 ? 1.0 : -1.0) /
+              (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+            const double c = 1.0 / std::sqrt(t * t + 1.0);
+            const double s = t * c;
+            for (int k = 0; k < 4; ++k)
+            {
+              const double kp = a[k][p], kq = a[k][q];
+              a[k][p] = c * kp - s * kq;
+              a[k][q] = s * kp + c * kq;
+            }
+            for (int k = 0; k < 4; ++k)
+            {
+              const double pk = a[p][k], qk = a[q][k];
+              a[p][k] = c * pk - s * qk;
+              a[q][k] = s * pk + c * qk;
+            }
+            for (int k = 0; k < 4; ++k)
+            {
+              const double kp = v[k][p], kq = v[k][q];
+              v[k][p] = c * kp - s * kq;
+              v[k][q] = s * kp + c * kq;
+            }
+          }
+        }
+      }
+    }
+
+    template <typename T>
+      bool sameWithin(const std::vector<T>& a, const std::vector<T>& b, float tolerance)
+      {
+        if (a.size() != b.size()) return false;
+        for (uint32_t i = 0; i < a.size(); ++i)
+        {
+          for (int k = 0; k < (int)(sizeof(T) / sizeof(float)); ++k)
+          {
+            if (!(std::fabs(a[i][k] - b[i][k]) <= tolerance)) return false;
+          }
+        }
+        return true;
+      }
+  }
+
+  bool rigidMatch(const GroupShape& a, const GroupShape& b, float tolerance, float4x4& m)
+  {
+    const uint32_t n = a.positions.size();
+    if (n == 0 || n != b.positions.size() || a.normals.size() != b.normals.size() ||
+        a.corners != b.corners || a.materials != b.materials ||
+        !sameWithin(a.uvs, b.uvs, tolerance))
+    {
+      return false;
+    }
+
+    double ca[3] = { 0.0, 0.0, 0.0 };
+    double cb[3] = { 0.0, 0.0, 0.0 };
+    for (uint32_t i = 0; i < n; ++i)
+    {
+      for (int k = 0; k < 3; ++k) { ca[k] += a.positions[i][k]; cb[k] += b.positions[i][k]; }
+    }
+    for (int k = 0; k < 3; ++k) { ca[k] /= n; cb[k] /= n; }
+
+    // Cross-covariance S[j][k] = sum a'_j b'_k, then Horn's symmetric 4x4
+    // whose largest eigenvector is the rotation quaternion.
+    double s[3][3] = { { 0.0 } };
+    for (uint32_t i = 0; i < n; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        for (int k = 0; k < 3; ++k)
+        {
+          s[j][k] += (a.positions[i][j] - ca[j]) * (b.positions[i][k] - cb[k]);
+        }
+      }
+    }
+    double h[4][4] = {
+      { s[0][0] + s[1][1] + s[2][2], s[1][2] - s[2][1], s[2][0] - s[0][2], s[0][1] - s[1][0] },
+      { s[1][2] - s[2][1], s[0][0] - s[1][1] - s[2][2], s[0][1] + s[1][0], s[2][0] + s[0][2] },
+      { s[2][0] - s[0][2], s[0][1] + s[1][0], -s[0][0] + s[1][1] - s[2][2], s[1][2] + s[2][1] },
+      { s[0][1] - s[1][0], s[2][0] + s[0][2], s[1][2] + s[2][1], -s[0][0] - s[1][1] + s[2][2] } };
+    double v[4][4];
+    jacobiEigen(h, v);
+    int best = 0;
+    for (int i = 1; i < 4; ++i) if (h[i][i] > h[best][best]) best = i;
+    double q[4];
+    double norm = 0.0;
+    for (int i = 0; i < 4; ++i) { q[i] = v[i][best]; norm += q[i] * q[i]; }
+    norm = std::sqrt(norm);
+    const double w = q[0] / norm, x = q[1] / norm, y = q[2] / norm, z = q[3] / norm;
+
+    const double r[3][3] = {
+      { 1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y) },
+      { 2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x) },
+      { 2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y) } };
+    m = float4x4();
+    for (int j = 0; j < 3; ++j)
+    {
+      double t = cb[j];
+      for (int k = 0; k < 3; ++k)
+      {
+        m(j, k) = r[j][k];
+        t -= r[j][k] * ca[k];
+      }
+      m(j, 3) = t;
+    }
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+      const float3 p = transformPoint(m, a.positions[i]);
+      for (int k = 0; k < 3; ++k)
+      {
+        if (!(std::fabs(p[k] - b.positions[i][k]) <= tolerance)) return false;
+      }
+    }
+    const float normalTolerance = std::max(tolerance, 1e-3f);
+    for (uint32_t i = 0; i < a.normals.size(); ++i)
+    {
+      const float3 nr = transformVector(m, a.normals[i]);
+      for (int k = 0; k < 3; ++k)
+      {
+        if (!(std::fabs(nr[k] - b.normals[i][k]) <= normalTolerance)) return false;
+      }
+    }
+    return true;
+  }
+
+  void materialIds(const std::vector<Group>& groups, uint32_t triangles,
+      std::vector<uint32_t>& ids)
+  {
+    std::map<std::string, uint32_t> names;
+    std::vector<uint32_t> groupIds(groups.size() + 1, groups.size());
+    for (uint32_t g = 0; g < groups.size(); ++g)
+    {
+      groupIds[g] = names.insert(std::make_pair(groups[g].name(), names.size())).first->second;
+    }
+    triangleRegions(groups, triangles, ids);
+    for (std::vector<uint32_t>::iterator t = ids.begin(); t != ids.end(); ++t) *t = groupIds[*t];
+  }
+
+  namespace
+  {
+    // A candidate and the prototype it is fitted to this round.
+    struct Candidate
+    {
+      uint32_t group;
+      uint32_t prototype;
+    };
+
+    struct MatchCandidates
+    {
+      const std::vector<GroupShape>* shapes;
+      const Candidate* candidates;
+      GroupInstance* fits; // Per candidate.
+      char* matched; // Per candidate.
+      float tolerance;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+          const Candidate& c = candidates[i];
+          GroupInstance& fit = fits[i];
+          fit.prototype = c.prototype;
+          fit.group = c.group;
+          matched[i] = rigidMatch((*shapes)[c.prototype], (*shapes)[c.group], tolerance, fit.transform);
+        }
+      }
+    };
+
+    // Orders by fingerprint class, then group.
+    struct ShapeLess
+    {
+      const std::vector<GroupShape>* shapes;
+
+      bool operator()(uint32_t a, uint32_t b)const
+      {
+        const uint64_t fa = (*shapes)[a].fingerprint, fb = (*shapes)[b].fingerprint;
+        return fa < fb || (fa == fb && a < b);
+      }
+    };
+
+    bool instanceLess(const GroupInstance& a, const GroupInstance& b)
+    {
+      return a.group < b.group;
+    }
+  }
+
+  void matchShapes(const std::vector<GroupShape>& shapes, float tolerance,
+      std::vector<GroupInstance>& instances)
+  {
+    std::vector<uint32_t> order;
+    for (uint32_t g = 0; g < shapes.size(); ++g)
+    {
+      if (!shapes[g].corners.empty()) order.push_back(g);
+    }
+    const ShapeLess less = { &shapes };
+    std::sort(order.begin(), order.end(), less);
+
+    // Unmatched shapes of each class, in group order.
+    std::vector<std::vector<uint32_t> > pending;
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+      if (i == 0 || shapes[order[i]].fingerprint != shapes[order[i - 1]].fingerprint)
+      {
+        pending.push_back(std::vector<uint32_t>());
+      }
+      pending.back().push_back(order[i]);
+    }
+
+    std::vector<Candidate> candidates;
+    std::vector<GroupInstance> fits;
+    std::vector<char> matched;
+    while (!pending.empty())
+    {
+      // The first pending shape of each class becomes a prototype, and
+      // shapes whose spread is too far from it can't match it.
+      candidates.clear();
+      for (std::vector<std::vector<uint32_t> >::const_iterator c = pending.begin(); c != pending.end(); ++c)
+      {
+        const uint32_t prototype = c->front();
+        const double spread = shapes[prototype].spread;
+        const double window = 4.0 * tolerance + 1e-6 * spread;
+        for (uint32_t i = 1; i < c->size(); ++i)
+        {
+          if (!(std::fabs(shapes[(*c)[i]].spread - spread) <= window)) continue;
+          const Candidate candidate = { (*c)[i], prototype };
+          candidates.push_back(candidate);
+        }
+      }
+
+      fits.resize(candidates.size());
+      matched.assign(candidates.size(), false);
+      if (!candidates.empty())
+      {
+        const MatchCandidates fn = { &shapes, &candidates[0], &fits[0], &matched[0], tolerance };
+        parallelFor(candidates.size(), fn, 1);
+      }
+
+      // Drop each class's prototype and matched shapes, and finished classes.
+      uint32_t next = 0;
+      uint32_t kept = 0;
+      for (uint32_t c = 0; c < pending.size(); ++c)
+      {
+        std::vector<uint32_t>& shapesLeft = pending[c];
+        uint32_t left = 0;
+        for (uint32_t i = 1; i < shapesLeft.size(); ++i)
+        {
+          if (next < candidates.size() && candidates[next].group == shapesLeft[i])
+          {
+            if (matched[next]) instances.push_back(fits[next]);
+            else shapesLeft[left++] = shapesLeft[i];
+            ++next;
+          }
+          else shapesLeft[left++] = shapesLeft[i];
+        }
+        shapesLeft.resize(left);
+        if (left) pending[kept++].swap(shapesLeft);
+      }
+      pending.resize(kept);
+    }
+    std::sort(instances.begin(), instances.end(), instanceLess);
+  }
+}
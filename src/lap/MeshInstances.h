@@ -0,0 +1,158 @@
+#ifndef LAP_MESH_INSTANCES_H
+#define LAP_MESH_INSTANCES_H
+
+#include "Dedup.h"
+#include "MeshTiles.h"
+#include "MeshTransform.h"
+
+namespace lap
+{
+  //! The geometry of one group in a transform-independent layout: its
+  //! vertices in first-use order and its corners as indices into them.
+  //! normals and uvs are empty if the vertices have none.
+  struct GroupShape
+  {
+    std::vector<uint32_t> corners;
+    std::vector<float3> positions;
+    std::vector<float3> normals;
+    std::vector<float2> uvs;
+    std::vector<uint32_t> materials; // Material id of each triangle, see materialIds.
+    uint64_t fingerprint;
+    double spread;
+  };
+
+  //! Hash of the parts of a shape a rigid transform leaves exactly
+  //! unchanged: vertex count, topology and materials.
+  uint64_t shapeFingerprint(const GroupShape& shape);
+
+  //! Mean distance of the vertices from their centroid. Rigid copies
+  //! within tolerance differ in it by at most 2 * sqrt(3) * tolerance, so
+  //! matchShapes compares it within 4 * tolerance rather than hashing it.
+  double shapeSpread(const GroupShape& shape);
+
+  //! Rotation and translation taking a's positions onto b's, solved with
+  //! Horn's quaternion method. False if the shapes differ in topology,
+  //! uvs or materials or any vertex or normal is off by more than
+  //! tolerance after the fit.
+  bool rigidMatch(const GroupShape& a, const GroupShape& b, float tolerance, float4x4& m);
+
+  //! A geometry group that repeats another.
+  struct GroupInstance
+  {
+    uint32_t prototype; // Geometry group index of the original.
+    uint32_t group; // Geometry group index of the copy.
+    float4x4 transform; // Takes prototype onto group.
+  };
+
+  //! An id per material name for each triangle, equal ids meaning the same
+  //! material; triangles in no material group get groups.size().
+  void materialIds(const std::vector<Group>& groups, uint32_t triangles,
+      std::vector<uint32_t>& ids);
+
+  //! Match the shapes of each fingerprint class against each other. Each
+  //! round every class with unmatched shapes takes the first as a new
+  //! prototype, and the candidates within its spread window are fitted to
+  //! it in one parallel pass over all classes, so a class of many copies
+  //! is matched in parallel too. The first group of a match is its
+  //! prototype.
+  void matchShapes(const std::vector<GroupShape>& shapes, float tolerance,
+      std::vector<GroupInstance>& instances);
+
+  template <typename V>
+    struct GatherShapes
+    {
+      const Mesh<V>* mesh;
+      const std::vector<uint32_t>* materials;
+      GroupShape* shapes;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t g = begin; g < end; ++g) gather(mesh->_geometryGroups[g], shapes[g]);
+      }
+
+      void gather(const Group& g, GroupShape& shape)const
+      {
+        const bool flat = mesh->_indices.empty();
+        const uint32_t corners = flat ? mesh->_vertices.size() : mesh->_indices.size();
+        const uint32_t begin = std::min(g.begin(), corners) / 3 * 3;
+        const uint32_t end = std::min(g.end(), corners) / 3 * 3;
+        FlatIndexMap<uint32_t> local(end - begin);
+        for (uint32_t c = begin; c < end; ++c)
+        {
+          const uint32_t id = flat ? c : mesh->_indices[c];
+          std::pair<uint32_t, bool> pib = local.insert(id, shape.positions.size());
+          shape.corners.push_back(pib.first);
+          if (!pib.second) continue;
+
+          V v = mesh->_vertices[id];
+          shape.positions.push_back(v.position);
+          if (Normal* n = attributePtr<Normal>(v)) shape.normals.push_back(n->normal);
+          if (TexCoord* t = attributePtr<TexCoord>(v)) shape.uvs.push_back(t->uv);
+        }
+        for (uint32_t t = begin / 3; t < end / 3; ++t)
+        {
+          shape.materials.push_back((*materials)[t]);
+        }
+        shape.fingerprint = shapeFingerprint(shape);
+        shape.spread = shapeSpread(shape);
+      }
+    };
+
+  //! Find geometry groups that are rigidly transformed copies of earlier
+  //! ones. Groups are gathered and fingerprinted in parallel, then each
+  //! candidate is verified by fitting its transform, see rigidMatch.
+  template <typename V>
+    void findInstances(const shared_ptr<Mesh<V> >& mesh, float tolerance,
+        std::vector<GroupInstance>& instances)
+    {
+      instances.clear();
+      const uint32_t corners = mesh->_indices.empty() ? mesh->_vertices.size() : mesh->_indices.size();
+      std::vector<uint32_t> materials;
+      materialIds(mesh->_materialGroups, corners / 3, materials);
+
+      std::vector<GroupShape> shapes(mesh->_geometryGroups.size());
+      if (shapes.empty()) return;
+      GatherShapes<V> gather = { mesh.get(), &materials, &shapes[0] };
+      parallelFor(shapes.size(), gather, 1);
+      matchShapes(shapes, tolerance, instances);
+    }
+
+  //! Copy of mesh without the instanced copies' triangles: prototypes and
+  //! unique groups remain, compacted and indexed.
+  template <typename V>
+    shared_ptr<Mesh<V> > removeInstances(shared_ptr<Mesh<V> > mesh,
+        const std::vector<GroupInstance>& instances)
+    {
+      if (mesh->_indices.empty()) mesh = indexedMeshFromMesh(mesh);
+      const uint32_t triangles = mesh->_indices.size() / 3;
+      std::vector<char> removed(triangles, false);
+      for (std::vector<GroupInstance>::const_iterator i = instances.begin(); i != instances.end(); ++i)
+      {
+        const Group& g = mesh->_geometryGroups[i->group];
+        const uint32_t end = std::min(g.end() / 3, triangles);
+        for (uint32_t t = g.begin() / 3; t < end; ++t) removed[t] = true;
+      }
+      std::vector<uint32_t> tris;
+      for (uint32_t t = 0; t < triangles; ++t) if (!removed[t]) tris.push_back(t);
+
+      shared_ptr<Mesh<V> > out(new Mesh<V>());
+      std::vector<uint32_t> vertexIds;
+      const uint32_t* kept = tris.empty() ? NULL : &tris[0];
+      compactCorners(mesh->_indices, kept, tris.size(), vertexIds, out->_indices);
+      out->_vertices.reserve(vertexIds.size());
+      for (std::vector<uint32_t>::const_iterator v = vertexIds.begin(); v != vertexIds.end(); ++v)
+      {
+        out->_vertices.push_back(mesh->_vertices[*v]);
+      }
+
+      std::vector<uint32_t> regions;
+      triangleRegions(mesh->_geometryGroups, triangles, regions);
+      regionGroups(mesh->_geometryGroups, regions, kept, tris.size(), out->_geometryGroups);
+      triangleRegions(mesh->_materialGroups, triangles, regions);
+      regionGroups(mesh->_materialGroups, regions, kept, tris.size(), out->_materialGroups);
+      out->_materials = mesh->_materials;
+      return out;
+    }
+}
+
+#endif
@@ -82,6 +82,62 @@ namespace lap
       return c;
     }
 
+  template <typename T, int N>
+    vec<T, N> operator+(const vec<T, N>& a, const vec<T, N>& b)
+    {
+      vec<T, N> c;
+      for (int i = 0; i < N; ++i) c[i] = a[i] + b[i];
+      return c;
+    }
+
+  template <typename T, int N>
+    vec<T, N> operator-(const vec<T, N>& a, const vec<T, N>& b)
+    {
+      vec<T, N> c;
+      for (int i = 0; i < N; ++i) c[i] = a[i] - b[i];
+      return c;
+    }
+
+  template <typename T, int N>
+    vec<T, N> operator*(const vec<T, N>& a, T s)
+    {
+      vec<T, N> c;
+      for (int i = 0; i < N; ++i) c[i] = a[i] * s;
+      return c;
+    }
+
+  template <typename T, int N>
+    T dot(const vec<T, N>& a, const vec<T, N>& b)
+    {
+      T d = T();
+      for (int i = 0; i < N; ++i) d += a[i] * b[i];
+      return d;
+    }
+
+  template <typename T>
+    vec<T, 3> cross(const vec<T, 3>& a, const vec<T, 3>& b)
+    {
+      vec<T, 3> c;
+      c[0] = a[1] * b[2] - a[2] * b[1];
+      c[1] = a[2] * b[0] - a[0] * b[2];
+      c[2] = a[0] * b[1] - a[1] * b[0];
+      return c;
+    }
+
+  template <typename T, int N>
+    T length(const vec<T, N>& a)
+    {
+      return std::sqrt(dot(a, a));
+    }
+
+  //! Unit vector along a, or zero if a is degenerate.
+  template <typename T, int N>
+    vec<T, N> normalize(const vec<T, N>& a)
+    {
+      T l = length(a);
+      return l > T() ? a * (T(1) / l) : vec<T, N>();
+    }
+
   template <typename T, int N>
     std::ostream& operator<<(std::ostream& os, const vec<T, N>& rhs)
     {
@@ -138,9 +194,11 @@ namespace lap
       return make_range<I>(&dest[0], dest.size());
     }
 
+  typedef vec<uint32_t,4> uint4;
   typedef vec<uint32_t,3> uint3;
   typedef vec<uint32_t,2> uint2;
   typedef vec<uint32_t,1> uint1;
+  typedef vec<float,4> float4;
   typedef vec<float,3> float3;
   typedef vec<float,2> float2;
   typedef vec<float,1> float1;
@@ -190,8 +248,8 @@ namespace lap
         }
         int largestAxis()const
         {
-          return std::max(make_pair(size(0), 0), 
-              std::max(make_pair(size(1), 1), make_pair(size(2), 2))).second;
+          return std::max(std::make_pair(size(0), 0), 
+              std::max(std::make_pair(size(1), 1), std::make_pair(size(2), 2))).second;
         }
       private:
         P _min;
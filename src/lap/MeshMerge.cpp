@@ -0,0 +1,101 @@
+#include "MeshMerge.h"
+#include <sstream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace lap
+{
+  void mergeMaterials(MaterialMap& merged, const MaterialMap& materials,
+      MaterialRenames& renames)
+  {
+    std::vector<std::string> names;
+    for (MaterialMap::const_iterator m = materials.begin(); m != materials.end(); ++m)
+    {
+      names.push_back(m->first);
+    }
+    std::sort(names.begin(), names.end());
+
+    for (std::vector<std::string>::const_iterator name = names.begin();
+        name != names.end(); ++name)
+    {
+      const Material& material = materials.find(*name)->second;
+      MaterialMap::const_iterator existing = merged.find(*name);
+      if (existing == merged.end())
+      {
+        merged.insert(std::make_pair(*name, material));
+        continue;
+      }
+      if (sameAppearance(existing->second, material)) continue;
+
+      std::string renamed;
+      for (uint32_t n = 2; ; ++n)
+      {
+        std::ostringstream os;
+        os << *name << '_' << n;
+        renamed = os.str();
+        existing = merged.find(renamed);
+        if (existing == merged.end()) break;
+        if (sameAppearance(existing->second, material)) break;
+      }
+      if (existing == merged.end())
+      {
+        Material copy = material;
+        copy.setName(renamed);
+        merged.insert(std::make_pair(renamed, copy));
+      }
+      renames[*name] = renamed;
+    }
+  }
+
+  void offsetGroups(const std::vector<Group>& src, uint32_t offset,
+      const MaterialRenames& renames, std::vector<Group>& dst)
+  {
+    for (GroupConstIter g = src.begin(); g != src.end(); ++g)
+    {
+      MaterialRenames::const_iterator r = renames.find(g->name());
+      dst.push_back(Group(r == renames.end() ? g->name() : r->second,
+            g->begin() + offset, g->count()));
+    }
+  }
+
+  void rebaseIndices(uint32_t* dst, const uint32_t* src, uint32_t count, uint32_t base)
+  {
+    uint32_t i = 0;
+#ifdef __SSE2__
+    const __m128i b = _mm_set1_epi32(base);
+    if (src)
+    {
+      for (; i + 4 <= count; i += 4)
+      {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi32(v, b));
+      }
+    }
+    else
+    {
+      __m128i v = _mm_add_epi32(b, _mm_set_epi32(3, 2, 1, 0));
+      const __m128i step = _mm_set1_epi32(4);
+      for (; i + 4 <= count; i += 4)
+      {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        v = _mm_add_epi32(v, step);
+      }
+    }
+#endif
+    for (; i < count; ++i) dst[i] = (src ? src[i] : i) + base;
+  }
+
+  void mergeBlocks(const std::vector<uint32_t>& counts, uint32_t blockSize,
+      std::vector<MergeBlock>& blocks)
+  {
+    for (uint32_t input = 0; input < counts.size(); ++input)
+    {
+      for (uint32_t begin = 0; begin < counts[input]; begin += blockSize)
+      {
+        const MergeBlock block = { input, begin, std::min(begin + blockSize, counts[input]) };
+        blocks.push_back(block);
+      }
+    }
+  }
+}
@@ -0,0 +1,130 @@
+#ifndef LAP_MESH_MERGE_H
+#define LAP_MESH_MERGE_H
+
+#include <map>
+#include "MeshAsset.h"
+#include "Parallel.h"
+
+namespace lap
+{
+  typedef std::map<std::string, std::string> MaterialRenames;
+
+  //! Add materials to merged. A material whose name is taken by one that
+  //! looks different is renamed <name>_<n> with the first free n, and
+  //! renames records it. Names are visited in order so renaming is stable.
+  void mergeMaterials(MaterialMap& merged, const MaterialMap& materials,
+      MaterialRenames& renames);
+
+  //! Append src's groups to dst, offset by offset corners and renamed per
+  //! renames.
+  void offsetGroups(const std::vector<Group>& src, uint32_t offset,
+      const MaterialRenames& renames, std::vector<Group>& dst);
+
+  //! dst[i] = src[i] + base, with SSE2 where available. src may be null
+  //! for dst[i] = base + i.
+  void rebaseIndices(uint32_t* dst, const uint32_t* src, uint32_t count, uint32_t base);
+
+  //! A run of one merge input's items, copied by one task.
+  struct MergeBlock
+  {
+    uint32_t input;
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  //! Split each input's count items into blocks of at most blockSize.
+  void mergeBlocks(const std::vector<uint32_t>& counts, uint32_t blockSize,
+      std::vector<MergeBlock>& blocks);
+
+  template <typename V>
+    struct MergeCopy
+    {
+      const shared_ptr<Mesh<V> >* inputs;
+      const MergeBlock* vertexBlocks;
+      const MergeBlock* indexBlocks;
+      uint32_t vertexBlockCount;
+      const uint32_t* vertexOffsets;
+      const uint32_t* cornerOffsets;
+      V* vertices;
+      uint32_t* indices; // Null for a flat result.
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t b = begin; b < end; ++b)
+        {
+          if (b < vertexBlockCount) copyVertices(vertexBlocks[b]);
+          else copyIndices(indexBlocks[b - vertexBlockCount]);
+        }
+      }
+
+      void copyVertices(const MergeBlock& block)const
+      {
+        const std::vector<V>& src = inputs[block.input]->_vertices;
+        std::copy(src.begin() + block.begin, src.begin() + block.end,
+            vertices + vertexOffsets[block.input] + block.begin);
+      }
+
+      void copyIndices(const MergeBlock& block)const
+      {
+        const Mesh<V>& input = *inputs[block.input];
+        uint32_t* dst = indices + cornerOffsets[block.input] + block.begin;
+        const uint32_t base = vertexOffsets[block.input];
+        // Flat inputs of an indexed result index their own corners.
+        if (input._indices.empty()) rebaseIndices(dst, NULL, block.end - block.begin, base + block.begin);
+        else rebaseIndices(dst, &input._indices[block.begin], block.end - block.begin, base);
+      }
+    };
+
+  //! Concatenate meshes into one. The result is flat if every input is,
+  //! otherwise indexed with flat inputs indexing their own corners. All
+  //! offsets are computed up front, each array is allocated once and the
+  //! inputs are copied and rebased in parallel blocks. Groups are offset
+  //! into the result and conflicting material names renamed, see
+  //! mergeMaterials.
+  template <typename V>
+    shared_ptr<Mesh<V> > mergeMeshes(const std::vector<shared_ptr<Mesh<V> > >& meshes)
+    {
+      shared_ptr<Mesh<V> > merged(new Mesh<V>());
+      bool flat = true;
+      for (uint32_t i = 0; i < meshes.size(); ++i) flat = flat && meshes[i]->_indices.empty();
+
+      std::vector<uint32_t> vertexCounts(meshes.size());
+      std::vector<uint32_t> cornerCounts(meshes.size());
+      std::vector<uint32_t> vertexOffsets(meshes.size() + 1, 0);
+      std::vector<uint32_t> cornerOffsets(meshes.size() + 1, 0);
+      for (uint32_t i = 0; i < meshes.size(); ++i)
+      {
+        const Mesh<V>& m = *meshes[i];
+        vertexCounts[i] = m._vertices.size();
+        cornerCounts[i] = flat ? 0 : (m._indices.empty() ? m._vertices.size() : m._indices.size());
+        vertexOffsets[i + 1] = vertexOffsets[i] + vertexCounts[i];
+        cornerOffsets[i + 1] = cornerOffsets[i] + cornerCounts[i];
+
+        MaterialRenames renames;
+        mergeMaterials(merged->_materials, m._materials, renames);
+        const uint32_t groupOffset = flat ? vertexOffsets[i] : cornerOffsets[i];
+        offsetGroups(m._geometryGroups, groupOffset, MaterialRenames(), merged->_geometryGroups);
+        offsetGroups(m._materialGroups, groupOffset, renames, merged->_materialGroups);
+      }
+      if (meshes.empty()) return merged;
+
+      merged->_vertices.resize(vertexOffsets.back());
+      merged->_indices.resize(cornerOffsets.back());
+
+      const uint32_t kBlock = 1 << 16;
+      std::vector<MergeBlock> vertexBlocks;
+      std::vector<MergeBlock> indexBlocks;
+      mergeBlocks(vertexCounts, kBlock, vertexBlocks);
+      mergeBlocks(cornerCounts, kBlock, indexBlocks);
+      MergeCopy<V> copy = { &meshes[0],
+        vertexBlocks.empty() ? NULL : &vertexBlocks[0],
+        indexBlocks.empty() ? NULL : &indexBlocks[0], (uint32_t)vertexBlocks.size(),
+        &vertexOffsets[0], &cornerOffsets[0],
+        merged->_vertices.empty() ? NULL : &merged->_vertices[0],
+        merged->_indices.empty() ? NULL : &merged->_indices[0] };
+      parallelFor(vertexBlocks.size() + indexBlocks.size(), copy, 1);
+      return merged;
+    }
+}
+
+#endif
@@ -0,0 +1,297 @@
+#include "MeshNormals.h"
+#include <algorithm>
+#include "Parallel.h"
+#include "RadixSort.h"
+
+namespace lap
+{
+  namespace
+  {
+    const float kPi = 3.14159265358979f;
+
+    // Positions with more corners than this sum their creased normals by
+    // cluster rather than comparing every pair of corners.
+    const uint32_t kClusteredValence = 32;
+
+    inline float cornerAngle(const float3& p, const float3& next, const float3& prev)
+    {
+      float d = dot(normalize(next - p), normalize(prev - p));
+      return std::acos(std::max(-1.0f, std::min(1.0f, d)));
+    }
+
+    // A corner at a high-valence position, keyed by the grid cell and the
+    // bits of its face normal; equal keys form a cluster.
+    struct ClusterCorner
+    {
+      uint64_t cell;
+      vec<uint32_t, 3> bits;
+      uint32_t corner;
+
+      bool operator<(const ClusterCorner& b)const
+      {
+        if (cell != b.cell) return cell < b.cell;
+        if (!(bits == b.bits)) return bits < b.bits;
+        return corner < b.corner;
+      }
+      bool sameCluster(const ClusterCorner& b)const { return cell == b.cell && bits == b.bits; }
+    };
+
+    struct Cluster
+    {
+      uint64_t cell;
+      float3 normal; // Face normal shared by its corners.
+      float3 sum; // Of its corners' weighted normals.
+      uint32_t begin; // Its run of ClusterCorners.
+      uint32_t end;
+
+      bool operator<(const Cluster& b)const { return cell < b.cell; }
+    };
+
+    // 21 bits per axis, cells are at least 1e-4 wide.
+    uint64_t cellKey(int x, int y, int z)
+    {
+      const uint32_t mask = (1u << 21) - 1;
+      return (uint64_t)((x + (1 << 20)) & mask) << 42 |
+        (uint64_t)((y + (1 << 20)) & mask) << 21 | ((z + (1 << 20)) & mask);
+    }
+
+    // Normals are gathered per position rather than scattered per face, so
+    // every output is written by exactly one thread.
+    struct NormalContext
+    {
+      const float3* positions;
+      const uint32_t* corners;
+      NormalWeighting weighting;
+      bool smoothAll;
+      float cosCrease;
+      float cell; // Grid cell wide enough that normals within the crease are neighbours.
+      std::vector<float3> faceNormals;
+      std::vector<float> weights; // Per corner.
+      std::vector<uint32_t> sortedCorners; // Corners ordered by position.
+      std::vector<uint32_t> offsets; // First sorted corner of each position.
+      float3* normals;
+
+      void faces(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t t = begin; t < end; ++t)
+        {
+          const float3& p0 = positions[corners[3*t]];
+          const float3& p1 = positions[corners[3*t+1]];
+          const float3& p2 = positions[corners[3*t+2]];
+          float3 n = cross(p1 - p0, p2 - p0);
+          float doubleArea = length(n);
+          faceNormals[t] = doubleArea > 0.0f ? n * (1.0f / doubleArea) : float3();
+          if (weighting == kAreaWeighted)
+          {
+            weights[3*t] = weights[3*t+1] = weights[3*t+2] = doubleArea;
+          }
+          else
+          {
+            weights[3*t] = cornerAngle(p0, p1, p2);
+            weights[3*t+1] = cornerAngle(p1, p2, p0);
+            weights[3*t+2] = cornerAngle(p2, p0, p1);
+          }
+        }
+      }
+
+      float3 weightedNormal(uint32_t corner)const
+      {
+        return faceNormals[corner / 3] * weights[corner];
+      }
+
+      int cellOf(float x)const { return (int)std::floor(x / cell); }
+
+      // Face normals within the crease angle differ by at most the cell
+      // width per axis, so each cluster sums those in the 27 cells around
+      // its own. Corners with equal face normals share a cluster and its
+      // result.
+      void gatherClusters(const uint32_t* first, const uint32_t* last,
+          std::vector<ClusterCorner>& entries, std::vector<Cluster>& clusters)const
+      {
+        entries.clear();
+        for (const uint32_t* c = first; c != last; ++c)
+        {
+          const float3& fn = faceNormals[*c / 3];
+          ClusterCorner e;
+          e.cell = cellKey(cellOf(fn[0]), cellOf(fn[1]), cellOf(fn[2]));
+          memcpy(&e.bits[0], &fn, sizeof(float3));
+          e.corner = *c;
+          entries.push_back(e);
+        }
+        std::sort(entries.begin(), entries.end());
+
+        clusters.clear();
+        for (uint32_t i = 0; i < entries.size(); ++i)
+        {
+          if (i == 0 || !entries[i].sameCluster(entries[i - 1]))
+          {
+            Cluster cluster = { entries[i].cell, faceNormals[entries[i].corner / 3], float3(), i, i };
+            clusters.push_back(cluster);
+          }
+          Cluster& cluster = clusters.back();
+          cluster.sum = cluster.sum + weightedNormal(entries[i].corner);
+          cluster.end = i + 1;
+        }
+
+        // Neighbouring cells are visited in key order, so matches are summed
+        // in cluster order and corners matching the same clusters get
+        // bit-identical normals, later sharing a vertex.
+        for (std::vector<Cluster>::const_iterator k = clusters.begin(); k != clusters.end(); ++k)
+        {
+          const int x = cellOf(k->normal[0]), y = cellOf(k->normal[1]), z = cellOf(k->normal[2]);
+          Cluster neighbours[27];
+          for (int i = 0; i < 27; ++i) neighbours[i].cell = cellKey(x + i % 3 - 1, y + i / 3 % 3 - 1, z + i / 9 - 1);
+          std::sort(neighbours, neighbours + 27);
+          float3 n;
+          std::vector<Cluster>::const_iterator j = clusters.begin();
+          const std::vector<Cluster>::const_iterator end = clusters.end();
+          for (int i = 0; i < 27; ++i)
+          {
+            j = std::lower_bound(j, end, neighbours[i]);
+            for (; j != end && j->cell == neighbours[i].cell; ++j)
+            {
+              if (dot(k->normal, j->normal) >= cosCrease) n = n + j->sum;
+            }
+          }
+          n = normalize(n);
+          for (uint32_t i = k->begin; i < k->end; ++i) normals[entries[i].corner] = n;
+        }
+      }
+
+      void gather(uint32_t begin, uint32_t end)
+      {
+        std::vector<ClusterCorner> entries;
+        std::vector<Cluster> clusters;
+        for (uint32_t id = begin; id < end; ++id)
+        {
+          const uint32_t* first = &sortedCorners[0] + offsets[id];
+          const uint32_t* last = &sortedCorners[0] + offsets[id+1];
+          if (smoothAll)
+          {
+            float3 n;
+            for (const uint32_t* c = first; c != last; ++c) n = n + weightedNormal(*c);
+            n = normalize(n);
+            for (const uint32_t* c = first; c != last; ++c) normals[*c] = n;
+            continue;
+          }
+          if (last - first > kClusteredValence)
+          {
+            gatherClusters(first, last, entries, clusters);
+            continue;
+          }
+          for (const uint32_t* c = first; c != last; ++c)
+          {
+            const float3& fn = faceNormals[*c / 3];
+            float3 n;
+            for (const uint32_t* d = first; d != last; ++d)
+            {
+              if (dot(fn, faceNormals[*d / 3]) >= cosCrease) n = n + weightedNormal(*d);
+            }
+            normals[*c] = normalize(n);
+          }
+        }
+      }
+
+      // Corners of degenerate faces or cancelling fans fall back to their face.
+      void fallback(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t c = begin; c < end; ++c)
+        {
+          if (dot(normals[c], normals[c]) == 0.0f) normals[c] = faceNormals[c / 3];
+        }
+      }
+    };
+  }
+
+  namespace
+  {
+    // Numbers the corners that represent themselves in order, then points
+    // every corner at its representative's number.
+    struct NumberLeaders
+    {
+      const uint32_t* representatives;
+      uint32_t* ids;
+      std::vector<uint32_t> chunkSums;
+
+      void sum(uint32_t chunk, uint32_t begin, uint32_t end)
+      {
+        uint32_t n = 0;
+        for (uint32_t c = begin; c < end; ++c) n += representatives[c] == c;
+        chunkSums[chunk] = n;
+      }
+
+      void scan(uint32_t chunk, uint32_t begin, uint32_t end)
+      {
+        uint32_t id = chunkSums[chunk];
+        for (uint32_t c = begin; c < end; ++c)
+        {
+          if (representatives[c] == c) ids[c] = id++;
+        }
+      }
+
+      // Only reads representatives' ids, which the scan has already set.
+      void assign(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t c = begin; c < end; ++c)
+        {
+          if (representatives[c] != c) ids[c] = ids[representatives[c]];
+        }
+      }
+    };
+  }
+
+  uint32_t numberRepresentatives(const std::vector<uint32_t>& representatives,
+      std::vector<uint32_t>& ids)
+  {
+    const uint32_t count = representatives.size();
+    ids.resize(count);
+    if (count == 0) return 0;
+
+    NumberLeaders number;
+    number.representatives = &representatives[0];
+    number.ids = &ids[0];
+    const uint32_t chunks = chunkCount(count, 1 << 16);
+    number.chunkSums.resize(chunks);
+    parallelChunks(count, chunks, bind(&NumberLeaders::sum, &number, _1, _2, _3));
+    uint32_t unique = 0;
+    for (uint32_t c = 0; c < chunks; ++c)
+    {
+      const uint32_t n = number.chunkSums[c];
+      number.chunkSums[c] = unique;
+      unique += n;
+    }
+    parallelChunks(count, chunks, bind(&NumberLeaders::scan, &number, _1, _2, _3));
+    parallelFor(count, bind(&NumberLeaders::assign, &number, _1, _2));
+    return unique;
+  }
+
+  void smoothCornerNormals(const std::vector<float3>& positions,
+      const std::vector<uint32_t>& corners, float creaseAngle, 
+      NormalWeighting weighting, std::vector<float3>& normals,
+      std::vector<uint32_t>* sortedCorners, std::vector<uint32_t>* offsets)
+  {
+    assert(corners.size() % 3 == 0);
+    const uint32_t cornerCount = corners.size();
+    normals.assign(cornerCount, float3());
+    if (cornerCount == 0) return;
+
+    NormalContext context;
+    context.positions = &positions[0];
+    context.corners = &corners[0];
+    context.weighting = weighting;
+    context.smoothAll = creaseAngle >= 180.0f;
+    context.cosCrease = std::cos(creaseAngle * kPi / 180.0f);
+    context.cell = std::sqrt(std::max(0.0f, 2.0f - 2.0f * context.cosCrease)) * 1.01f + 1e-4f;
+    context.faceNormals.resize(cornerCount / 3);
+    context.weights.resize(cornerCount);
+    context.normals = &normals[0];
+    parallelFor(cornerCount / 3, bind(&NormalContext::faces, &context, _1, _2));
+
+    bucketItems(corners, positions.size(), context.sortedCorners, context.offsets);
+
+    parallelFor(positions.size(), bind(&NormalContext::gather, &context, _1, _2), 1024);
+    parallelFor(cornerCount, bind(&NormalContext::fallback, &context, _1, _2));
+    if (sortedCorners) sortedCorners->swap(context.sortedCorners);
+    if (offsets) offsets->swap(context.offsets);
+  }
+}
@@ -0,0 +1,172 @@
+#ifndef LAP_MESH_NORMALS_H
+#define LAP_MESH_NORMALS_H
+
+#include <cstring>
+#include "Dedup.h"
+#include "MeshAsset.h"
+
+namespace lap
+{
+  enum NormalWeighting
+  {
+    kAngleWeighted, // Face normals weighted by the corner angle.
+    kAreaWeighted // Face normals weighted by the triangle area.
+  };
+
+  //! Smooth normals for each corner of a triangle list. corners holds three
+  //! position ids per triangle; corners sharing a position are averaged 
+  //! together unless their faces meet at more than creaseAngle degrees.
+  //! sortedCorners and offsets, if given, receive the corners bucketed by
+  //! position, see bucketItems.
+  void smoothCornerNormals(const std::vector<float3>& positions,
+      const std::vector<uint32_t>& corners, float creaseAngle, 
+      NormalWeighting weighting, std::vector<float3>& normals,
+      std::vector<uint32_t>* sortedCorners = NULL, std::vector<uint32_t>* offsets = NULL);
+
+  //! Given each item's representative, an earlier or the same item, numbers
+  //! the items representing themselves in order and gives every item its
+  //! representative's number. Counted and scanned in parallel chunks.
+  //! Returns the number of representatives.
+  uint32_t numberRepresentatives(const std::vector<uint32_t>& representatives,
+      std::vector<uint32_t>& ids);
+
+  //! The vertex type a mesh gets once it has normals.
+  template <typename V, bool HasNormal = HasAttribute<Normal, V>::value> 
+    struct NormalVertex
+    { 
+      typedef V type; 
+    };
+
+  template <typename V> 
+    struct NormalVertex<V, false> 
+    { 
+      typedef typename AppendAttribute<V, Normal>::type type; 
+    };
+
+  template <typename V>
+    typename NormalVertex<V>::type withNormal(const V& v, const float3& n)
+    {
+      typename NormalVertex<V>::type nv = convertVertex<typename NormalVertex<V>::type>(v);
+      nv.normal = n;
+      return nv;
+    }
+
+  //! Bitwise image of a vertex, for exact hashing of whole vertices.
+  template <typename V>
+    vec<uint32_t, sizeof(V) / sizeof(uint32_t)> vertexBits(const V& v)
+    {
+      vec<uint32_t, sizeof(V) / sizeof(uint32_t)> bits;
+      memcpy(&bits[0], &v, sizeof(V));
+      return bits;
+    }
+
+  //! Points each corner at the first corner with the same output vertex.
+  //! Equal vertices share a position, so corners are only compared with
+  //! others at their position, one position per item.
+  template <typename V>
+    struct SplitCorners
+    {
+      typedef typename NormalVertex<V>::type NV;
+      typedef vec<uint32_t, sizeof(NV) / sizeof(uint32_t)> VertexKey;
+
+      const Mesh<V>* mesh;
+      const float3* normals;
+      const uint32_t* sortedCorners;
+      const uint32_t* offsets;
+      uint32_t* representatives;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        const bool flat = mesh->indices().empty();
+        std::vector<std::pair<VertexKey, uint32_t> > keyed;
+        for (uint32_t id = begin; id < end; ++id)
+        {
+          keyed.clear();
+          for (uint32_t i = offsets[id]; i < offsets[id + 1]; ++i)
+          {
+            const uint32_t c = sortedCorners[i];
+            const V& v = mesh->vertices()[flat ? c : mesh->indices()[c]];
+            keyed.push_back(std::make_pair(vertexBits(withNormal(v, normals[c])), c));
+          }
+          std::sort(keyed.begin(), keyed.end());
+          for (uint32_t i = 0; i < keyed.size(); ++i)
+          {
+            const bool first = i == 0 || !(keyed[i].first == keyed[i - 1].first);
+            representatives[keyed[i].second] = first ? keyed[i].second : representatives[keyed[i - 1].second];
+          }
+        }
+      }
+    };
+
+  //! Builds the output vertex of each representative corner.
+  template <typename V>
+    struct MakeNormalVertices
+    {
+      typedef typename NormalVertex<V>::type NV;
+
+      const Mesh<V>* mesh;
+      const float3* normals;
+      const uint32_t* representatives;
+      const uint32_t* ids;
+      NV* vertices;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        const bool flat = mesh->indices().empty();
+        for (uint32_t c = begin; c < end; ++c)
+        {
+          if (representatives[c] != c) continue;
+          vertices[ids[c]] = withNormal(mesh->vertices()[flat ? c : mesh->indices()[c]], normals[c]);
+        }
+      }
+    };
+
+  //! Replace (or add) vertex normals with smooth normals, shared across 
+  //! corners with equal positions. Vertices are split where faces meet at
+  //! more than creaseAngle degrees. Flat or indexed meshes are accepted, 
+  //! the result is indexed with the same groups and materials.
+  template <typename V>
+    shared_ptr<Mesh<typename NormalVertex<V>::type> > 
+    generateNormals(const shared_ptr<Mesh<V> >& mesh, float creaseAngle = 180.0f,
+        NormalWeighting weighting = kAngleWeighted)
+    {
+      typedef typename NormalVertex<V>::type NV;
+      std::vector<uint32_t> positionIds;
+      std::vector<float3> positions;
+      weldPositions(mesh->vertices(), positionIds, positions);
+
+      const bool flat = mesh->indices().empty();
+      const uint32_t cornerCount = flat ? mesh->vertices().size() : mesh->indices().size();
+      std::vector<uint32_t> corners(cornerCount);
+      for (uint32_t c = 0; c < cornerCount; ++c) 
+      {
+        corners[c] = positionIds[flat ? c : mesh->indices()[c]];
+      }
+      std::vector<float3> normals;
+      std::vector<uint32_t> sortedCorners;
+      std::vector<uint32_t> offsets;
+      smoothCornerNormals(positions, corners, creaseAngle, weighting, normals,
+          &sortedCorners, &offsets);
+
+      shared_ptr<Mesh<NV> > out(new Mesh<NV>());
+      out->_geometryGroups.assign(mesh->beginGeometryGroups(), mesh->endGeometryGroups());
+      out->_materialGroups.assign(mesh->beginMaterialGroups(), mesh->endMaterialGroups());
+      out->_materials = mesh->materials();
+
+      // Corners sharing a vertex and normal share an output vertex, so 
+      // vertices are split only along creases. Output vertices keep the
+      // order of their first corner.
+      if (cornerCount == 0) return out;
+      std::vector<uint32_t> representatives(cornerCount);
+      SplitCorners<V> split = { mesh.get(), &normals[0], &sortedCorners[0], &offsets[0],
+        &representatives[0] };
+      parallelFor(positions.size(), split, 1024);
+      out->_vertices.resize(numberRepresentatives(representatives, out->_indices));
+      MakeNormalVertices<V> make = { mesh.get(), &normals[0], &representatives[0],
+        &out->_indices[0], &out->_vertices[0] };
+      parallelFor(cornerCount, make);
+      return out;
+    }
+}
+
+#endif
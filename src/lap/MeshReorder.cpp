@@ -0,0 +1,123 @@
+#include "MeshReorder.h"
+#include "RadixSort.h"
+
+namespace lap
+{
+  namespace
+  {
+    const uint32_t kMortonBits = 21;
+
+    // Spread the low 21 bits of x two bits apart.
+    uint64_t spreadBits(uint64_t x)
+    {
+      x &= 0x1fffff;
+      x = (x | x << 32) & 0x1f00000000ffffull;
+      x = (x | x << 16) & 0x1f0000ff0000ffull;
+      x = (x | x << 8) & 0x100f00f00f00f00full;
+      x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+      x = (x | x << 2) & 0x1249249249249249ull;
+      return x;
+    }
+
+    struct MortonCodes
+    {
+      const float3* centroids;
+      BoundingBox<float3> bounds;
+      uint64_t* codes;
+      uint32_t* ids;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t t = begin; t < end; ++t)
+        {
+          codes[t] = mortonCode(centroids[t], bounds);
+          ids[t] = t;
+        }
+      }
+    };
+
+    void addBoundaries(const std::vector<Group>& groups, std::vector<uint32_t>& boundaries)
+    {
+      for (GroupConstIter g = groups.begin(); g != groups.end(); ++g)
+      {
+        boundaries.push_back(g->begin() / 3);
+        boundaries.push_back(g->end() / 3);
+      }
+    }
+  }
+
+  uint64_t mortonCode(const float3& p, const BoundingBox<float3>& bounds)
+  {
+    const float cells = (float)((1u << kMortonBits) - 1);
+    uint64_t code = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      const float size = bounds.size(axis);
+      const float t = size > 0.0f ? (p[axis] - bounds.min()[axis]) / size : 0.0f;
+      const uint64_t cell = (uint64_t)(std::min(std::max(t, 0.0f), 1.0f) * cells);
+      code |= spreadBits(cell) << axis;
+    }
+    return code;
+  }
+
+  void mortonOrder(const std::vector<float3>& centroids,
+      const std::vector<Group>& geometryGroups, const std::vector<Group>& materialGroups,
+      std::vector<uint32_t>& order)
+  {
+    const uint32_t triangles = centroids.size();
+    order.clear();
+    if (!triangles) return;
+
+    BoundingBox<float3> bounds;
+    for (uint32_t t = 0; t < triangles; ++t) bounds.unionPoint(centroids[t]);
+    std::vector<uint64_t> codes(triangles);
+    std::vector<uint32_t> ids(triangles);
+    MortonCodes fn = { &centroids[0], bounds, &codes[0], &ids[0] };
+    parallelFor(triangles, fn);
+    radixSortPairs(codes, ids, 3 * kMortonBits);
+    std::vector<uint64_t>().swap(codes);
+
+    // Runs are numbered in triangle order, so bucketing by run keeps each
+    // triangle within its run's range.
+    std::vector<uint32_t> boundaries;
+    addBoundaries(geometryGroups, boundaries);
+    addBoundaries(materialGroups, boundaries);
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+    std::vector<uint32_t> runOf(triangles);
+    uint32_t run = 0;
+    std::vector<uint32_t>::const_iterator next = boundaries.begin();
+    for (uint32_t t = 0; t < triangles; ++t)
+    {
+      for (; next != boundaries.end() && *next <= t; ++next)
+      {
+        if (*next > 0) ++run;
+      }
+      runOf[t] = run;
+    }
+
+    std::vector<uint32_t> runs(triangles);
+    for (uint32_t i = 0; i < triangles; ++i) runs[i] = runOf[ids[i]];
+    std::vector<uint32_t> sorted;
+    std::vector<uint32_t> offsets;
+    bucketItems(runs, run + 1, sorted, offsets);
+    order.resize(triangles);
+    for (uint32_t i = 0; i < triangles; ++i) order[i] = ids[sorted[i]];
+  }
+
+  void firstTouchOrder(const std::vector<uint32_t>& indices, uint32_t vertexCount,
+      std::vector<uint32_t>& remap)
+  {
+    const uint32_t kUnused = ~0u;
+    remap.assign(vertexCount, kUnused);
+    uint32_t next = 0;
+    for (std::vector<uint32_t>::const_iterator i = indices.begin(); i != indices.end(); ++i)
+    {
+      if (remap[*i] == kUnused) remap[*i] = next++;
+    }
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+      if (remap[v] == kUnused) remap[v] = next++;
+    }
+  }
+}
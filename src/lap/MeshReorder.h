@@ -0,0 +1,103 @@
+#ifndef LAP_MESH_REORDER_H
+#define LAP_MESH_REORDER_H
+
+#include "MeshTiles.h"
+
+namespace lap
+{
+  //! Morton code of p quantized to 21 bits per axis within bounds, x in
+  //! the lowest bit.
+  uint64_t mortonCode(const float3& p, const BoundingBox<float3>& bounds);
+
+  //! Triangle ids sorted by the Morton code of their centroids within each
+  //! run of triangles between group boundaries, so every geometry and
+  //! material group still covers the same triangles. Codes are sorted with
+  //! one parallel radix sort over all triangles, then stably bucketed by run.
+  void mortonOrder(const std::vector<float3>& centroids,
+      const std::vector<Group>& geometryGroups, const std::vector<Group>& materialGroups,
+      std::vector<uint32_t>& order);
+
+  //! New index of each vertex, numbered in the order indices first use
+  //! them. Vertices no index uses follow in their old order.
+  void firstTouchOrder(const std::vector<uint32_t>& indices, uint32_t vertexCount,
+      std::vector<uint32_t>& remap);
+
+  template <typename T>
+    struct PermuteTriangles
+    {
+      const T* from;
+      const uint32_t* order;
+      T* to;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t t = begin; t < end; ++t)
+        {
+          const T* src = from + 3 * order[t];
+          to[3 * t] = src[0];
+          to[3 * t + 1] = src[1];
+          to[3 * t + 2] = src[2];
+        }
+      }
+    };
+
+  struct RemapIndices
+  {
+    const uint32_t* from;
+    const uint32_t* remap;
+    uint32_t* to;
+
+    void operator()(uint32_t begin, uint32_t end)const
+    {
+      for (uint32_t i = begin; i < end; ++i) to[i] = remap[from[i]];
+    }
+  };
+
+  //! Reorder a mesh for spatial locality: triangles by mortonOrder, then
+  //! an indexed mesh's vertices by firstTouchOrder. Groups and materials
+  //! are kept as they are.
+  template <typename V>
+    shared_ptr<Mesh<V> > reorderMorton(const shared_ptr<Mesh<V> >& mesh)
+    {
+      std::vector<uint32_t> order;
+      {
+        std::vector<float3> centroids;
+        triangleCentroids(mesh, centroids);
+        mortonOrder(centroids, mesh->_geometryGroups, mesh->_materialGroups, order);
+      }
+
+      shared_ptr<Mesh<V> > out(new Mesh<V>());
+      out->_geometryGroups = mesh->_geometryGroups;
+      out->_materialGroups = mesh->_materialGroups;
+      out->_materials = mesh->_materials;
+      if (order.empty())
+      {
+        out->_vertices = mesh->_vertices;
+        out->_indices = mesh->_indices;
+        return out;
+      }
+
+      if (mesh->_indices.empty())
+      {
+        out->_vertices.resize(mesh->_vertices.size());
+        PermuteTriangles<V> fn = { &mesh->_vertices[0], &order[0], &out->_vertices[0] };
+        parallelFor(order.size(), fn);
+        return out;
+      }
+
+      std::vector<uint32_t> corners(mesh->_indices.size());
+      PermuteTriangles<uint32_t> permute = { &mesh->_indices[0], &order[0], &corners[0] };
+      parallelFor(order.size(), permute);
+
+      std::vector<uint32_t> remap;
+      firstTouchOrder(corners, mesh->_vertices.size(), remap);
+      out->_vertices.resize(mesh->_vertices.size());
+      for (uint32_t v = 0; v < remap.size(); ++v) out->_vertices[remap[v]] = mesh->_vertices[v];
+      out->_indices.resize(corners.size());
+      RemapIndices fn = { &corners[0], &remap[0], &out->_indices[0] };
+      parallelFor(corners.size(), fn);
+      return out;
+    }
+}
+
+#endif
@@ -0,0 +1,342 @@
+#include "MeshStats.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include "Dedup.h"
+#include "MeshComponents.h"
+
+namespace lap
+{
+  namespace
+  {
+    // Directed edge between two position hashes.
+    uint64_t edgeKey(uint64_t from, uint64_t to)
+    {
+      return mixHash(from ^ mixHash(to));
+    }
+
+    // Hash of a position, -0 hashing as 0 as it compares.
+    uint64_t positionKey(const float3& p)
+    {
+      float3 q;
+      for (int i = 0; i < 3; ++i) q[i] = p[i] + 0.0f;
+      return hashBytes(&q, sizeof(float3));
+    }
+
+    struct BoundPositions
+    {
+      const float3* positions;
+      BoundingBox<float3>* chunks;
+
+      void operator()(uint32_t chunk, uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t i = begin; i < end; ++i) chunks[chunk].unionPoint(positions[i]);
+      }
+    };
+
+    // Adds each triangle to its group's accumulator, the last being for
+    // triangles in no group; one set of accumulators per chunk. Volume is
+    // taken about origin, the centre of the bounds, in double: about the
+    // world origin, far from it, float cancellation swamps small shapes.
+    struct MeasureTriangles
+    {
+      const float3* positions;
+      const double* origin;
+      const uint32_t* regions;
+      uint32_t regionCount;
+      std::vector<std::vector<TriangleStats> >* chunks;
+
+      void operator()(uint32_t chunk, uint32_t begin, uint32_t end)const
+      {
+        std::vector<TriangleStats>& acc = (*chunks)[chunk];
+        acc.resize(regionCount + 1);
+        for (uint32_t t = begin; t < end; ++t)
+        {
+          TriangleStats& s = acc[regions[t]];
+          const float3& a = positions[3 * t];
+          const float3& b = positions[3 * t + 1];
+          const float3& c = positions[3 * t + 2];
+          const float3 n = cross(b - a, c - a);
+          const double area = 0.5 * std::sqrt((double)dot(n, n));
+          ++s.triangles;
+          if (area == 0.0) ++s.degenerate;
+          s.area += area;
+          double da[3], db[3], dc[3];
+          for (int i = 0; i < 3; ++i)
+          {
+            da[i] = a[i] - origin[i];
+            db[i] = b[i] - origin[i];
+            dc[i] = c[i] - origin[i];
+          }
+          s.volume += (da[0] * (db[1] * dc[2] - db[2] * dc[1]) +
+              da[1] * (db[2] * dc[0] - db[0] * dc[2]) +
+              da[2] * (db[0] * dc[1] - db[1] * dc[0])) / 6.0;
+          const uint64_t pa = positionKey(a);
+          const uint64_t pb = positionKey(b);
+          const uint64_t pc = positionKey(c);
+          s.edgeBalance += edgeKey(pa, pb) + edgeKey(pb, pc) + edgeKey(pc, pa) -
+            edgeKey(pb, pa) - edgeKey(pc, pb) - edgeKey(pa, pc);
+          s.bounds.unionPoint(a);
+          s.bounds.unionPoint(b);
+          s.bounds.unionPoint(c);
+        }
+      }
+    };
+
+    // Unique vertices of each group, one group per call. Groups are 
+    // clamped to the corners, as triangleRegions clamps them.
+    struct HashGroups
+    {
+      const uint64_t* keys;
+      uint32_t corners;
+      const Group* groups;
+      GroupStats* out;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t g = begin; g < end; ++g)
+        {
+          const uint32_t first = std::min(groups[g].begin(), corners);
+          const uint32_t last = std::min(groups[g].end(), corners);
+          FlatIndexMap<uint64_t> unique(last - first);
+          for (uint32_t c = first; c < last; ++c) unique.insert(keys[c], 0);
+          out[g].stats.corners = last - first;
+          out[g].stats.uniqueVertices = unique.size();
+        }
+      }
+    };
+
+    void addStats(TriangleStats& to, const TriangleStats& from)
+    {
+      if (!from.triangles) return;
+      to.triangles += from.triangles;
+      to.degenerate += from.degenerate;
+      to.area += from.area;
+      to.volume += from.volume;
+      to.edgeBalance += from.edgeBalance;
+      to.bounds.unionPoint(from.bounds.min());
+      to.bounds.unionPoint(from.bounds.max());
+    }
+
+    // Material groups are sorted and disjoint, so their ends are too.
+    bool endsBefore(const Group& group, uint32_t corner)
+    {
+      return group.end() <= corner;
+    }
+
+    std::string jsonString(const std::string& s)
+    {
+      std::string out("\"");
+      for (std::string::const_iterator c = s.begin(); c != s.end(); ++c)
+      {
+        if (*c == '"' || *c == '\\') out += '\\';
+        if ((unsigned char)*c < 0x20)
+        {
+          char escaped[8];
+          std::sprintf(escaped, "\\u%04x", (unsigned)(unsigned char)*c);
+          out += escaped;
+        }
+        else out += *c;
+      }
+      return out + '"';
+    }
+
+    // JSON has no NaN or infinity.
+    void printJsonNumber(std::ostream& os, double x)
+    {
+      if (std::fabs(x) <= DBL_MAX) os << x;
+      else os << "null";
+    }
+
+    void printJsonVec(std::ostream& os, const float3& v)
+    {
+      for (int i = 0; i < 3; ++i)
+      {
+        os << (i ? ',' : '[');
+        printJsonNumber(os, v[i]);
+      }
+      os << ']';
+    }
+
+    void printJsonBounds(std::ostream& os, const TriangleStats& s)
+    {
+      if (!s.triangles)
+      {
+        os << "null";
+        return;
+      }
+      os << "{\"min\":";
+      printJsonVec(os, s.bounds.min());
+      os << ",\"max\":";
+      printJsonVec(os, s.bounds.max());
+      os << '}';
+    }
+
+    void printJsonCounts(std::ostream& os, const TriangleStats& s)
+    {
+      os << "\"vertices\":" << s.corners << ",\"uniqueVertices\":" << s.uniqueVertices <<
+        ",\"triangles\":" << s.triangles << ",\"degenerateTriangles\":" << s.degenerate <<
+        ",\"bounds\":";
+      printJsonBounds(os, s);
+      os << ",\"surfaceArea\":";
+      printJsonNumber(os, s.area);
+      os << ",\"closed\":" << (s.closed ? "true" : "false") << ",\"volume\":";
+      if (s.closed) printJsonNumber(os, s.volume);
+      else os << "null";
+    }
+  }
+
+  uint64_t hashBytes(const void* bytes, uint32_t size)
+  {
+    // FNV-1a over the bytes, finished by mixHash.
+    const unsigned char* b = static_cast<const unsigned char*>(bytes);
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (uint32_t i = 0; i < size; ++i)
+    {
+      h ^= b[i];
+      h *= 0x100000001b3ULL;
+    }
+    return mixHash(h);
+  }
+
+  void cornerStats(const std::vector<float3>& positions, const std::vector<uint64_t>& vertexKeys,
+      const std::vector<Group>& geometryGroups, const std::vector<Group>& materialGroups,
+      MeshStats& stats)
+  {
+    const uint32_t triangles = positions.size() / 3;
+    const uint32_t groupCount = geometryGroups.size();
+    stats.total = TriangleStats();
+    stats.groups.assign(groupCount, GroupStats());
+
+    std::vector<uint32_t> regions;
+    triangleRegions(geometryGroups, triangles, regions);
+    const uint32_t chunks = chunkCount(triangles, 1 << 14);
+    std::vector<std::vector<TriangleStats> > chunkStats(chunks);
+    if (triangles)
+    {
+      std::vector<BoundingBox<float3> > chunkBounds(chunks);
+      BoundPositions bound = { &positions[0], &chunkBounds[0] };
+      parallelChunks(triangles * 3, chunks, bound);
+      BoundingBox<float3> bounds;
+      for (uint32_t c = 0; c < chunks; ++c)
+      {
+        bounds.unionPoint(chunkBounds[c].min());
+        bounds.unionPoint(chunkBounds[c].max());
+      }
+      // Infinite or NaN bounds would spoil every volume, not just their own.
+      double origin[3] = { 0.0, 0.0, 0.0 };
+      for (int i = 0; i < 3; ++i)
+      {
+        const double centre = 0.5 * ((double)bounds.min()[i] + bounds.max()[i]);
+        if (std::fabs(centre) <= DBL_MAX) origin[i] = centre;
+      }
+      MeasureTriangles fn = { &positions[0], origin, &regions[0], groupCount, &chunkStats };
+      parallelChunks(triangles, chunks, fn);
+    }
+    if (groupCount)
+    {
+      HashGroups fn = { vertexKeys.empty() ? NULL : &vertexKeys[0], 
+        (uint32_t)vertexKeys.size(), &geometryGroups[0], &stats.groups[0] };
+      parallelFor(groupCount, fn, 1);
+    }
+
+    // Chunks are summed in order, so totals don't depend on scheduling.
+    TriangleStats ungrouped;
+    for (uint32_t c = 0; c < chunkStats.size(); ++c)
+    {
+      for (uint32_t g = 0; g < chunkStats[c].size(); ++g)
+      {
+        addStats(g < groupCount ? stats.groups[g].stats : ungrouped, chunkStats[c][g]);
+      }
+    }
+
+    stats.total.corners = positions.size();
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> firsts;
+    stats.total.uniqueVertices = dedupKeys(vertexKeys, 64, indices, firsts);
+    addStats(stats.total, ungrouped);
+    stats.closedGroupVolume = 0.0;
+    for (uint32_t g = 0; g < groupCount; ++g)
+    {
+      GroupStats& group = stats.groups[g];
+      group.name = geometryGroups[g].name();
+      group.stats.closed = group.stats.triangles && !group.stats.edgeBalance;
+      if (group.stats.closed) stats.closedGroupVolume += group.stats.volume;
+      addStats(stats.total, group.stats);
+
+      GroupConstIter m = std::lower_bound(materialGroups.begin(), materialGroups.end(),
+          geometryGroups[g].begin(), endsBefore);
+      for (; m != materialGroups.end() && m->begin() < geometryGroups[g].end(); ++m)
+      {
+        if (std::find(group.materials.begin(), group.materials.end(), m->name()) == group.materials.end())
+        {
+          group.materials.push_back(m->name());
+        }
+      }
+    }
+    stats.total.closed = stats.total.triangles && !stats.total.edgeBalance;
+  }
+
+  void printStats(std::ostream& os, const MeshStats& stats)
+  {
+    const TriangleStats& t = stats.total;
+    os << "vertices " << stats.vertices <<
+      "\ncorners " << t.corners <<
+      "\nunique-vertices " << t.uniqueVertices <<
+      "\ntriangles " << t.triangles <<
+      "\ndegenerate-triangles " << t.degenerate <<
+      "\nbounds " << t.bounds <<
+      "\nsurface-area " << t.area <<
+      "\nvolume ";
+    if (t.closed) os << t.volume;
+    else os << "open";
+    os << "\nclosed-group-volume " << stats.closedGroupVolume << '\n';
+    os << "groups\n";
+    for (std::vector<GroupStats>::const_iterator g = stats.groups.begin(); g != stats.groups.end(); ++g)
+    {
+      const TriangleStats& s = g->stats;
+      os << "  " << g->name <<
+        "\n    vertices " << s.corners <<
+        "\n    unique-vertices " << s.uniqueVertices <<
+        "\n    triangles " << s.triangles <<
+        "\n    degenerate-triangles " << s.degenerate <<
+        "\n    bounds " << s.bounds <<
+        "\n    surface-area " << s.area <<
+        "\n    volume ";
+      if (s.closed) os << s.volume;
+      else os << "open";
+      os << "\n    materials ";
+      for (std::vector<std::string>::const_iterator m = g->materials.begin(); m != g->materials.end(); ++m)
+      {
+        os << *m << ' ';
+      }
+      os << '\n';
+    }
+  }
+
+  void printStatsJson(std::ostream& os, const MeshStats& stats)
+  {
+    const std::streamsize precision = os.precision(9);
+    os << "{\"meshVertices\":" << stats.vertices << ',';
+    printJsonCounts(os, stats.total);
+    os << ",\"closedGroupVolume\":";
+    printJsonNumber(os, stats.closedGroupVolume);
+    os << ",\"groups\":[";
+    for (uint32_t g = 0; g < stats.groups.size(); ++g)
+    {
+      const GroupStats& group = stats.groups[g];
+      os << (g ? "," : "") << "{\"name\":" << jsonString(group.name) << ',';
+      printJsonCounts(os, group.stats);
+      os << ",\"materials\":[";
+      for (uint32_t m = 0; m < group.materials.size(); ++m)
+      {
+        os << (m ? "," : "") << jsonString(group.materials[m]);
+      }
+      os << "]}";
+    }
+    os << "]}\n";
+    os.precision(precision);
+  }
+}
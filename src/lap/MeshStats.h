@@ -0,0 +1,102 @@
+#ifndef LAP_MESH_STATS_H
+#define LAP_MESH_STATS_H
+
+#include <iosfwd>
+#include "MeshAsset.h"
+#include "Parallel.h"
+
+namespace lap
+{
+  //! Counts and measures of a run of triangles. Vertices are unique when
+  //! bit-identical but for signed zeros, compared by 64-bit hash, so unlike
+  //! a weld no epsilon applies. Degenerate triangles have zero area.
+  struct TriangleStats
+  {
+    TriangleStats():
+      corners(0), uniqueVertices(0), triangles(0), degenerate(0),
+      area(0.0), volume(0.0), edgeBalance(0), closed(false)
+    {}
+
+    uint32_t corners;
+    uint32_t uniqueVertices;
+    uint32_t triangles;
+    uint32_t degenerate;
+    BoundingBox<float3> bounds;
+    double area;
+    double volume; // Signed, meaningful only when closed.
+    uint64_t edgeBalance; // Hashes of edges, by position, less their reverses'.
+    bool closed; // Triangles whose edgeBalance is zero: each edge has a reverse.
+  };
+
+  struct GroupStats
+  {
+    std::string name;
+    std::vector<std::string> materials; // Material groups overlapping it.
+    TriangleStats stats;
+  };
+
+  //! Statistics of a mesh's triangles and of each geometry group. Volume
+  //! is measured for the whole mesh and for each geometry group that's 
+  //! closed, not for connected components: a closed shell sharing an open
+  //! group with other triangles adds nothing to closedGroupVolume.
+  struct MeshStats
+  {
+    uint32_t vertices; // Of the mesh, flat or indexed.
+    TriangleStats total;
+    double closedGroupVolume;
+    std::vector<GroupStats> groups;
+  };
+
+  //! Hash of a value's bytes.
+  uint64_t hashBytes(const void* bytes, uint32_t size);
+
+  //! Fill stats from each corner's position and vertex hash. Triangles are
+  //! measured, and their edges balanced, in parallel chunks; each group's
+  //! unique vertices are counted in parallel with the others.
+  void cornerStats(const std::vector<float3>& positions, const std::vector<uint64_t>& vertexKeys,
+      const std::vector<Group>& geometryGroups, const std::vector<Group>& materialGroups,
+      MeshStats& stats);
+
+  void printStats(std::ostream& os, const MeshStats& stats);
+  void printStatsJson(std::ostream& os, const MeshStats& stats);
+
+  template <typename V>
+    struct CornerKeys
+    {
+      const Mesh<V>* mesh;
+      float3* positions;
+      uint64_t* keys;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        const bool flat = mesh->_indices.empty();
+        for (uint32_t c = begin; c < end; ++c)
+        {
+          V v = mesh->_vertices[flat ? c : mesh->_indices[c]];
+          positions[c] = v.position;
+          // Vertices are all floats; -0 hashes as 0 as it compares.
+          float* f = reinterpret_cast<float*>(&v);
+          for (uint32_t i = 0; i < sizeof(V) / sizeof(float); ++i) f[i] += 0.0f;
+          keys[c] = hashBytes(&v, sizeof(V));
+        }
+      }
+    };
+
+  //! Statistics of a flat or indexed mesh without welding or slicing it.
+  template <typename V>
+    void meshStats(const shared_ptr<Mesh<V> >& mesh, MeshStats& stats)
+    {
+      const uint32_t corners = mesh->_indices.empty() ? mesh->_vertices.size() : mesh->_indices.size();
+      std::vector<float3> positions(corners);
+      std::vector<uint64_t> keys(corners);
+      if (corners)
+      {
+        CornerKeys<V> fn = { mesh.get(), &positions[0], &keys[0] };
+        parallelFor(corners, fn);
+      }
+      stats.vertices = mesh->_vertices.size();
+      cornerStats(positions, keys, mesh->_geometryGroups, mesh->_materialGroups, stats);
+    }
+}
+
+#endif
@@ -0,0 +1,181 @@
+#include "MeshTangents.h"
+#include "MeshNormals.h"
+#include "Parallel.h"
+#include "RadixSort.h"
+
+namespace lap
+{
+  namespace
+  {
+    inline float3 projectToPlane(const float3& v, const float3& n)
+    {
+      return v - n * dot(n, v);
+    }
+
+    inline float3 anyPerpendicular(const float3& n)
+    {
+      float3 axis;
+      axis[fabs(n[0]) < 0.9f ? 0 : 1] = 1.0f;
+      return normalize(cross(n, axis));
+    }
+
+    struct TangentContext
+    {
+      const VertexPTN* vertices;
+      const uint32_t* corners;
+      std::vector<float3> faceTangents; // Unit, pointing along +u; zero without uv area.
+      std::vector<uint32_t> orientations; // Per triangle: 0 if uvs wind cw, 1 ccw, 2 no uv area.
+      std::vector<uint32_t> sortedCorners;
+      std::vector<uint32_t> offsets;
+      float4* tangents;
+
+      const VertexPTN& vertex(uint32_t corner)const { return vertices[corners[corner]]; }
+
+      void faces(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t t = begin; t < end; ++t)
+        {
+          const VertexPTN& v0 = vertex(3*t);
+          const VertexPTN& v1 = vertex(3*t+1);
+          const VertexPTN& v2 = vertex(3*t+2);
+          float3 e1 = v1.position - v0.position;
+          float3 e2 = v2.position - v0.position;
+          float2 d1 = v1.uv - v0.uv;
+          float2 d2 = v2.uv - v0.uv;
+          float signedArea = d1[0] * d2[1] - d1[1] * d2[0];
+          // Faces without uv area have no tangent to add.
+          if (!(signedArea > 0.0f || signedArea < 0.0f))
+          {
+            orientations[t] = 2;
+            faceTangents[t] = float3();
+            continue;
+          }
+          orientations[t] = signedArea > 0.0f ? 1 : 0;
+          float3 t0 = e1 * d2[1] - e2 * d1[1];
+          faceTangents[t] = normalize(t0) * (signedArea > 0.0f ? 1.0f : -1.0f);
+        }
+      }
+
+      // The angle at a corner between its edges projected onto the normal plane.
+      float cornerWeight(uint32_t corner)const
+      {
+        uint32_t base = corner - corner % 3;
+        const VertexPTN& v = vertex(corner);
+        const VertexPTN& next = vertex(base + (corner + 1) % 3);
+        const VertexPTN& prev = vertex(base + (corner + 2) % 3);
+        float3 a = normalize(projectToPlane(next.position - v.position, v.normal));
+        float3 b = normalize(projectToPlane(prev.position - v.position, v.normal));
+        return std::acos(std::max(-1.0f, std::min(1.0f, dot(a, b))));
+      }
+
+      void gather(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t bucket = begin; bucket < end; ++bucket)
+        {
+          const uint32_t* first = &sortedCorners[0] + offsets[bucket];
+          const uint32_t* last = &sortedCorners[0] + offsets[bucket+1];
+          if (first == last) continue;
+
+          const float3& n = vertex(*first).normal;
+          float3 sum;
+          for (const uint32_t* c = first; c != last; ++c)
+          {
+            if (dot(faceTangents[*c / 3], faceTangents[*c / 3]) == 0.0f) continue;
+            float3 t = normalize(projectToPlane(faceTangents[*c / 3], n));
+            sum = sum + t * cornerWeight(*c);
+          }
+          float3 t = normalize(projectToPlane(sum, n));
+          if (dot(t, t) == 0.0f) t = anyPerpendicular(n);
+
+          float4 tangent;
+          tangent[0] = t[0];
+          tangent[1] = t[1];
+          tangent[2] = t[2];
+          tangent[3] = bucket % 2 ? 1.0f : -1.0f;
+          for (const uint32_t* c = first; c != last; ++c) tangents[*c] = tangent;
+        }
+      }
+    };
+  }
+
+  void cornerTangents(const std::vector<VertexPTN>& vertices,
+      const std::vector<uint32_t>& corners, std::vector<float4>& tangents)
+  {
+    assert(corners.size() % 3 == 0);
+    const uint32_t cornerCount = corners.size();
+    tangents.assign(cornerCount, float4());
+    if (cornerCount == 0) return;
+
+    TangentContext context;
+    context.vertices = &vertices[0];
+    context.corners = &corners[0];
+    context.faceTangents.resize(cornerCount / 3);
+    context.orientations.resize(cornerCount / 3);
+    context.tangents = &tangents[0];
+    parallelFor(cornerCount / 3, bind(&TangentContext::faces, &context, _1, _2));
+
+    // Corners share a tangent when they share a vertex and uv orientation.
+    // Corners of faces without uv area join their vertex's ccw corners, or
+    // its cw ones if it has only those, so they add no split; a vertex
+    // with neither gets sign +1.
+    std::vector<uint8_t> windings(vertices.size(), 0);
+    for (uint32_t c = 0; c < cornerCount; ++c)
+    {
+      const uint32_t o = context.orientations[c / 3];
+      if (o < 2) windings[corners[c]] |= 1 << o;
+    }
+    std::vector<uint32_t> buckets(cornerCount);
+    for (uint32_t c = 0; c < cornerCount; ++c)
+    {
+      uint32_t o = context.orientations[c / 3];
+      if (o == 2) o = windings[corners[c]] == 1 ? 0 : 1;
+      buckets[c] = 2 * corners[c] + o;
+    }
+    bucketItems(buckets, 2 * vertices.size(), context.sortedCorners, context.offsets);
+    parallelFor(2 * vertices.size(), bind(&TangentContext::gather, &context, _1, _2), 1024);
+  }
+
+  MeshPTNTPtr generateTangents(const MeshPTNPtr& mesh)
+  {
+    // Weld bitwise-equal vertices first so flat meshes share tangents too.
+    typedef vec<uint32_t, sizeof(VertexPTN) / sizeof(uint32_t)> VertexKey;
+    FlatIndexMap<VertexKey> weld(mesh->vertices().size());
+    std::vector<VertexPTN> vertices;
+    std::vector<uint32_t> ids(mesh->vertices().size());
+    for (uint32_t v = 0; v < mesh->vertices().size(); ++v)
+    {
+      std::pair<uint32_t, bool> pib = weld.insert(vertexBits(mesh->vertices()[v]), 
+          vertices.size());
+      if (pib.second) vertices.push_back(mesh->vertices()[v]);
+      ids[v] = pib.first;
+    }
+
+    const bool flat = mesh->indices().empty();
+    const uint32_t cornerCount = flat ? mesh->vertices().size() : mesh->indices().size();
+    std::vector<uint32_t> corners(cornerCount);
+    for (uint32_t c = 0; c < cornerCount; ++c) 
+    {
+      corners[c] = ids[flat ? c : mesh->indices()[c]];
+    }
+    std::vector<float4> tangents;
+    cornerTangents(vertices, corners, tangents);
+
+    MeshPTNTPtr out(new Mesh<VertexPTNT>());
+    out->_geometryGroups.assign(mesh->beginGeometryGroups(), mesh->endGeometryGroups());
+    out->_materialGroups.assign(mesh->beginMaterialGroups(), mesh->endMaterialGroups());
+    out->_materials = mesh->materials();
+
+    typedef vec<uint32_t, sizeof(VertexPTNT) / sizeof(uint32_t)> TangentKey;
+    FlatIndexMap<TangentKey> split(vertices.size());
+    out->_indices.resize(cornerCount);
+    for (uint32_t c = 0; c < cornerCount; ++c)
+    {
+      const VertexPTN& v = vertices[corners[c]];
+      VertexPTNT vt(v.position, v.uv, v.normal, tangents[c]);
+      std::pair<uint32_t, bool> pib = split.insert(vertexBits(vt), out->_vertices.size());
+      if (pib.second) out->_vertices.push_back(vt);
+      out->_indices[c] = pib.first;
+    }
+    return out;
+  }
+}
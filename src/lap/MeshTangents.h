@@ -0,0 +1,24 @@
+#ifndef LAP_MESH_TANGENTS_H
+#define LAP_MESH_TANGENTS_H
+
+#include "MeshAsset.h"
+
+namespace lap
+{
+  //! Tangents for each corner of a triangle list, following MikkTSpace: 
+  //! per-face tangents are projected onto each corner's normal, weighted by
+  //! the corner angle and averaged over corners sharing a vertex and uv 
+  //! orientation. Faces without uv area add nothing and take their
+  //! vertex's orientation, ccw if it has both or none, so a vertex without
+  //! any contribution gets sign +1. corners holds three vertex ids per
+  //! triangle. The result doesn't depend on the thread count.
+  void cornerTangents(const std::vector<VertexPTN>& vertices,
+      const std::vector<uint32_t>& corners, std::vector<float4>& tangents);
+
+  //! Add tangents and bitangent signs to a flat or indexed mesh. Vertices 
+  //! are split where mirrored uvs meet. The result is indexed with the 
+  //! same groups and materials.
+  MeshPTNTPtr generateTangents(const MeshPTNPtr& mesh);
+}
+
+#endif
@@ -0,0 +1,283 @@
+#include "MeshTiles.h"
+#include <sstream>
+
+namespace lap
+{
+  namespace
+  {
+    struct CentroidLess
+    {
+      const float3* centroids;
+      int axis;
+
+      bool operator()(uint32_t a, uint32_t b)const
+      {
+        return centroids[a][axis] < centroids[b][axis];
+      }
+    };
+
+    // Nodes at least this big are split one at a time with every thread,
+    // smaller ones a node per thread.
+    const uint32_t kWideNode = 1 << 16;
+    const uint32_t kSplitBins = 4096;
+
+    struct ChunkBounds
+    {
+      const float3* centroids;
+      const uint32_t* ids;
+      BoundingBox<float3>* bounds;
+
+      void operator()(uint32_t chunk, uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t i = begin; i < end; ++i) bounds[chunk].unionPoint(centroids[ids[i]]);
+      }
+    };
+
+    // Bin of a centroid along axis within [low, low + size].
+    struct AxisBins
+    {
+      const float3* centroids;
+      int axis;
+      float low;
+      float scale;
+
+      uint32_t operator()(uint32_t id)const
+      {
+        const float t = (centroids[id][axis] - low) * scale;
+        return t > 0.0f ? std::min((uint32_t)t, kSplitBins - 1) : 0;
+      }
+    };
+
+    struct ChunkHistogram
+    {
+      const uint32_t* ids;
+      AxisBins bins;
+      uint32_t* counts; // kSplitBins per chunk
+
+      void operator()(uint32_t chunk, uint32_t begin, uint32_t end)const
+      {
+        uint32_t* h = counts + (size_t)chunk * kSplitBins;
+        for (uint32_t i = begin; i < end; ++i) ++h[bins(ids[i])];
+      }
+    };
+
+    // Stable three-way partition of ids around one bin: each chunk writes 
+    // its ids below, in and above the bin from its own offsets.
+    struct ScatterByBin
+    {
+      const uint32_t* ids;
+      AxisBins bins;
+      uint32_t bin;
+      const uint32_t* offsets; // 3 per chunk
+      uint32_t* out;
+
+      void operator()(uint32_t chunk, uint32_t begin, uint32_t end)const
+      {
+        uint32_t at[3] = { offsets[3 * chunk], offsets[3 * chunk + 1], offsets[3 * chunk + 2] };
+        for (uint32_t i = begin; i < end; ++i)
+        {
+          const uint32_t b = bins(ids[i]);
+          out[at[b < bin ? 0 : (b == bin ? 1 : 2)]++] = ids[i];
+        }
+      }
+    };
+
+    struct CopyIds
+    {
+      const uint32_t* from;
+      uint32_t* to;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        std::copy(from + begin, from + end, to + begin);
+      }
+    };
+
+    // As SplitNodes for one node, with bounds, selection and partition in
+    // parallel: centroids are binned along the widest axis, the bin holding
+    // the cut is found from their histogram and only that bin is sorted.
+    uint32_t splitWideNode(const std::vector<float3>& centroids, uint32_t* order,
+        const Group& node, uint32_t budget)
+    {
+      const uint32_t count = node.count();
+      uint32_t* ids = order + node.begin();
+      const uint32_t chunks = chunkCount(count, 1 << 14);
+
+      std::vector<BoundingBox<float3> > chunkBounds(chunks);
+      ChunkBounds measure = { &centroids[0], ids, &chunkBounds[0] };
+      parallelChunks(count, chunks, measure);
+      BoundingBox<float3> bounds;
+      for (uint32_t c = 0; c < chunks; ++c)
+      {
+        bounds.unionPoint(chunkBounds[c].min());
+        bounds.unionPoint(chunkBounds[c].max());
+      }
+
+      const int axis = bounds.largestAxis();
+      const float size = bounds.size(axis);
+      AxisBins bins = { &centroids[0], axis, bounds.min()[axis],
+        size > 0.0f ? kSplitBins / size : 0.0f };
+      std::vector<uint32_t> histograms((size_t)chunks * kSplitBins);
+      ChunkHistogram histogram = { ids, bins, &histograms[0] };
+      parallelChunks(count, chunks, histogram);
+
+      // Cut on a multiple of the budget so leaves come out full.
+      const uint32_t leaves = (count + budget - 1) / budget;
+      const uint32_t rank = (leaves / 2) * budget;
+      uint32_t bin = 0;
+      uint32_t below = 0;
+      for (;; ++bin)
+      {
+        uint32_t inBin = 0;
+        for (uint32_t c = 0; c < chunks; ++c) inBin += histograms[(size_t)c * kSplitBins + bin];
+        if (below + inBin > rank || bin + 1 == kSplitBins) break;
+        below += inBin;
+      }
+
+      std::vector<uint32_t> totals(3 * chunks);
+      for (uint32_t c = 0; c < chunks; ++c)
+      {
+        const uint32_t* h = &histograms[(size_t)c * kSplitBins];
+        for (uint32_t b = 0; b < kSplitBins; ++b)
+        {
+          totals[3 * c + (b < bin ? 0 : (b == bin ? 1 : 2))] += h[b];
+        }
+      }
+      uint32_t inBin = 0;
+      for (uint32_t c = 0; c < chunks; ++c) inBin += totals[3 * c + 1];
+      std::vector<uint32_t> offsets(3 * chunks);
+      uint32_t at = 0;
+      for (uint32_t side = 0; side < 3; ++side)
+      {
+        for (uint32_t c = 0; c < chunks; ++c)
+        {
+          offsets[3 * c + side] = at;
+          at += totals[3 * c + side];
+        }
+      }
+
+      std::vector<uint32_t> partitioned(count);
+      ScatterByBin scatter = { ids, bins, bin, &offsets[0], &partitioned[0] };
+      parallelChunks(count, chunks, scatter);
+      CopyIds copy = { &partitioned[0], ids };
+      parallelFor(count, copy);
+
+      CentroidLess less = { &centroids[0], axis };
+      std::nth_element(ids + below, ids + rank, ids + below + inBin, less);
+      return node.begin() + rank;
+    }
+
+    struct SplitNodes
+    {
+      const std::vector<float3>* centroids;
+      uint32_t* order;
+      const Group* nodes;
+      uint32_t budget;
+      uint32_t* mids; // Split point of each node, or its end for leaves.
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t n = begin; n < end; ++n)
+        {
+          const Group& node = nodes[n];
+          if (node.count() >= kWideNode && node.count() > budget) continue;
+          if (node.count() <= budget)
+          {
+            mids[n] = node.end();
+            continue;
+          }
+          BoundingBox<float3> bounds;
+          for (uint32_t i = node.begin(); i < node.end(); ++i) 
+          {
+            bounds.unionPoint((*centroids)[order[i]]);
+          }
+          // Cut on a multiple of the budget so leaves come out full.
+          const uint32_t leaves = (node.count() + budget - 1) / budget;
+          const uint32_t mid = node.begin() + (leaves / 2) * budget;
+          CentroidLess less = { &(*centroids)[0], bounds.largestAxis() };
+          std::nth_element(order + node.begin(), order + mid, order + node.end(), less);
+          mids[n] = mid;
+        }
+      }
+    };
+  }
+
+  void kdTiles(const std::vector<float3>& centroids, uint32_t budget,
+      std::vector<uint32_t>& order, std::vector<Group>& leaves)
+  {
+    budget = std::max(budget, 1u);
+    order.resize(centroids.size());
+    for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+    leaves.clear();
+    if (order.empty()) return;
+
+    std::vector<Group> level(1, Group("", 0, order.size()));
+    while (!level.empty())
+    {
+      std::vector<uint32_t> mids(level.size());
+      for (uint32_t n = 0; n < level.size(); ++n)
+      {
+        if (level[n].count() >= kWideNode && level[n].count() > budget)
+          mids[n] = splitWideNode(centroids, &order[0], level[n], budget);
+      }
+      SplitNodes fn = { &centroids, &order[0], &level[0], budget, &mids[0] };
+      parallelFor(level.size(), fn, 1);
+
+      std::vector<Group> next;
+      for (uint32_t n = 0; n < level.size(); ++n)
+      {
+        const Group& node = level[n];
+        if (mids[n] == node.end())
+        {
+          leaves.push_back(node);
+          continue;
+        }
+        next.push_back(Group("", node.begin(), mids[n] - node.begin()));
+        next.push_back(Group("", mids[n], node.end() - mids[n]));
+      }
+      level.swap(next);
+    }
+
+    std::sort(leaves.begin(), leaves.end());
+    for (uint32_t i = 0; i < leaves.size(); ++i)
+    {
+      std::ostringstream name;
+      name << "tile_" << i;
+      leaves[i] = Group(name.str(), leaves[i].begin(), leaves[i].count());
+    }
+  }
+
+  void compactCorners(const std::vector<uint32_t>& indices, const uint32_t* tris,
+      uint32_t count, std::vector<uint32_t>& vertexIds,
+      std::vector<uint32_t>& corners)
+  {
+    corners.resize(3 * count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+      std::copy(&indices[3 * tris[i]], &indices[3 * tris[i]] + 3, &corners[3 * i]);
+    }
+    vertexIds = corners;
+    std::sort(vertexIds.begin(), vertexIds.end());
+    vertexIds.erase(std::unique(vertexIds.begin(), vertexIds.end()), vertexIds.end());
+    for (std::vector<uint32_t>::iterator c = corners.begin(); c != corners.end(); ++c)
+    {
+      *c = std::lower_bound(vertexIds.begin(), vertexIds.end(), *c) - vertexIds.begin();
+    }
+  }
+
+  void regionGroups(const std::vector<Group>& groups, const std::vector<uint32_t>& regions,
+      const uint32_t* tris, uint32_t count, std::vector<Group>& out)
+  {
+    for (uint32_t i = 0; i < count; )
+    {
+      const uint32_t region = regions[tris[i]];
+      uint32_t end = i + 1;
+      while (end < count && regions[tris[end]] == region) ++end;
+      if (region < groups.size())
+      {
+        out.push_back(Group(groups[region].name(), 3 * i, 3 * (end - i)));
+      }
+      i = end;
+    }
+  }
+}
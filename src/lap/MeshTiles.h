@@ -0,0 +1,160 @@
+#ifndef LAP_MESH_TILES_H
+#define LAP_MESH_TILES_H
+
+#include "MeshComponents.h"
+#include "Parallel.h"
+
+namespace lap
+{
+  //! Split triangles into k-d leaves of at most budget triangles. Each
+  //! node is cut along its widest axis so the centroids below the cut fill
+  //! half the node's leaves, rounded down, which leaves every leaf full 
+  //! but one. Nodes of a level are split in parallel, a node per thread;
+  //! the few large nodes of the first levels are each split by all threads.
+  //! order receives triangle ids leaf by leaf and leaves their ranges 
+  //! within it, named tile_<n>.
+  void kdTiles(const std::vector<float3>& centroids, uint32_t budget,
+      std::vector<uint32_t>& order, std::vector<Group>& leaves);
+
+  //! Sorted, unique vertex ids used by the triangles listed in tris, and
+  //! each of their corners renumbered into that list.
+  void compactCorners(const std::vector<uint32_t>& indices, const uint32_t* tris,
+      uint32_t count, std::vector<uint32_t>& vertexIds,
+      std::vector<uint32_t>& corners);
+
+  //! Runs of equal region over a list of triangles, as groups over their
+  //! corners named after the region's group. Triangles in no region get
+  //! no group.
+  void regionGroups(const std::vector<Group>& groups, const std::vector<uint32_t>& regions,
+      const uint32_t* tris, uint32_t count, std::vector<Group>& out);
+
+  template <typename V>
+    struct TriangleCentroids
+    {
+      const Mesh<V>* mesh;
+      float3* centroids;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        const bool flat = mesh->_indices.empty();
+        for (uint32_t t = begin; t < end; ++t)
+        {
+          float3 c;
+          for (uint32_t k = 0; k < 3; ++k)
+          {
+            const uint32_t corner = 3 * t + k;
+            c = c + mesh->_vertices[flat ? corner : mesh->_indices[corner]].position;
+          }
+          centroids[t] = c * (1.0f / 3.0f);
+        }
+      }
+    };
+
+  template <typename V>
+    void triangleCentroids(const shared_ptr<Mesh<V> >& mesh, std::vector<float3>& centroids)
+    {
+      const uint32_t corners = mesh->_indices.empty() ? mesh->_vertices.size() : mesh->_indices.size();
+      centroids.resize(corners / 3);
+      if (centroids.empty()) return;
+      TriangleCentroids<V> fn = { mesh.get(), &centroids[0] };
+      parallelFor(centroids.size(), fn);
+    }
+
+  //! One spatial tile of a mesh.
+  template <typename V>
+    struct MeshTile
+    {
+      std::string name;
+      BoundingBox<float3> bounds;
+      shared_ptr<Mesh<V> > mesh;
+    };
+
+  template <typename V>
+    struct ExtractTiles
+    {
+      const Mesh<V>* mesh;
+      const std::vector<uint32_t>* order;
+      const std::vector<Group>* leaves;
+      const std::vector<uint32_t>* geometryRegions;
+      const std::vector<uint32_t>* materialRegions;
+      MeshTile<V>* tiles;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t i = begin; i < end; ++i) extract((*leaves)[i], tiles[i]);
+      }
+
+      void extract(const Group& leaf, MeshTile<V>& tile)const
+      {
+        // Order the leaf's triangles by geometry then material group so
+        // each is one contiguous run.
+        const uint32_t materials = mesh->_materialGroups.size() + 1;
+        std::vector<std::pair<uint64_t, uint32_t> > keyed(leaf.count());
+        for (uint32_t i = 0; i < leaf.count(); ++i)
+        {
+          const uint32_t t = (*order)[leaf.begin() + i];
+          keyed[i] = std::make_pair(((uint64_t)(*geometryRegions)[t] * materials +
+                (*materialRegions)[t]) << 32 | i, t);
+        }
+        std::sort(keyed.begin(), keyed.end());
+        std::vector<uint32_t> tris(leaf.count());
+        for (uint32_t i = 0; i < leaf.count(); ++i) tris[i] = keyed[i].second;
+
+        shared_ptr<Mesh<V> > out(new Mesh<V>());
+        std::vector<uint32_t> vertexIds;
+        compactCorners(mesh->_indices, tris.empty() ? NULL : &tris[0], tris.size(),
+            vertexIds, out->_indices);
+        out->_vertices.reserve(vertexIds.size());
+        for (std::vector<uint32_t>::const_iterator v = vertexIds.begin(); v != vertexIds.end(); ++v)
+        {
+          out->_vertices.push_back(mesh->_vertices[*v]);
+          tile.bounds.unionPoint(out->_vertices.back().position);
+        }
+
+        const uint32_t* t = tris.empty() ? NULL : &tris[0];
+        regionGroups(mesh->_geometryGroups, *geometryRegions, t, tris.size(), out->_geometryGroups);
+        regionGroups(mesh->_materialGroups, *materialRegions, t, tris.size(), out->_materialGroups);
+        for (GroupConstIter g = out->beginMaterialGroups(); g != out->endMaterialGroups(); ++g)
+        {
+          MaterialMap::const_iterator m = mesh->_materials.find(g->name());
+          if (m != mesh->_materials.end()) out->_materials.insert(*m);
+        }
+        tile.name = leaf.name();
+        tile.mesh = out;
+      }
+    };
+
+  //! Cut a mesh into spatial tiles of at most budget triangles, see kdTiles.
+  //! Each tile is a compact indexed mesh keeping the geometry and material
+  //! groups and materials of its triangles. Tiles are extracted in
+  //! parallel; flat meshes are indexed first.
+  template <typename V>
+    void tileMesh(shared_ptr<Mesh<V> > mesh, uint32_t budget,
+        std::vector<MeshTile<V> >& tiles)
+    {
+      tiles.clear();
+      if (mesh->_indices.empty()) mesh = indexedMeshFromMesh(mesh);
+
+      std::vector<uint32_t> order;
+      std::vector<Group> leaves;
+      {
+        std::vector<float3> centroids;
+        triangleCentroids(mesh, centroids);
+        kdTiles(centroids, budget, order, leaves);
+      }
+
+      const uint32_t triangles = mesh->_indices.size() / 3;
+      std::vector<uint32_t> geometryRegions;
+      std::vector<uint32_t> materialRegions;
+      triangleRegions(mesh->_geometryGroups, triangles, geometryRegions);
+      triangleRegions(mesh->_materialGroups, triangles, materialRegions);
+
+      tiles.resize(leaves.size());
+      if (tiles.empty()) return;
+      ExtractTiles<V> fn = { mesh.get(), &order, &leaves, &geometryRegions,
+        &materialRegions, &tiles[0] };
+      parallelFor(tiles.size(), fn, 1);
+    }
+}
+
+#endif
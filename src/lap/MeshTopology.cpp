@@ -0,0 +1,143 @@
+#include "MeshTopology.h"
+#include "Parallel.h"
+#include "RadixSort.h"
+
+namespace lap
+{
+  const uint32_t HalfEdgeMesh::kInvalid;
+
+  namespace
+  {
+    struct EdgeKeys
+    {
+      const uint32_t* origins;
+      uint64_t* keys;
+      uint32_t vertexBits;
+
+      void operator()(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t h = begin; h < end; ++h)
+        {
+          uint32_t a = origins[h];
+          uint32_t b = origins[h % 3 == 2 ? h - 2 : h + 1];
+          keys[h] = ((uint64_t)std::min(a, b) << vertexBits) | std::max(a, b);
+        }
+      }
+    };
+
+    // Walks runs of equal edge keys; a chunk owns the runs starting in it.
+    struct EdgeMatcher
+    {
+      const uint32_t* origins;
+      const uint64_t* keys;
+      const uint32_t* halfEdges;
+      uint32_t count;
+      uint32_t* twins;
+      uint8_t* nonManifold;
+      std::vector<uint32_t> edges;
+      std::vector<uint32_t> boundaryEdges;
+      std::vector<std::vector<uint32_t> > nonManifoldEdges;
+
+      bool startsRun(uint32_t i)const { return i == 0 || keys[i] != keys[i-1]; }
+
+      void operator()(uint32_t chunk, uint32_t begin, uint32_t end)
+      {
+        uint32_t i = begin;
+        while (i < end && !startsRun(i)) ++i;
+        while (i < end)
+        {
+          uint32_t j = i + 1;
+          while (j < count && keys[j] == keys[i]) ++j;
+          ++edges[chunk];
+          if (j - i == 1)
+          {
+            ++boundaryEdges[chunk];
+          }
+          else if (j - i == 2 && origins[halfEdges[i]] != origins[halfEdges[i+1]])
+          {
+            twins[halfEdges[i]] = halfEdges[i+1];
+            twins[halfEdges[i+1]] = halfEdges[i];
+          }
+          else
+          {
+            for (uint32_t k = i; k < j; ++k) nonManifold[halfEdges[k]] = 1;
+            nonManifoldEdges[chunk].push_back(halfEdges[i]);
+          }
+          i = j;
+        }
+      }
+    };
+
+    struct OrderFans
+    {
+      const uint32_t* twins;
+      const uint8_t* nonManifold;
+      const uint32_t* offsets;
+      uint32_t* outgoing;
+
+      bool isBoundary(uint32_t h)const { return twins[h] == HalfEdgeMesh::kInvalid && !nonManifold[h]; }
+
+      void operator()(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t v = begin; v < end; ++v)
+        {
+          std::stable_partition(outgoing + offsets[v], outgoing + offsets[v+1],
+              bind(&OrderFans::isBoundary, this, _1));
+        }
+      }
+    };
+  }
+
+  void HalfEdgeMesh::build(const std::vector<uint32_t>& corners, uint32_t vertexCount)
+  {
+    assert(corners.size() % 3 == 0);
+    const uint32_t count = corners.size();
+    _origins = corners;
+    _twins.assign(count, kInvalid);
+    _nonManifold.assign(count, 0);
+    _nonManifoldEdges.clear();
+
+    std::vector<uint64_t> keys(count);
+    std::vector<uint32_t> halfEdges(count);
+    for (uint32_t h = 0; h < count; ++h) halfEdges[h] = h;
+    const uint32_t vertexBits = bitsFor(vertexCount);
+    EdgeKeys ek = { count ? &_origins[0] : NULL, count ? &keys[0] : NULL, vertexBits };
+    parallelFor(count, ek);
+    radixSortPairs(keys, halfEdges, 2 * vertexBits);
+
+    const uint32_t chunks = chunkCount(count, 1 << 16);
+    EdgeMatcher matcher;
+    matcher.origins = count ? &_origins[0] : NULL;
+    matcher.keys = count ? &keys[0] : NULL;
+    matcher.halfEdges = count ? &halfEdges[0] : NULL;
+    matcher.count = count;
+    matcher.twins = count ? &_twins[0] : NULL;
+    matcher.nonManifold = count ? &_nonManifold[0] : NULL;
+    matcher.edges.assign(chunks, 0);
+    matcher.boundaryEdges.assign(chunks, 0);
+    matcher.nonManifoldEdges.resize(chunks);
+    parallelChunks(count, chunks, boost::ref(matcher));
+
+    _stats = TopologyStats();
+    _stats.faces = faces();
+    for (uint32_t c = 0; c < chunks; ++c)
+    {
+      _stats.edges += matcher.edges[c];
+      _stats.boundaryEdges += matcher.boundaryEdges[c];
+      _nonManifoldEdges.insert(_nonManifoldEdges.end(), 
+          matcher.nonManifoldEdges[c].begin(), matcher.nonManifoldEdges[c].end());
+    }
+    _stats.nonManifoldEdges = _nonManifoldEdges.size();
+
+    std::vector<uint64_t>().swap(keys);
+    bucketItems(_origins, vertexCount, _outgoing, _vertexOffsets);
+    OrderFans fans = { matcher.twins, matcher.nonManifold, &_vertexOffsets[0], 
+      count ? &_outgoing[0] : NULL };
+    parallelFor(vertexCount, fans, 1024);
+
+    for (uint32_t v = 0; v < vertexCount; ++v) 
+    {
+      if (valence(v)) ++_stats.vertices;
+    }
+  }
+}
@@ -0,0 +1,100 @@
+#ifndef LAP_MESH_TOPOLOGY_H
+#define LAP_MESH_TOPOLOGY_H
+
+#include "Dedup.h"
+#include "MeshAsset.h"
+
+namespace lap
+{
+  struct TopologyStats
+  {
+    TopologyStats(): 
+      vertices(0), faces(0), edges(0), boundaryEdges(0), nonManifoldEdges(0)
+    {}
+    uint32_t vertices; // Referenced by at least one face.
+    uint32_t faces;
+    uint32_t edges;
+    uint32_t boundaryEdges; // Edges with a single face.
+    uint32_t nonManifoldEdges; // Edges with more than two faces, or two faces that disagree on winding.
+    int64_t eulerCharacteristic()const { return (int64_t)vertices - edges + faces; }
+  };
+
+  //! Half-edge connectivity of a triangle list, held in flat arrays. Half-edge
+  //! h is the edge of face h/3 leaving corner h, so next/prev/face are 
+  //! arithmetic and twins and per-vertex fans are table lookups.
+  class HalfEdgeMesh
+  {
+    public:
+      static const uint32_t kInvalid = ~0u;
+
+      //! Build from three vertex ids per triangle. Edges are matched by 
+      //! radix-sorting their vertex pairs, in parallel.
+      void build(const std::vector<uint32_t>& corners, uint32_t vertexCount);
+
+      uint32_t faces()const { return _origins.size() / 3; }
+      uint32_t halfEdges()const { return _origins.size(); }
+      uint32_t vertices()const { return _vertexOffsets.empty() ? 0 : _vertexOffsets.size() - 1; }
+
+      uint32_t face(uint32_t h)const { return h / 3; }
+      uint32_t next(uint32_t h)const { return h % 3 == 2 ? h - 2 : h + 1; }
+      uint32_t prev(uint32_t h)const { return h % 3 == 0 ? h + 2 : h - 1; }
+      uint32_t origin(uint32_t h)const { return _origins[h]; }
+      uint32_t target(uint32_t h)const { return _origins[next(h)]; }
+
+      //! Opposite half-edge, or kInvalid on boundary and non-manifold edges.
+      uint32_t twin(uint32_t h)const { return _twins[h]; }
+      bool isBoundary(uint32_t h)const { return _twins[h] == kInvalid && !_nonManifold[h]; }
+      bool isNonManifold(uint32_t h)const { return _nonManifold[h] != 0; }
+
+      //! Half-edges leaving vertex v, boundary half-edges first.
+      const uint32_t* outgoingBegin(uint32_t v)const { return &_outgoing[0] + _vertexOffsets[v]; }
+      const uint32_t* outgoingEnd(uint32_t v)const { return &_outgoing[0] + _vertexOffsets[v+1]; }
+      uint32_t valence(uint32_t v)const { return _vertexOffsets[v+1] - _vertexOffsets[v]; }
+
+      //! One half-edge of each non-manifold edge.
+      const std::vector<uint32_t>& nonManifoldEdges()const { return _nonManifoldEdges; }
+
+      const TopologyStats& stats()const { return _stats; }
+
+    private:
+      std::vector<uint32_t> _origins;
+      std::vector<uint32_t> _twins;
+      std::vector<uint8_t> _nonManifold;
+      std::vector<uint32_t> _outgoing;
+      std::vector<uint32_t> _vertexOffsets;
+      std::vector<uint32_t> _nonManifoldEdges;
+      TopologyStats _stats;
+  };
+
+  //! Position ids of each corner of a flat or indexed mesh, with equal 
+  //! positions sharing an id. Returns the number of distinct positions.
+  template <typename V>
+    uint32_t weldedCorners(const shared_ptr<Mesh<V> >& mesh, std::vector<uint32_t>& corners)
+    {
+      std::vector<uint32_t> ids;
+      std::vector<float3> positions;
+      weldPositions(mesh->vertices(), ids, positions);
+
+      const bool flat = mesh->indices().empty();
+      const uint32_t cornerCount = flat ? mesh->vertices().size() : mesh->indices().size();
+      corners.resize(cornerCount);
+      for (uint32_t c = 0; c < cornerCount; ++c) 
+      {
+        corners[c] = ids[flat ? c : mesh->indices()[c]];
+      }
+      return positions.size();
+    }
+
+  //! Connectivity of a flat or indexed mesh. Vertices are matched by 
+  //! position, so uv and normal seams don't split edges; half-edge h is
+  //! mesh corner h.
+  template <typename V>
+    void buildTopology(const shared_ptr<Mesh<V> >& mesh, HalfEdgeMesh& topology)
+    {
+      std::vector<uint32_t> corners;
+      uint32_t vertexCount = weldedCorners(mesh, corners);
+      topology.build(corners, vertexCount);
+    }
+}
+
+#endif
@@ -0,0 +1,309 @@
+#include "MeshTransform.h"
+#include "Parallel.h"
+#include <cmath>
+#include <iostream>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+namespace lap
+{
+  float4x4::float4x4()
+  {
+    for (int i = 0; i < 16; ++i) m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+  }
+
+  float4x4::float4x4(const float* rowMajor)
+  {
+    std::copy(rowMajor, rowMajor + 16, m);
+  }
+
+  float4x4 operator*(const float4x4& a, const float4x4& b)
+  {
+    float4x4 c;
+    for (int r = 0; r < 4; ++r)
+    {
+      for (int k = 0; k < 4; ++k)
+      {
+        float sum = 0.0f;
+        for (int i = 0; i < 4; ++i) sum += a(r, i) * b(i, k);
+        c(r, k) = sum;
+      }
+    }
+    return c;
+  }
+
+  std::ostream& operator<<(std::ostream& os, const float4x4& rhs)
+  {
+    os << '[';
+    for (int r = 0; r < 4; ++r)
+    {
+      os << '[' << rhs(r, 0) << ' ' << rhs(r, 1) << ' ' << rhs(r, 2) << ' '
+        << rhs(r, 3) << ']';
+    }
+    os << ']';
+    return os;
+  }
+
+  float3 transformPoint(const float4x4& m, const float3& p)
+  {
+    float3 q;
+    for (int r = 0; r < 3; ++r) q[r] = m(r, 0) * p[0] + m(r, 1) * p[1] + m(r, 2) * p[2] + m(r, 3);
+    return q;
+  }
+
+  float3 transformVector(const float4x4& m, const float3& v)
+  {
+    float3 q;
+    for (int r = 0; r < 3; ++r) q[r] = m(r, 0) * v[0] + m(r, 1) * v[1] + m(r, 2) * v[2];
+    return q;
+  }
+
+  float linearDeterminant(const float4x4& m)
+  {
+    return m(0, 0) * (m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1)) -
+      m(0, 1) * (m(1, 0) * m(2, 2) - m(1, 2) * m(2, 0)) +
+      m(0, 2) * (m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0));
+  }
+
+  bool normalMatrix(const float4x4& m, float4x4& n)
+  {
+    const float det = linearDeterminant(m);
+    if (det == 0.0f || !(std::fabs(det) < HUGE_VALF)) return false;
+
+    // The inverse is the transposed cofactor matrix over det, so its
+    // transpose is the cofactors themselves.
+    const float s = 1.0f / det;
+    n = float4x4();
+    for (int r = 0; r < 3; ++r)
+    {
+      const int r1 = (r + 1) % 3;
+      const int r2 = (r + 2) % 3;
+      for (int c = 0; c < 3; ++c)
+      {
+        const int c1 = (c + 1) % 3;
+        const int c2 = (c + 2) % 3;
+        n(r, c) = (m(r1, c1) * m(r2, c2) - m(r1, c2) * m(r2, c1)) * s;
+      }
+    }
+    return true;
+  }
+
+  namespace
+  {
+    // The columns of a 3x4 transform: x, y and z axes and translation.
+    struct Columns
+    {
+      float c[4][4];
+
+      Columns(const float4x4& m)
+      {
+        for (int col = 0; col < 4; ++col)
+        {
+          for (int r = 0; r < 3; ++r) c[col][r] = m(r, col);
+          c[col][3] = 0.0f;
+        }
+      }
+    };
+
+#ifdef __SSE__
+    // Vertex attributes are packed float3s, so load and store exactly 12
+    // bytes to stay within the last vertex.
+    inline __m128 load3(const float* p)
+    {
+      const __m128 xy = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(p));
+      return _mm_movelh_ps(xy, _mm_load_ss(p + 2));
+    }
+
+    inline void store3(float* p, __m128 v)
+    {
+      _mm_storel_pi(reinterpret_cast<__m64*>(p), v);
+      _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+    }
+
+    inline __m128 linear(const __m128* c, __m128 v)
+    {
+      __m128 r = _mm_mul_ps(c[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+      r = _mm_add_ps(r, _mm_mul_ps(c[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+      return _mm_add_ps(r, _mm_mul_ps(c[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+    }
+
+    inline __m128 normalized(__m128 v)
+    {
+      __m128 d = _mm_mul_ps(v, v);
+      d = _mm_add_ss(_mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1))),
+          _mm_movehl_ps(d, d));
+      float l2;
+      _mm_store_ss(&l2, d);
+      if (!(l2 > 0.0f)) return _mm_setzero_ps();
+      return _mm_mul_ps(v, _mm_set1_ps(1.0f / std::sqrt(l2)));
+    }
+
+    struct Kernel
+    {
+      __m128 m[4];
+      __m128 n[3];
+      bool renormalize;
+
+      Kernel(const Columns& mc, const Columns& nc, bool r):
+        renormalize(r)
+      {
+        for (int i = 0; i < 4; ++i) m[i] = _mm_loadu_ps(mc.c[i]);
+        for (int i = 0; i < 3; ++i) n[i] = _mm_loadu_ps(nc.c[i]);
+      }
+
+      void point(float* p)const
+      {
+        store3(p, _mm_add_ps(linear(m, load3(p)), m[3]));
+      }
+
+      void normal(float* p)const
+      {
+        const __m128 v = linear(n, load3(p));
+        store3(p, renormalize ? normalized(v) : v);
+      }
+
+      void tangent(float* p)const
+      {
+        const __m128 v = linear(m, load3(p));
+        store3(p, renormalize ? normalized(v) : v);
+      }
+    };
+#else
+    inline void linear(const float (*c)[4], float* p)
+    {
+      const float x = p[0], y = p[1], z = p[2];
+      for (int i = 0; i < 3; ++i) p[i] = c[0][i] * x + c[1][i] * y + c[2][i] * z;
+    }
+
+    inline void normalize(float* p)
+    {
+      const float l2 = p[0] * p[0] + p[1] * p[1] + p[2] * p[2];
+      const float s = l2 > 0.0f ? 1.0f / std::sqrt(l2) : 0.0f;
+      for (int i = 0; i < 3; ++i) p[i] *= s;
+    }
+
+    struct Kernel
+    {
+      Columns m;
+      Columns n;
+      bool renormalize;
+
+      Kernel(const Columns& mc, const Columns& nc, bool r):
+        m(mc), n(nc), renormalize(r)
+      {}
+
+      void point(float* p)const
+      {
+        linear(m.c, p);
+        for (int i = 0; i < 3; ++i) p[i] += m.c[3][i];
+      }
+
+      void normal(float* p)const
+      {
+        linear(n.c, p);
+        if (renormalize) normalize(p);
+      }
+
+      void tangent(float* p)const
+      {
+        linear(m.c, p);
+        if (renormalize) normalize(p);
+      }
+    };
+#endif
+
+    struct TransformRange
+    {
+      const TransformTarget* target;
+      const uint32_t* ids;
+      const Kernel* kernel;
+      float tangentSign;
+
+      float* at(float* base, uint32_t i)const
+      {
+        return reinterpret_cast<float*>(reinterpret_cast<char*>(base) +
+            (size_t)(ids ? ids[i] : i) * target->stride);
+      }
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t i = begin; i < end; ++i) kernel->point(at(target->positions, i));
+        if (target->normals)
+        {
+          for (uint32_t i = begin; i < end; ++i) kernel->normal(at(target->normals, i));
+        }
+        if (target->tangents)
+        {
+          for (uint32_t i = begin; i < end; ++i)
+          {
+            float* t = at(target->tangents, i);
+            kernel->tangent(t);
+            t[3] *= tangentSign;
+          }
+        }
+      }
+    };
+  }
+
+  bool transformVertices(const TransformTarget& target, const uint32_t* ids,
+      uint32_t count, const float4x4& m, const TransformOptions& options)
+  {
+    float4x4 n;
+    if (!normalMatrix(m, n)) return false;
+    if (count == 0 || !target.positions) return true;
+
+    const Kernel kernel(Columns(m), Columns(n), options.renormalize);
+    const TransformRange range = { &target, ids, &kernel,
+      linearDeterminant(m) < 0.0f ? -1.0f : 1.0f };
+    parallelFor(count, range, 1 << 14);
+    return true;
+  }
+
+  void flipWinding(std::vector<uint32_t>& indices, const Group& g)
+  {
+    const uint32_t end = std::min<uint32_t>(g.end(), indices.size());
+    for (uint32_t c = g.begin(); c + 2 < end; c += 3)
+    {
+      std::swap(indices[c + 1], indices[c + 2]);
+    }
+  }
+
+  void groupVertexIds(std::vector<uint32_t>& indices, const Group& g,
+      uint32_t vertexCount, std::vector<uint32_t>& ids,
+      std::vector<uint32_t>& copies)
+  {
+    const uint32_t begin = std::min<uint32_t>(g.begin(), indices.size());
+    const uint32_t end = std::min<uint32_t>(g.end(), indices.size());
+
+    // Bit 0: used inside g, bit 1: used outside.
+    std::vector<uint8_t> use(vertexCount, 0);
+    for (uint32_t c = 0; c < indices.size(); ++c)
+    {
+      use[indices[c]] |= (c >= begin && c < end) ? 1 : 2;
+    }
+
+    const uint32_t kNone = ~0u;
+    std::vector<uint32_t> remap(vertexCount, kNone);
+    ids.clear();
+    copies.clear();
+    for (uint32_t c = begin; c < end; ++c)
+    {
+      uint32_t& to = remap[indices[c]];
+      if (to == kNone)
+      {
+        if (use[indices[c]] & 2)
+        {
+          to = vertexCount + copies.size();
+          copies.push_back(indices[c]);
+        }
+        else
+        {
+          to = indices[c];
+        }
+        ids.push_back(to);
+      }
+      indices[c] = to;
+    }
+  }
+}
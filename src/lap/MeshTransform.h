@@ -0,0 +1,178 @@
+#ifndef LAP_MESH_TRANSFORM_H
+#define LAP_MESH_TRANSFORM_H
+
+#include <iosfwd>
+#include "MeshAsset.h"
+
+namespace lap
+{
+  //! Row-major 4x4 matrix applied to column vectors, p' = M p. The bottom
+  //! row is ignored; placements are affine.
+  struct float4x4
+  {
+    //! Identity.
+    float4x4();
+    explicit float4x4(const float* rowMajor);
+
+    float operator()(int row, int col)const { return m[4 * row + col]; }
+    float& operator()(int row, int col) { return m[4 * row + col]; }
+
+    float m[16];
+  };
+
+  float4x4 operator*(const float4x4& a, const float4x4& b);
+  std::ostream& operator<<(std::ostream& os, const float4x4& rhs);
+
+  float3 transformPoint(const float4x4& m, const float3& p);
+  float3 transformVector(const float4x4& m, const float3& v);
+
+  //! Determinant of the upper 3x3. Negative for mirroring transforms.
+  float linearDeterminant(const float4x4& m);
+
+  //! The inverse-transpose of m's upper 3x3, which keeps normals
+  //! perpendicular to transformed surfaces. False if m is singular.
+  bool normalMatrix(const float4x4& m, float4x4& n);
+
+  struct TransformOptions
+  {
+    TransformOptions(): renormalize(true) {}
+
+    //! Rescale normals and tangents to unit length after transforming, so
+    //! scaling placements keep them usable for shading.
+    bool renormalize;
+  };
+
+  //! Attributes of a vertex array, each stride bytes apart. Null for
+  //! attributes the vertices don't have.
+  struct TransformTarget
+  {
+    float* positions;
+    float* normals;
+    float* tangents;
+    uint32_t stride;
+  };
+
+  template <typename V>
+    TransformTarget transformTarget(std::vector<V>& vertices)
+    {
+      TransformTarget t = { NULL, NULL, NULL, sizeof(V) };
+      if (vertices.empty()) return t;
+      V& v = vertices[0];
+      t.positions = &v.position[0];
+      Normal* n = attributePtr<Normal>(v);
+      if (n) t.normals = &n->normal[0];
+      Tangent* tn = attributePtr<Tangent>(v);
+      if (tn) t.tangents = &tn->tangent[0];
+      return t;
+    }
+
+  //! Transform count vertices of target, or the vertices listed in ids
+  //! when it isn't null: positions by m, normals by its inverse-transpose,
+  //! tangents by its linear part with bitangent signs flipped by mirroring
+  //! transforms. Uses SSE where available and runs in parallel over large
+  //! arrays. False, leaving target untouched, if m is singular.
+  bool transformVertices(const TransformTarget& target, const uint32_t* ids,
+      uint32_t count, const float4x4& m, const TransformOptions& options);
+
+  //! Reverse the winding of the triangles in corner range g, keeping mirrored
+  //! geometry front-facing.
+  void flipWinding(std::vector<uint32_t>& indices, const Group& g);
+
+  template <typename V>
+    void flipWinding(std::vector<V>& vertices, const Group& g)
+    {
+      for (uint32_t c = g.begin(); c + 2 < g.end(); c += 3)
+      {
+        std::swap(vertices[c + 1], vertices[c + 2]);
+      }
+    }
+
+  //! Vertex ids referenced by corner range g of an indexed mesh. Vertices
+  //! g shares with corners outside it are split off so transforming g
+  //! leaves the rest of the mesh alone: the new ids start at vertexCount,
+  //! g's indices are redirected to them and copies holds their sources.
+  void groupVertexIds(std::vector<uint32_t>& indices, const Group& g,
+      uint32_t vertexCount, std::vector<uint32_t>& ids,
+      std::vector<uint32_t>& copies);
+
+  //! Transform a whole flat or indexed mesh, see transformVertices.
+  //! Mirroring transforms also reverse the triangle winding.
+  template <typename V>
+    bool transformMesh(const shared_ptr<Mesh<V> >& mesh, const float4x4& m,
+        const TransformOptions& options = TransformOptions())
+    {
+      if (!transformVertices(transformTarget(mesh->_vertices), NULL,
+            mesh->_vertices.size(), m, options))
+      {
+        return false;
+      }
+      if (linearDeterminant(m) < 0.0f)
+      {
+        const bool flat = mesh->_indices.empty();
+        const Group all("all", 0, flat ? mesh->_vertices.size() : mesh->_indices.size());
+        if (flat) flipWinding(mesh->_vertices, all);
+        else flipWinding(mesh->_indices, all);
+      }
+      mesh->touch();
+      return true;
+    }
+
+  //! Transform the corners in range g, usually one of the mesh's geometry
+  //! groups. Indexed vertices shared with other groups are duplicated
+  //! first, see groupVertexIds.
+  template <typename V>
+    bool transformGroup(const shared_ptr<Mesh<V> >& mesh, const Group& g,
+        const float4x4& m, const TransformOptions& options = TransformOptions())
+    {
+      float4x4 n;
+      if (!normalMatrix(m, n)) return false;
+      if (mesh->_indices.empty())
+      {
+        const uint32_t end = std::min<uint32_t>(g.end(), mesh->_vertices.size());
+        if (g.begin() >= end) return true;
+        const Group range(g.name(), g.begin(), end - g.begin());
+        TransformTarget t = transformTarget(mesh->_vertices);
+        const uint32_t offset = range.begin() * t.stride;
+        if (t.positions) t.positions = (float*)((char*)t.positions + offset);
+        if (t.normals) t.normals = (float*)((char*)t.normals + offset);
+        if (t.tangents) t.tangents = (float*)((char*)t.tangents + offset);
+        transformVertices(t, NULL, range.count(), m, options);
+        if (linearDeterminant(m) < 0.0f) flipWinding(mesh->_vertices, range);
+        mesh->touch();
+        return true;
+      }
+
+      std::vector<uint32_t> ids;
+      std::vector<uint32_t> copies;
+      groupVertexIds(mesh->_indices, g, mesh->_vertices.size(), ids, copies);
+      mesh->_vertices.reserve(mesh->_vertices.size() + copies.size());
+      for (std::vector<uint32_t>::const_iterator c = copies.begin(); c != copies.end(); ++c)
+      {
+        mesh->_vertices.push_back(mesh->_vertices[*c]);
+      }
+      transformVertices(transformTarget(mesh->_vertices),
+          ids.empty() ? NULL : &ids[0], ids.size(), m, options);
+      if (linearDeterminant(m) < 0.0f) flipWinding(mesh->_indices, g);
+      mesh->touch();
+      return true;
+    }
+
+  //! Transform every geometry group called name. False if there's none or
+  //! m is singular.
+  template <typename V>
+    bool transformGroups(const shared_ptr<Mesh<V> >& mesh, const std::string& name,
+        const float4x4& m, const TransformOptions& options = TransformOptions())
+    {
+      bool found = false;
+      for (GroupConstIter g = mesh->beginGeometryGroups();
+          g != mesh->endGeometryGroups(); ++g)
+      {
+        if (g->name() != name) continue;
+        if (!transformGroup(mesh, *g, m, options)) return false;
+        found = true;
+      }
+      return found;
+    }
+}
+
+#endif
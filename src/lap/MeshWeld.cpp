@@ -0,0 +1,83 @@
+#include "MeshWeld.h"
+#include <cmath>
+
+namespace lap
+{
+  namespace
+  {
+    WeldSegment makeSegment(uint32_t group, uint32_t begin, uint32_t count)
+    {
+      const WeldSegment s = { group, begin, count, 0, 0, 0, 0, 0 };
+      return s;
+    }
+  }
+
+  void weldSegments(const std::vector<Group>& groups, uint32_t corners,
+      std::vector<WeldSegment>& segments)
+  {
+    segments.clear();
+    uint32_t cursor = 0;
+    for (uint32_t g = 0; g < groups.size(); ++g)
+    {
+      const uint32_t begin = std::min(std::max(groups[g].begin(), cursor), corners);
+      const uint32_t end = std::min(std::max(groups[g].end(), begin), corners);
+      if (begin > cursor) segments.push_back(makeSegment(WeldSegment::kGap, cursor, begin - cursor));
+      segments.push_back(makeSegment(g, begin, end - begin));
+      cursor = end;
+    }
+    if (corners > cursor) segments.push_back(makeSegment(WeldSegment::kGap, cursor, corners - cursor));
+  }
+
+  uint32_t slackCapacity(uint32_t used, float slack, uint32_t multiple)
+  {
+    const uint32_t capacity = used + (uint32_t)std::ceil(used * slack);
+    return (capacity + multiple - 1) / multiple * multiple;
+  }
+
+  void weldedGroups(const std::vector<Group>& geometryGroups, 
+      const std::vector<Group>& materialGroups, const std::vector<WeldSegment>& segments,
+      std::vector<Group>& geometryOut, std::vector<Group>& materialOut)
+  {
+    geometryOut.clear();
+    materialOut.clear();
+    for (std::vector<WeldSegment>::const_iterator s = segments.begin(); s != segments.end(); ++s)
+    {
+      if (s->group != WeldSegment::kGap)
+      {
+        geometryOut.push_back(Group(geometryGroups[s->group].name(), s->indexBegin, s->cornerCount));
+      }
+    }
+
+    // Segments are in corner order, so each material group's are found by
+    // bisecting on their first corner.
+    std::vector<uint32_t> segmentBegins(segments.size());
+    for (uint32_t i = 0; i < segments.size(); ++i) segmentBegins[i] = segments[i].cornerBegin;
+    for (GroupConstIter m = materialGroups.begin(); m != materialGroups.end(); ++m)
+    {
+      uint32_t i = std::upper_bound(segmentBegins.begin(), segmentBegins.end(), m->begin()) -
+        segmentBegins.begin();
+      for (i = i > 0 ? i - 1 : 0; i < segments.size() && segments[i].cornerBegin < m->end(); ++i)
+      {
+        const WeldSegment& s = segments[i];
+        const uint32_t begin = std::max(m->begin(), s.cornerBegin);
+        const uint32_t end = std::min(m->end(), s.cornerBegin + s.cornerCount);
+        if (begin >= end) continue;
+        materialOut.push_back(Group(m->name(), s.indexBegin + begin - s.cornerBegin, end - begin));
+      }
+    }
+    std::sort(materialOut.begin(), materialOut.end());
+
+    // Rejoin pieces of a group that stayed adjacent.
+    std::vector<Group> joined;
+    for (GroupConstIter m = materialOut.begin(); m != materialOut.end(); ++m)
+    {
+      if (!joined.empty() && joined.back().name() == m->name() && joined.back().end() == m->begin())
+      {
+        joined.back().setCount(joined.back().count() + m->count());
+        continue;
+      }
+      joined.push_back(*m);
+    }
+    materialOut.swap(joined);
+  }
+}
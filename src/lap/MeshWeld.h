@@ -0,0 +1,276 @@
+#ifndef LAP_MESH_WELD_H
+#define LAP_MESH_WELD_H
+
+#include "MeshAsset.h"
+#include "Parallel.h"
+
+namespace lap
+{
+  //! A run of corners welded on its own into a range of vertex slots and
+  //! a range of index slots.
+  struct WeldSegment
+  {
+    static const uint32_t kGap = ~0u;
+
+    uint32_t group; // Geometry group index, kGap for corners in none.
+    uint32_t cornerBegin; // Of the flat mesh.
+    uint32_t cornerCount;
+    uint32_t vertexBegin;
+    uint32_t capacity; // Vertex slots reserved, at least used.
+    uint32_t used;
+    uint32_t indexBegin;
+    uint32_t indexCapacity; // Index slots reserved, at least cornerCount.
+  };
+
+  //! One segment per geometry group and per run of corners between them,
+  //! in corner order. Vertex and index ranges are left empty.
+  void weldSegments(const std::vector<Group>& groups, uint32_t corners,
+      std::vector<WeldSegment>& segments);
+
+  //! Slots for used vertices or corners plus slack, a fraction of them,
+  //! rounded up to a multiple of multiple.
+  uint32_t slackCapacity(uint32_t used, float slack, uint32_t multiple = 1);
+
+  //! Groups of the flat mesh moved to their segments' index ranges. Each
+  //! geometry group covers its segment's corners; material groups are cut
+  //! where they cross segments that aren't adjacent, and sorted by begin.
+  void weldedGroups(const std::vector<Group>& geometryGroups, 
+      const std::vector<Group>& materialGroups, const std::vector<WeldSegment>& segments,
+      std::vector<Group>& geometryOut, std::vector<Group>& materialOut);
+
+  template <typename V>
+    struct WeldedSegment
+    {
+      std::vector<V> vertices;
+      std::vector<uint32_t> indices; // Local to vertices.
+    };
+
+  template <typename V>
+    struct WeldSegments
+    {
+      const Mesh<V>* flat;
+      const WeldSegment* segments;
+      const uint32_t* ids; // Segments to weld.
+      WeldedSegment<V>* welded;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+          const WeldSegment& s = segments[ids[i]];
+          shared_ptr<Mesh<V> > part(new Mesh<V>());
+          part->_vertices.assign(flat->_vertices.begin() + s.cornerBegin,
+              flat->_vertices.begin() + s.cornerBegin + s.cornerCount);
+          if (part->_vertices.empty()) continue;
+          shared_ptr<Mesh<V> > indexed = indexedMeshFromMesh(part);
+          welded[i].vertices.swap(indexed->_vertices);
+          welded[i].indices.swap(indexed->_indices);
+        }
+      }
+    };
+
+  //! An indexed mesh kept in step with a flat one by re-welding only the
+  //! geometry groups that change. Each segment (see weldSegments) is welded
+  //! on its own into a range of vertex slots with slack, so vertices aren't
+  //! shared across groups, and writes its indices into its own range of
+  //! index slots. A re-welded group that still fits its ranges is written
+  //! in place, otherwise it moves to the end of the vertex or index array
+  //! and leaves a hole until compact(). Unused index slots hold degenerate
+  //! triangles outside every group. Other segments are never touched.
+  template <typename V>
+    class IncrementalWeld
+    {
+      public:
+        explicit IncrementalWeld(const shared_ptr<Mesh<V> >& flat, float slack = 0.25f):
+          _mesh(new Mesh<V>()),
+          _slack(slack)
+        {
+          rebuild(*flat);
+        }
+
+        //! The indexed mesh. It's modified in place by update and compact.
+        const shared_ptr<Mesh<V> >& mesh()const { return _mesh; }
+
+        //! Vertex slots referenced by no index: slack and holes.
+        uint32_t unusedVertices()const
+        {
+          uint32_t used = 0;
+          for (std::vector<WeldSegment>::const_iterator s = _segments.begin(); s != _segments.end(); ++s)
+          {
+            used += s->used;
+          }
+          return _mesh->_vertices.size() - used;
+        }
+
+        //! Index slots holding no corner of the flat mesh: slack and holes.
+        uint32_t unusedCorners()const
+        {
+          uint32_t used = 0;
+          for (std::vector<WeldSegment>::const_iterator s = _segments.begin(); s != _segments.end(); ++s)
+          {
+            used += s->cornerCount;
+          }
+          return _mesh->_indices.size() - used;
+        }
+
+        //! Re-weld the geometry groups changed, by index, of flat after an
+        //! edit. Other segments must be unchanged but may have moved. If
+        //! the groups themselves changed everything is re-welded, into the
+        //! same mesh, and false returned.
+        bool update(const shared_ptr<Mesh<V> >& flat, const std::vector<uint32_t>& changed)
+        {
+          std::vector<WeldSegment> segments;
+          weldSegments(flat->_geometryGroups, flat->_vertices.size(), segments);
+          bool same = segments.size() == _segments.size();
+          for (uint32_t i = 0; same && i < segments.size(); ++i)
+          {
+            same = segments[i].group == _segments[i].group;
+            if (same && segments[i].cornerCount != _segments[i].cornerCount &&
+                std::find(changed.begin(), changed.end(), segments[i].group) == changed.end())
+            {
+              same = false;
+            }
+          }
+          if (!same)
+          {
+            rebuild(*flat);
+            return false;
+          }
+
+          for (uint32_t i = 0; i < segments.size(); ++i)
+          {
+            segments[i].vertexBegin = _segments[i].vertexBegin;
+            segments[i].capacity = _segments[i].capacity;
+            segments[i].used = _segments[i].used;
+            segments[i].indexBegin = _segments[i].indexBegin;
+            segments[i].indexCapacity = _segments[i].indexCapacity;
+          }
+          _segments.swap(segments);
+
+          std::vector<uint32_t> ids;
+          for (uint32_t i = 0; i < _segments.size(); ++i)
+          {
+            if (_segments[i].group != WeldSegment::kGap &&
+                std::find(changed.begin(), changed.end(), _segments[i].group) != changed.end())
+            {
+              ids.push_back(i);
+            }
+          }
+          place(*flat, ids);
+          return true;
+        }
+
+        //! Repack the vertex and index ranges in corner order without 
+        //! slack or holes, so groups match the flat mesh's.
+        void compact()
+        {
+          std::vector<V> vertices;
+          vertices.reserve(_mesh->_vertices.size() - unusedVertices());
+          std::vector<uint32_t> indices;
+          indices.reserve(_mesh->_indices.size() - unusedCorners());
+          for (std::vector<WeldSegment>::iterator s = _segments.begin(); s != _segments.end(); ++s)
+          {
+            const uint32_t base = vertices.size();
+            vertices.insert(vertices.end(), _mesh->_vertices.begin() + s->vertexBegin,
+                _mesh->_vertices.begin() + s->vertexBegin + s->used);
+            const uint32_t indexBase = indices.size();
+            for (uint32_t c = s->indexBegin; c < s->indexBegin + s->cornerCount; ++c)
+            {
+              indices.push_back(_mesh->_indices[c] - s->vertexBegin + base);
+            }
+            s->vertexBegin = base;
+            s->capacity = s->used;
+            s->indexBegin = indexBase;
+            s->indexCapacity = s->cornerCount;
+          }
+          _mesh->_vertices.swap(vertices);
+          _mesh->_indices.swap(indices);
+          regroup();
+          _mesh->touch();
+        }
+
+      private:
+        // Weld every segment of flat into the mesh, replacing its contents.
+        // Index ranges start without slack.
+        void rebuild(const Mesh<V>& flat)
+        {
+          weldSegments(flat._geometryGroups, flat._vertices.size(), _segments);
+          std::vector<uint32_t> all(_segments.size());
+          for (uint32_t i = 0; i < all.size(); ++i)
+          {
+            all[i] = i;
+            _segments[i].indexBegin = _segments[i].cornerBegin;
+            _segments[i].indexCapacity = _segments[i].cornerCount;
+          }
+          _mesh->_vertices.clear();
+          _mesh->_indices.assign(flat._vertices.size(), 0);
+          place(flat, all);
+        }
+
+        void regroup()
+        {
+          std::vector<Group> geometryGroups;
+          std::vector<Group> materialGroups;
+          weldedGroups(_flatGeometryGroups, _flatMaterialGroups, _segments,
+              geometryGroups, materialGroups);
+          _mesh->_geometryGroups.swap(geometryGroups);
+          _mesh->_materialGroups.swap(materialGroups);
+        }
+
+        // Weld segments ids of flat in parallel and write them into their
+        // vertex ranges, moving those that outgrew theirs to the end.
+        void place(const Mesh<V>& flat, const std::vector<uint32_t>& ids)
+        {
+          std::vector<WeldedSegment<V> > welded(ids.size());
+          if (!ids.empty())
+          {
+            WeldSegments<V> fn = { &flat, &_segments[0], &ids[0], &welded[0] };
+            parallelFor(ids.size(), fn, 1);
+          }
+
+          for (uint32_t i = 0; i < ids.size(); ++i)
+          {
+            WeldSegment& s = _segments[ids[i]];
+            const WeldedSegment<V>& w = welded[i];
+            s.used = w.vertices.size();
+            if (s.used > s.capacity)
+            {
+              s.vertexBegin = _mesh->_vertices.size();
+              s.capacity = slackCapacity(s.used, _slack);
+              _mesh->_vertices.resize(s.vertexBegin + s.capacity);
+            }
+            std::copy(w.vertices.begin(), w.vertices.end(), _mesh->_vertices.begin() + s.vertexBegin);
+
+            // Slots left behind or past the corners become degenerate.
+            std::vector<uint32_t>& indices = _mesh->_indices;
+            if (s.cornerCount > s.indexCapacity)
+            {
+              std::fill(indices.begin() + s.indexBegin, 
+                  indices.begin() + s.indexBegin + s.indexCapacity, 0);
+              s.indexBegin = indices.size();
+              s.indexCapacity = slackCapacity(s.cornerCount, _slack, 3);
+              indices.resize(s.indexBegin + s.indexCapacity);
+            }
+            for (uint32_t c = 0; c < w.indices.size(); ++c)
+            {
+              indices[s.indexBegin + c] = w.indices[c] + s.vertexBegin;
+            }
+            std::fill(indices.begin() + s.indexBegin + s.cornerCount,
+                indices.begin() + s.indexBegin + s.indexCapacity, 0);
+          }
+          _flatGeometryGroups = flat._geometryGroups;
+          _flatMaterialGroups = flat._materialGroups;
+          regroup();
+          _mesh->_materials = flat._materials;
+          _mesh->touch();
+        }
+
+        shared_ptr<Mesh<V> > _mesh;
+        std::vector<WeldSegment> _segments;
+        std::vector<Group> _flatGeometryGroups;
+        std::vector<Group> _flatMaterialGroups;
+        float _slack;
+    };
+}
+
+#endif
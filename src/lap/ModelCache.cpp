@@ -0,0 +1,131 @@
+#include "ModelCache.h"
+#include <iostream>
+#include <boost/filesystem/operations.hpp>
+
+namespace lap
+{
+  FileStamp fileStamp(const std::string& filename)
+  {
+    boost::system::error_code timeError;
+    boost::system::error_code sizeError;
+    const std::time_t modified = boost::filesystem::last_write_time(filename, timeError);
+    const uint64_t size = boost::filesystem::file_size(filename, sizeError);
+    const FileStamp stamp = { timeError ? 0 : modified, sizeError ? 0 : size };
+    return stamp;
+  }
+
+  namespace
+  {
+    uint64_t modelBytes(const obj::Model& model)
+    {
+      return model.positions().size() * sizeof(float3) +
+        model.normals().size() * sizeof(float3) +
+        model.uvs().size() * sizeof(float2) +
+        model.faceIndices().size() * sizeof(uint32_t) +
+        (model._geometryGroups.size() + model._materialGroups.size()) * sizeof(Group);
+    }
+  }
+
+  ModelCache::ModelCache(uint64_t capacity)
+  {
+    const Stats stats = { 0, 0, 0, 0, 0, capacity };
+    _stats = stats;
+  }
+
+  obj::ModelPtr ModelCache::model(const std::string& filename, FileStamp* stamp)
+  {
+    const FileStamp current = fileStamp(filename);
+    if (stamp) *stamp = current;
+    shared_ptr<void> found = find(filename, current);
+    if (found) return static_pointer_cast<obj::Model>(found);
+
+    // Only this file's lock is held, so other files are served meanwhile.
+    BuildLock building(*this, filename);
+    found = find(filename, current, false);
+    if (found) return static_pointer_cast<obj::Model>(found);
+    obj::ObjTranslator translator;
+    translator.setPipelined(true);
+    obj::ModelPtr model = translator.importFile(filename);
+    if (!model) return model;
+    return static_pointer_cast<obj::Model>(insert(filename, current, model, modelBytes(*model)));
+  }
+
+  ModelCache::Stats ModelCache::stats()const
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _stats;
+  }
+
+  ModelCache::BuildLock::BuildLock(ModelCache& cache, const std::string& key):
+    _cache(cache),
+    _key(key)
+  {
+    {
+      boost::mutex::scoped_lock lock(_cache._mutex);
+      shared_ptr<boost::mutex>& building = _cache._building[key];
+      if (!building) building.reset(new boost::mutex());
+      _building = building;
+    }
+    _building->lock();
+  }
+
+  ModelCache::BuildLock::~BuildLock()
+  {
+    // Copies are only taken under the cache's mutex, so the last holder
+    // sees nobody else waiting and drops the entry.
+    boost::mutex::scoped_lock lock(_cache._mutex);
+    _building->unlock();
+    if (_building.use_count() == 2) _cache._building.erase(_key);
+  }
+
+  shared_ptr<void> ModelCache::find(const std::string& key, const FileStamp& stamp, 
+      bool count)
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    unordered_map<std::string, EntryList::iterator>::iterator i = _index.find(key);
+    if (i == _index.end() || i->second->stamp != stamp)
+    {
+      if (count) ++_stats.misses;
+      return shared_ptr<void>();
+    }
+    if (count) ++_stats.hits;
+    _entries.splice(_entries.begin(), _entries, i->second);
+    return i->second->value;
+  }
+
+  shared_ptr<void> ModelCache::insert(const std::string& key, const FileStamp& stamp,
+      const shared_ptr<void>& value, uint64_t bytes)
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    unordered_map<std::string, EntryList::iterator>::iterator i = _index.find(key);
+    if (i != _index.end())
+    {
+      if (i->second->stamp == stamp) return i->second->value;
+      _stats.bytes -= i->second->bytes;
+      _entries.erase(i->second);
+      _index.erase(i);
+    }
+    const Entry entry = { key, stamp, value, bytes };
+    _entries.push_front(entry);
+    _index[key] = _entries.begin();
+    _stats.bytes += bytes;
+
+    // The new entry stays even if it alone is over capacity.
+    while (_stats.bytes > _stats.capacity && _entries.size() > 1)
+    {
+      _stats.bytes -= _entries.back().bytes;
+      _index.erase(_entries.back().key);
+      _entries.pop_back();
+      ++_stats.evictions;
+    }
+    _stats.entries = _entries.size();
+    return value;
+  }
+
+  std::ostream& operator<<(std::ostream& os, const ModelCache::Stats& rhs)
+  {
+    return os << "hits " << rhs.hits << "\nmisses " << rhs.misses <<
+      "\nevictions " << rhs.evictions << "\nentries " << rhs.entries <<
+      "\nbytes " << rhs.bytes << "\ncapacity " << rhs.capacity;
+  }
+}
@@ -0,0 +1,177 @@
+#ifndef LAP_MODEL_CACHE_H
+#define LAP_MODEL_CACHE_H
+
+#include <ctime>
+#include <list>
+#include <typeinfo>
+#include <boost/thread/mutex.hpp>
+#include "ObjAdapt.h"
+
+namespace lap
+{
+  //! Version of a file: its modification time, in seconds, and its size,
+  //! which catches most rewrites within the same second.
+  struct FileStamp
+  {
+    std::time_t modified;
+    uint64_t size;
+
+    bool operator==(const FileStamp& rhs)const 
+    { 
+      return modified == rhs.modified && size == rhs.size; 
+    }
+    bool operator!=(const FileStamp& rhs)const { return !(*this == rhs); }
+  };
+
+  //! Thread-safe LRU cache of imported models and meshes derived from them.
+  //! Entries are keyed by file and FileStamp, so an edited file is
+  //! re-imported, and the least recently used are evicted once their
+  //! estimated size passes the capacity. Evicted values stay alive while a
+  //! caller still holds them. Concurrent misses on one entry build it once,
+  //! the others wait for it; misses on different entries build in parallel.
+  class ModelCache
+  {
+    public:
+      struct Stats
+      {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t entries;
+        uint64_t bytes;
+        uint64_t capacity;
+      };
+
+      explicit ModelCache(uint64_t capacity);
+
+      //! filename's model, imported on a miss. Null if it can't be imported.
+      //! stamp, if given, receives the version of the file it was read from.
+      obj::ModelPtr model(const std::string& filename, FileStamp* stamp = NULL);
+
+      //! model, filename's model at stamp as returned by model(), as a flat
+      //! mesh of layout V, built from it on a miss. Never null: holding the
+      //! model keeps a mesh buildable however the file changes meanwhile.
+      //! The mesh doesn't memoize derived meshes (see Mesh::disableMemo), 
+      //! whose size the cache couldn't see; cache them as entries of their
+      //! own, like groupMesh.
+      template <typename V>
+        shared_ptr<Mesh<V> > mesh(const std::string& filename, 
+            const obj::ModelPtr& model, const FileStamp& stamp);
+
+      //! As above for filename's current model. Null if it can't be imported.
+      template <typename V>
+        shared_ptr<Mesh<V> > mesh(const std::string& filename);
+
+      //! The geometry group called group of model's mesh, see mesh(), 
+      //! flattened and welded, built on a miss and counted against the 
+      //! capacity like any other entry. Null if there's no such group.
+      template <typename V>
+        shared_ptr<Mesh<V> > groupMesh(const std::string& filename, 
+            const obj::ModelPtr& model, const FileStamp& stamp, const std::string& group);
+
+      Stats stats()const;
+
+    private:
+      struct Entry
+      {
+        std::string key;
+        FileStamp stamp;
+        shared_ptr<void> value;
+        uint64_t bytes;
+      };
+      typedef std::list<Entry> EntryList;
+
+      //! Held while building key's value, so concurrent misses on key 
+      //! wait for the first rather than building it again.
+      class BuildLock
+      {
+        public:
+          BuildLock(ModelCache& cache, const std::string& key);
+          ~BuildLock();
+        private:
+          BuildLock(const BuildLock&);
+          BuildLock& operator=(const BuildLock&);
+
+          ModelCache& _cache;
+          std::string _key;
+          shared_ptr<boost::mutex> _building;
+      };
+
+      //! The value cached under key if it is as new as stamp, made most
+      //! recently used. count is false for the second look of a miss, 
+      //! after waiting on its BuildLock.
+      shared_ptr<void> find(const std::string& key, const FileStamp& stamp,
+          bool count = true);
+
+      //! Cache value under key and evict down to capacity. If another
+      //! thread cached key meanwhile its value is kept and returned.
+      shared_ptr<void> insert(const std::string& key, const FileStamp& stamp,
+          const shared_ptr<void>& value, uint64_t bytes);
+
+      mutable boost::mutex _mutex;
+      EntryList _entries; // Most recently used first.
+      unordered_map<std::string, EntryList::iterator> _index;
+      unordered_map<std::string, shared_ptr<boost::mutex> > _building;
+      Stats _stats;
+  };
+
+  //! Version of filename, zero if it doesn't exist.
+  FileStamp fileStamp(const std::string& filename);
+
+  template <typename V>
+    uint64_t meshBytes(const Mesh<V>& mesh)
+    {
+      return mesh._vertices.size() * sizeof(V) + mesh._indices.size() * sizeof(uint32_t);
+    }
+
+  template <typename V>
+    shared_ptr<Mesh<V> > ModelCache::mesh(const std::string& filename,
+        const obj::ModelPtr& model, const FileStamp& stamp)
+    {
+      const std::string key = filename + '\n' + typeid(V).name();
+      shared_ptr<void> found = find(key, stamp);
+      if (found) return static_pointer_cast<Mesh<V> >(found);
+
+      BuildLock building(*this, key);
+      found = find(key, stamp, false);
+      if (found) return static_pointer_cast<Mesh<V> >(found);
+      shared_ptr<Mesh<V> > mesh = meshFromObj<V>(model);
+      mesh->disableMemo();
+      return static_pointer_cast<Mesh<V> >(insert(key, stamp, mesh, meshBytes(*mesh)));
+    }
+
+  template <typename V>
+    shared_ptr<Mesh<V> > ModelCache::mesh(const std::string& filename)
+    {
+      FileStamp stamp;
+      const obj::ModelPtr m = model(filename, &stamp);
+      if (!m) return shared_ptr<Mesh<V> >();
+      return mesh<V>(filename, m, stamp);
+    }
+
+  template <typename V>
+    shared_ptr<Mesh<V> > ModelCache::groupMesh(const std::string& filename,
+        const obj::ModelPtr& model, const FileStamp& stamp, const std::string& group)
+    {
+      const std::string key = filename + '\n' + typeid(V).name() + '\n' + group;
+      shared_ptr<void> found = find(key, stamp);
+      if (found) return static_pointer_cast<Mesh<V> >(found);
+
+      BuildLock building(*this, key);
+      found = find(key, stamp, false);
+      if (found) return static_pointer_cast<Mesh<V> >(found);
+      const shared_ptr<Mesh<V> > whole = mesh<V>(filename, model, stamp);
+      for (uint32_t g = 0; g < whole->_geometryGroups.size(); ++g)
+      {
+        if (whole->_geometryGroups[g].name() != group) continue;
+        shared_ptr<Mesh<V> > welded = whole->geometryGroupSlice(g)->flatten()->indexed();
+        welded->disableMemo();
+        return static_pointer_cast<Mesh<V> >(insert(key, stamp, welded, meshBytes(*welded)));
+      }
+      return shared_ptr<Mesh<V> >();
+    }
+
+  std::ostream& operator<<(std::ostream& os, const ModelCache::Stats& rhs);
+}
+
+#endif
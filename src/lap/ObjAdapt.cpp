@@ -1,31 +1,30 @@
 #include "ObjAdapt.h"
+#include "Parallel.h"
+#include "RadixSort.h"
 
 namespace lap {
 
-  typedef unordered_map<uint64_t, uint32_t> IndexMap;
-
-  VertexP makeVertexP(const obj::ModelPtr& obj, uint1 index)
-  {
-    return VertexP(obj->positions()[index[0]]);
-  }
-
-  VertexPTN makeVertexPTN(const obj::ModelPtr& obj, uint3 index)
-  {
-    return VertexPTN(obj->positions()[index[0]],
-        obj->uvs()[index[1]],
-        obj->normals()[index[2]]);
-  }
-
-  VertexPN makeVertexPN(const obj::ModelPtr& obj, uint2 index)
-  {
-    return VertexPN(obj->positions()[index[0]], obj->normals()[index[1]]);
-  }
-
-  VertexPT makeVertexPT(const obj::ModelPtr& obj, uint2 index)
-  {
-    return VertexPT(obj->positions()[index[0]], obj->uvs()[index[1]]);
-  }
+  //! The vertex at an obj face corner, reading one index per obj attribute.
+  template <typename V, typename I>
+    V makeObjVertex(const obj::ModelPtr& obj, I corner)
+    {
+      V v;
+      const uint32_t* c = &corner[0];
+      ObjAttrib<typename V::Attrib0>::read(v, *obj, c);
+      ObjAttrib<typename V::Attrib1>::read(v, *obj, c);
+      ObjAttrib<typename V::Attrib2>::read(v, *obj, c);
+      ObjAttrib<typename V::Attrib3>::read(v, *obj, c);
+      return v;
+    }
 
+  template <typename V>
+    void objAttribCounts(const obj::Model& obj, uint32_t* counts)
+    {
+      ObjAttrib<typename V::Attrib0>::count(obj, counts);
+      ObjAttrib<typename V::Attrib1>::count(obj, counts);
+      ObjAttrib<typename V::Attrib2>::count(obj, counts);
+      ObjAttrib<typename V::Attrib3>::count(obj, counts);
+    }
 
   Group meshGroupFromObj(const Group& objGroup, uint32_t components)
   {
@@ -48,53 +47,119 @@ namespace lap {
     return mesh;
   }
 
-  template <>
-  shared_ptr<Mesh<VertexP> > meshFromObj(const obj::ModelPtr& obj)
-  {
-    return meshFromObj<VertexP, uint1>(obj, makeVertexP);
-  }
+  template <typename V>
+    shared_ptr<Mesh<V> > meshFromObj(const obj::ModelPtr& obj)
+    {
+      typedef typename ObjCorner<V>::type I;
+      return meshFromObj<V, I>(obj, makeObjVertex<V, I>);
+    }
 
-  template <>
-  shared_ptr<Mesh<VertexPT> > meshFromObj(const obj::ModelPtr& obj)
-  {
-    return meshFromObj<VertexPT, uint2>(obj, makeVertexPT);
-  }
+  // Packs corner indices into a 64-bit key using just enough bits for each
+  // attribute array, so a key is exact whenever the widths fit.
+  template <typename I>
+    class CornerPacker
+    {
+      public:
+        static const uint32_t kComponents = sizeof(I) / sizeof(uint32_t);
 
-  template <>
-  shared_ptr<Mesh<VertexPN> > meshFromObj(const obj::ModelPtr& obj)
-  {
-    return meshFromObj<VertexPN, uint2>(obj, makeVertexPN);
-  }
+        CornerPacker(const uint32_t* counts):
+          _bits(0)
+        {
+          for (uint32_t i = 0; i < kComponents; ++i)
+          {
+            _shifts[i] = _bits;
+            _bits += bitsFor(counts[i]);
+          }
+        }
 
-  template <>
-  shared_ptr<Mesh<VertexPTN> > meshFromObj(const obj::ModelPtr& obj)
-  {
-    return meshFromObj<VertexPTN, uint3>(obj, makeVertexPTN);
-  }
+        uint32_t bits()const { return _bits; }
+        bool fits()const { return _bits <= 64; }
+
+        uint64_t operator()(const I& corner)const
+        {
+          uint64_t key = 0;
+          for (uint32_t i = 0; i < kComponents; ++i) 
+          {
+            if (_shifts[i] < 64) key |= (uint64_t)corner[i] << _shifts[i];
+          }
+          return key;
+        }
+
+      private:
+        uint32_t _shifts[kComponents];
+        uint32_t _bits;
+    };
+
+  template <typename I>
+    struct PackCorners
+    {
+      const I* corners;
+      uint64_t* keys;
+      const CornerPacker<I>* packer;
+
+      void operator()(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t i = begin; i < end; ++i) keys[i] = (*packer)(corners[i]);
+      }
+    };
+
+  template <typename V, typename I>
+    struct MakeUniqueVertices
+    {
+      const obj::ModelPtr* obj;
+      const I* corners;
+      const uint32_t* firsts;
+      V* vertices;
+      boost::function<V (obj::ModelPtr const&, I)> vertexGen;
+
+      void operator()(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t i = begin; i < end; ++i) 
+        {
+          vertices[i] = vertexGen(*obj, corners[firsts[i]]);
+        }
+      }
+    };
 
   template <typename V, typename I>
     shared_ptr<Mesh<V> > indexedMeshFromObj(const obj::ModelPtr& obj,
-        boost::function<uint64_t (I const& idx, obj::ModelPtr const& m)> keygen,
+        const uint32_t* attribCounts,
         boost::function<V (obj::ModelPtr const&, I)> vertexGen)
     {
       shared_ptr<Mesh<V> > mesh(new Mesh<V>());
       Range<I> is = make_range<I>(&obj->_faceIndices[0], obj->_faceIndices.size());
-      mesh->_indices.reserve(is.count());
-      uint32_t largestIndex = 0;
-      IndexMap indexMap;
-      for (const I* p = is.begin(); p != is.end(); ++p)
+      CornerPacker<I> packer(attribCounts);
+      if (packer.fits())
       {
-        std::pair<IndexMap::iterator, bool> pib = 
-          indexMap.insert(IndexMap::value_type(keygen(*p, obj), largestIndex));
-        if (pib.second)
-        {
-          mesh->_vertices.push_back(vertexGen(ref(obj), (*p)));
-          mesh->_indices.push_back(largestIndex++);
-        }
-        else
+        std::vector<uint64_t> keys(is.count());
+        PackCorners<I> pack = { is.begin(), keys.empty() ? NULL : &keys[0], &packer };
+        parallelFor(keys.size(), pack);
+
+        std::vector<uint32_t> firsts;
+        dedupKeys(keys, packer.bits(), mesh->_indices, firsts);
+        std::vector<uint64_t>().swap(keys);
+
+        mesh->_vertices.resize(firsts.size());
+        MakeUniqueVertices<V, I> make = { &obj, is.begin(), 
+          firsts.empty() ? NULL : &firsts[0], 
+          mesh->_vertices.empty() ? NULL : &mesh->_vertices[0], vertexGen };
+        parallelFor(firsts.size(), make);
+      }
+      else
+      {
+        // Too many attributes to pack, hash the corners themselves.
+        FlatIndexMap<I> indexMap(is.count() / 2);
+        mesh->_indices.reserve(is.count());
+        uint32_t largestIndex = 0;
+        for (const I* p = is.begin(); p != is.end(); ++p)
         {
-          uint32_t priorIndex = pib.first->second;
-          mesh->_indices.push_back(priorIndex);
+          std::pair<uint32_t, bool> pib = indexMap.insert(*p, largestIndex);
+          if (pib.second)
+          {
+            mesh->_vertices.push_back(vertexGen(ref(obj), (*p)));
+            ++largestIndex;
+          }
+          mesh->_indices.push_back(pib.first);
         }
       }
 
@@ -104,52 +169,104 @@ namespace lap {
       return mesh;
     }
 
-  uint64_t keyPTN(const uint3& index, const obj::ModelPtr& obj)
-  {
-    uint64_t zStride = obj->uvs().size() * obj->normals().size();
-    uint64_t yStride = obj->normals().size();
-    return index[0] * zStride + index[1] * yStride + index[2];
-  }
-  uint64_t keyPT(const uint2& index, const obj::ModelPtr& obj)
-  {
-    uint64_t yStride = obj->uvs().size();
-    return index[0] * yStride + index[1];
-  }
-  uint64_t keyPN(const uint2& index, const obj::ModelPtr& obj)
-  {
-    uint64_t yStride = obj->normals().size();
-    return index[0] * yStride + index[1];
-  }
-
+  template <typename V>
+    shared_ptr<Mesh<V> > indexedMeshFromObj(const obj::ModelPtr& obj)
+    {
+      typedef typename ObjCorner<V>::type I;
+      uint32_t counts[ObjCorner<V>::kSlots];
+      objAttribCounts<V>(*obj, counts);
+      return indexedMeshFromObj<V, I>(obj, counts, makeObjVertex<V, I>);
+    }
 
   template <>
-  shared_ptr<Mesh<VertexPT> > indexedMeshFromObj(const obj::ModelPtr& obj)
+  shared_ptr<Mesh<VertexP> > indexedMeshFromObj(const obj::ModelPtr& obj)
   {
-    return indexedMeshFromObj<VertexPT, uint2>(obj, keyPT, makeVertexPT);
+    shared_ptr<Mesh<VertexP> > mesh(new Mesh<VertexP>());
+    mesh->_vertices.assign(obj->positions().begin(), obj->positions().end());
+    mesh->_indices = obj->faceIndices();
+    adaptGroups<uint1>(obj->_geometryGroups, mesh->_geometryGroups, meshGroupFromObj);
+    adaptGroups<uint1>(obj->_materialGroups, mesh->_materialGroups, meshGroupFromObj);
+    mesh->_materials = obj->materials();
+    return mesh;
   }
 
-  template <>
-  shared_ptr<Mesh<VertexPN> > indexedMeshFromObj(const obj::ModelPtr& obj)
+  // Assigns each distinct corner the next index as faces stream in.
+  class CornerWelder
   {
-    return indexedMeshFromObj<VertexPN, uint2>(obj, keyPN, makeVertexPN);
-  }
+    public:
+      CornerWelder(WeldedObj& welded): _welded(welded) {}
 
-  template <>
-  shared_ptr<Mesh<VertexPTN> > indexedMeshFromObj(const obj::ModelPtr& obj)
-  {
-    return indexedMeshFromObj<VertexPTN, uint3>(obj, keyPTN, makeVertexPTN);
-  }
+      void operator()(const uint32_t* corner, uint32_t components)
+      {
+        uint3 key;
+        std::copy(corner, corner + components, &key[0]);
+        std::pair<uint32_t, bool> pib = _map.insert(key, _welded.corners.size());
+        if (pib.second) _welded.corners.push_back(key);
+        _welded.indices.push_back(pib.first);
+      }
 
-  template <>
-  shared_ptr<Mesh<VertexP> > indexedMeshFromObj(const obj::ModelPtr& obj)
+    private:
+      typedef FlatIndexMap<uint3> CornerMap;
+      WeldedObj& _welded;
+      CornerMap _map;
+  };
+
+  WeldedObjPtr importWeldedObj(const std::string& filename)
   {
-    shared_ptr<Mesh<VertexP> > mesh(new Mesh<VertexP>());
-    mesh->_vertices.assign(obj->positions().begin(), obj->positions().end());
-    mesh->_indices = obj->faceIndices();
-    return mesh;
+    WeldedObjPtr welded(new WeldedObj());
+    CornerWelder welder(*welded);
+    welded->model = obj::ObjTranslator().importFile(filename, boost::ref(welder));
+    if (!welded->model) return WeldedObjPtr();
+    return welded;
   }
 
+  template <typename I>
+    I cornerFromKey(const uint3& key)
+    {
+      I corner;
+      for (uint32_t i = 0; i < sizeof(I) / sizeof(uint32_t); ++i) corner[i] = key[i];
+      return corner;
+    }
+
+  template <typename V, typename I>
+    shared_ptr<Mesh<V> > indexedMeshFromWeldedObj(const WeldedObjPtr& welded,
+        boost::function<V (obj::ModelPtr const&, I)> vertexGen)
+    {
+      shared_ptr<Mesh<V> > mesh(new Mesh<V>());
+      const obj::ModelPtr& obj = welded->model;
+      mesh->_vertices.reserve(welded->corners.size());
+      for (std::vector<uint3>::const_iterator c = welded->corners.begin();
+          c != welded->corners.end(); ++c)
+      {
+        mesh->_vertices.push_back(vertexGen(obj, cornerFromKey<I>(*c)));
+      }
+      std::vector<uint3>().swap(welded->corners);
+      mesh->_indices.swap(welded->indices);
+
+      adaptGroups<I>(obj->_geometryGroups, mesh->_geometryGroups, meshGroupFromObj);
+      adaptGroups<I>(obj->_materialGroups, mesh->_materialGroups, meshGroupFromObj);
+      mesh->_materials = obj->materials();
+      return mesh;
+    }
+
+  template <typename V>
+    shared_ptr<Mesh<V> > indexedMeshFromWeldedObj(const WeldedObjPtr& welded)
+    {
+      typedef typename ObjCorner<V>::type I;
+      return indexedMeshFromWeldedObj<V, I>(welded, makeObjVertex<V, I>);
+    }
 
+  template shared_ptr<Mesh<VertexP> > meshFromObj<VertexP>(const obj::ModelPtr&);
+  template shared_ptr<Mesh<VertexPT> > meshFromObj<VertexPT>(const obj::ModelPtr&);
+  template shared_ptr<Mesh<VertexPN> > meshFromObj<VertexPN>(const obj::ModelPtr&);
+  template shared_ptr<Mesh<VertexPTN> > meshFromObj<VertexPTN>(const obj::ModelPtr&);
 
-}
+  template shared_ptr<Mesh<VertexPT> > indexedMeshFromObj<VertexPT>(const obj::ModelPtr&);
+  template shared_ptr<Mesh<VertexPN> > indexedMeshFromObj<VertexPN>(const obj::ModelPtr&);
+  template shared_ptr<Mesh<VertexPTN> > indexedMeshFromObj<VertexPTN>(const obj::ModelPtr&);
 
+  template shared_ptr<Mesh<VertexP> > indexedMeshFromWeldedObj<VertexP>(const WeldedObjPtr&);
+  template shared_ptr<Mesh<VertexPT> > indexedMeshFromWeldedObj<VertexPT>(const WeldedObjPtr&);
+  template shared_ptr<Mesh<VertexPN> > indexedMeshFromWeldedObj<VertexPN>(const WeldedObjPtr&);
+  template shared_ptr<Mesh<VertexPTN> > indexedMeshFromWeldedObj<VertexPTN>(const WeldedObjPtr&);
+}
@@ -1,6 +1,7 @@
 #ifndef LAP_OBJ_ADAPT_H
 #define LAP_OBJ_ADAPT_H
 
+#include "Dedup.h"
 #include "MeshAsset.h"
 
 namespace lap {
@@ -8,20 +9,49 @@ namespace lap {
   template <typename V>
     obj::ModelPtr objFromMesh(const shared_ptr<Mesh<V> > mesh);
 
+  // meshFromObj, indexedMeshFromObj and indexedMeshFromWeldedObj are
+  // instantiated for the layouts an obj-file holds: VertexP, VertexPT,
+  // VertexPN and VertexPTN.
   template <typename V>
     shared_ptr<Mesh<V> > meshFromObj(const obj::ModelPtr& model);
 
-  template <> shared_ptr<Mesh<VertexP> > meshFromObj(const obj::ModelPtr& model);
-  template <> shared_ptr<Mesh<VertexPT> > meshFromObj(const obj::ModelPtr& model);
-  template <> shared_ptr<Mesh<VertexPN> > meshFromObj(const obj::ModelPtr& model);
-  template <> shared_ptr<Mesh<VertexPTN> > meshFromObj(const obj::ModelPtr& model);
-
   template <typename V>
     shared_ptr<Mesh<V> > indexedMeshFromObj(const obj::ModelPtr& model);
+
+  // Positions-only faces already index the model's positions.
   template <> shared_ptr<Mesh<VertexP> > indexedMeshFromObj(const obj::ModelPtr& model);
-  template <> shared_ptr<Mesh<VertexPT> > indexedMeshFromObj(const obj::ModelPtr& model);
-  template <> shared_ptr<Mesh<VertexPN> > indexedMeshFromObj(const obj::ModelPtr& model);
-  template <> shared_ptr<Mesh<VertexPTN> > indexedMeshFromObj(const obj::ModelPtr& model);
+
+  //! Call f.apply<V>() with the vertex layout matching format, returning
+  //! false for kNone.
+  template <typename F>
+    bool dispatchVertexFormat(obj::VertexFormat format, const F& f)
+    {
+      switch (format)
+      {
+        case obj::kPosition: f.template apply<VertexP>(); return true;
+        case obj::kPositionUV: f.template apply<VertexPT>(); return true;
+        case obj::kPositionNormal: f.template apply<VertexPN>(); return true;
+        case obj::kPositionUVNormal: f.template apply<VertexPTN>(); return true;
+        default: return false;
+      }
+    }
+
+  //! An obj-model whose face corners were welded as they were parsed.
+  //! The model keeps its attributes, groups and materials but no face-indices.
+  struct WeldedObj
+  {
+    obj::ModelPtr model;
+    std::vector<uint3> corners; // Unique (v, vt, vn) corners, in first-seen order.
+    std::vector<uint32_t> indices; // Triangle indices into corners.
+  };
+  typedef shared_ptr<WeldedObj> WeldedObjPtr;
+
+  //! Import an obj-file, deduplicating corners on the fly.
+  WeldedObjPtr importWeldedObj(const std::string& filename);
+
+  //! Build an indexed mesh from a welded obj, consuming its indices.
+  template <typename V>
+    shared_ptr<Mesh<V> > indexedMeshFromWeldedObj(const WeldedObjPtr& welded);
 
   template<typename V, typename A>
     void objVertices(const shared_ptr<Mesh<V> >& mesh, 
@@ -29,14 +59,12 @@ namespace lap {
         boost::function<A (V const&)> getAttrib,
         boost::function<void (uint32_t, uint32_t)> indexGen)
     {
-      typedef unordered_map<A, uint32_t> AttribIndexer;
-      AttribIndexer indexer;
+      FlatIndexMap<A> indexer(mesh->vertices().size());
       uint32_t largestIndex = 0;
       for (uint32_t v = 0; v < mesh->vertices().size(); ++v)
       {
         A attrib = getAttrib(cref(mesh->vertices()[v]));
-        pair<typename AttribIndexer::iterator, bool> pib = 
-          indexer.insert(typename AttribIndexer::value_type(attrib, largestIndex));
+        pair<uint32_t, bool> pib = indexer.insert(attrib, largestIndex);
         if (pib.second)
         {
           vertexGen(attrib);
@@ -44,11 +72,35 @@ namespace lap {
         }
         else
         {
-          indexGen(v, pib.first->second);
+          indexGen(v, pib.first);
         }
       }
     }
 
+  //! As objVertices for an indexed mesh: each vertex's attribute is 
+  //! deduplicated and slot of every corner's face-index set to it.
+  template<typename V, typename A, typename I>
+    void objIndexedVertices(const Mesh<V>& mesh, 
+        boost::function<void (A)> vertexGen,
+        boost::function<A (V const&)> getAttrib,
+        Range<I>& is, uint32_t slot)
+    {
+      FlatIndexMap<A> indexer(mesh.vertices().size());
+      std::vector<uint32_t> attribIndices(mesh.vertices().size());
+      uint32_t largestIndex = 0;
+      for (uint32_t v = 0; v < mesh.vertices().size(); ++v)
+      {
+        A attrib = getAttrib(cref(mesh.vertices()[v]));
+        pair<uint32_t, bool> pib = indexer.insert(attrib, largestIndex);
+        if (pib.second) vertexGen(attrib);
+        attribIndices[v] = pib.second ? largestIndex++ : pib.first;
+      }
+      for (uint32_t c = 0; c < mesh.indices().size(); ++c)
+      {
+        is[c][slot] = attribIndices[mesh.indices()[c]];
+      }
+    }
+
   inline Group objGroupFromMesh(const Group& meshGroup, uint32_t components)
   {
     return Group(meshGroup.name(), meshGroup.begin() * components, 
@@ -69,77 +121,167 @@ namespace lap {
     }
 
 
-  inline void objFromMeshImp(const MeshPPtr mesh,
-      obj::ModelPtr& model)
-  {
-    Range<uint1> is = allocateRange<uint1>(model->_faceIndices, mesh->vertices().size());
-    objVertices<VertexP, float3>(mesh, 
-        bind(&obj::Model::addPosition, model.get(), _1),
-        position<VertexP>, 
-        bind(setRangeAttrib<uint1>, ref(is), 0, _1, _2));
-    adaptGroupsToObj<VertexP, uint1>(mesh, model);
-  }
+  //! How a vertex attribute maps onto an obj face-index slot. Attributes
+  //! obj can't hold (tangents, unused slots) take no slot and are dropped.
+  template <typename A>
+    struct ObjAttrib
+    {
+      enum { kSlots = 0 };
+      static void read(A&, const obj::Model&, const uint32_t*&) {}
+      static void count(const obj::Model&, uint32_t*&) {}
 
-  inline void objFromMeshImp(const MeshPNPtr mesh, 
-      obj::ModelPtr& model)
-  {
-    Range<uint2> is = allocateRange<uint2>(model->_faceIndices, mesh->vertices().size());
-    objVertices<VertexPN, float3>(mesh, 
-        bind(&obj::Model::addPosition, model.get(), _1),
-        position<VertexPN>, 
-        bind(setRangeAttrib<uint2>, ref(is), 0, _1, _2));
-
-    objVertices<VertexPN, float3>(mesh, 
-        bind(&obj::Model::addNormal, model.get(), _1),
-        normal<VertexPN>, 
-        bind(setRangeAttrib<uint2>, ref(is), 1, _1, _2));
-    adaptGroupsToObj<VertexPN, uint2>(mesh, model);
-  }
+      template <typename V, typename I>
+        static void write(const shared_ptr<Mesh<V> >&, obj::ModelPtr&, Range<I>&, uint32_t&) {}
 
-  inline void objFromMeshImp(const MeshPTPtr mesh, 
-      obj::ModelPtr& model)
-  {
-    Range<uint2> is = allocateRange<uint2>(model->_faceIndices, mesh->vertices().size());
-    objVertices<VertexPT, float3>(mesh, 
-        bind(&obj::Model::addPosition, model.get(), _1),
-        position<VertexPT>, 
-        bind(setRangeAttrib<uint2>, ref(is), 0, _1, _2));
-
-    objVertices<VertexPT, float2>(mesh, 
-        bind(&obj::Model::addUV, model.get(), _1),
-        uv<VertexPT>, 
-        bind(setRangeAttrib<uint2>, ref(is), 1, _1, _2));
-    adaptGroupsToObj<VertexPT, uint2>(mesh, model);
-  }
+      template <typename V, typename I>
+        static void writeIndexed(const Mesh<V>&, obj::Model&, Range<I>&, uint32_t&) {}
+    };
 
-  inline void objFromMeshImp(const MeshPTNPtr mesh, 
-      obj::ModelPtr& model)
-  {
-    Range<uint3> is = allocateRange<uint3>(model->_faceIndices, mesh->vertices().size());
-    objVertices<VertexPTN, float3>(mesh, 
-        bind(&obj::Model::addPosition, model.get(), _1),
-        position<VertexPTN>, 
-        bind(setRangeAttrib<uint3>, ref(is), 0, _1, _2));
-
-    objVertices<VertexPTN, float2>(mesh, 
-        bind(&obj::Model::addUV, model.get(), _1),
-        uv<VertexPTN>, 
-        bind(setRangeAttrib<uint3>, ref(is), 1, _1, _2));
-
-    objVertices<VertexPTN, float3>(mesh, 
-        bind(&obj::Model::addNormal, model.get(), _1),
-        normal<VertexPTN>, 
-        bind(setRangeAttrib<uint3>, ref(is), 2, _1, _2));
-    adaptGroupsToObj<VertexPTN, uint3>(mesh, model);
-  }
+  template <>
+    struct ObjAttrib<Position>
+    {
+      enum { kSlots = 1 };
+      static void read(Position& a, const obj::Model& obj, const uint32_t*& corner)
+      {
+        a.position = obj.positions()[*corner++];
+      }
+      static void count(const obj::Model& obj, uint32_t*& counts) 
+      { 
+        *counts++ = obj.positions().size(); 
+      }
+
+      template <typename V, typename I>
+        static void write(const shared_ptr<Mesh<V> >& mesh, obj::ModelPtr& model, 
+            Range<I>& is, uint32_t& slot)
+        {
+          objVertices<V, float3>(mesh, 
+              boost::lambda::bind(&obj::Model::addPosition, model.get(), _1),
+              position<V>, 
+              boost::lambda::bind(setRangeAttrib<I>, ref(is), slot++, _1, _2));
+        }
+
+      template <typename V, typename I>
+        static void writeIndexed(const Mesh<V>& mesh, obj::Model& model, 
+            Range<I>& is, uint32_t& slot)
+        {
+          objIndexedVertices<V, float3>(mesh, 
+              boost::lambda::bind(&obj::Model::addPosition, &model, _1), position<V>, is, slot++);
+        }
+    };
+
+  template <>
+    struct ObjAttrib<TexCoord>
+    {
+      enum { kSlots = 1 };
+      static void read(TexCoord& a, const obj::Model& obj, const uint32_t*& corner)
+      {
+        a.uv = obj.uvs()[*corner++];
+      }
+      static void count(const obj::Model& obj, uint32_t*& counts) 
+      { 
+        *counts++ = obj.uvs().size(); 
+      }
+
+      template <typename V, typename I>
+        static void write(const shared_ptr<Mesh<V> >& mesh, obj::ModelPtr& model, 
+            Range<I>& is, uint32_t& slot)
+        {
+          objVertices<V, float2>(mesh, 
+              boost::lambda::bind(&obj::Model::addUV, model.get(), _1),
+              uv<V>, 
+              boost::lambda::bind(setRangeAttrib<I>, ref(is), slot++, _1, _2));
+        }
+
+      template <typename V, typename I>
+        static void writeIndexed(const Mesh<V>& mesh, obj::Model& model, 
+            Range<I>& is, uint32_t& slot)
+        {
+          objIndexedVertices<V, float2>(mesh, 
+              boost::lambda::bind(&obj::Model::addUV, &model, _1), uv<V>, is, slot++);
+        }
+    };
+
+  template <>
+    struct ObjAttrib<Normal>
+    {
+      enum { kSlots = 1 };
+      static void read(Normal& a, const obj::Model& obj, const uint32_t*& corner)
+      {
+        a.normal = obj.normals()[*corner++];
+      }
+      static void count(const obj::Model& obj, uint32_t*& counts) 
+      { 
+        *counts++ = obj.normals().size(); 
+      }
+
+      template <typename V, typename I>
+        static void write(const shared_ptr<Mesh<V> >& mesh, obj::ModelPtr& model, 
+            Range<I>& is, uint32_t& slot)
+        {
+          objVertices<V, float3>(mesh, 
+              boost::lambda::bind(&obj::Model::addNormal, model.get(), _1),
+              normal<V>, 
+              boost::lambda::bind(setRangeAttrib<I>, ref(is), slot++, _1, _2));
+        }
+
+      template <typename V, typename I>
+        static void writeIndexed(const Mesh<V>& mesh, obj::Model& model, 
+            Range<I>& is, uint32_t& slot)
+        {
+          objIndexedVertices<V, float3>(mesh, 
+              boost::lambda::bind(&obj::Model::addNormal, &model, _1), normal<V>, is, slot++);
+        }
+    };
+
+  //! The obj face-index tuple of V, one slot per obj attribute in layout order.
+  template <typename V>
+    struct ObjCorner
+    {
+      enum 
+      { 
+        kSlots = ObjAttrib<typename V::Attrib0>::kSlots + ObjAttrib<typename V::Attrib1>::kSlots +
+          ObjAttrib<typename V::Attrib2>::kSlots + ObjAttrib<typename V::Attrib3>::kSlots
+      };
+      typedef vec<uint32_t, kSlots> type;
+    };
+
+  template <typename V>
+    void objFromMeshImp(const shared_ptr<Mesh<V> > mesh, obj::ModelPtr& model)
+    {
+      typedef typename ObjCorner<V>::type I;
+      Range<I> is = allocateRange<I>(model->_faceIndices, mesh->vertices().size());
+      uint32_t slot = 0;
+      ObjAttrib<typename V::Attrib0>::write(mesh, model, is, slot);
+      ObjAttrib<typename V::Attrib1>::write(mesh, model, is, slot);
+      ObjAttrib<typename V::Attrib2>::write(mesh, model, is, slot);
+      ObjAttrib<typename V::Attrib3>::write(mesh, model, is, slot);
+      adaptGroupsToObj<V, I>(mesh, model);
+    }
+
+  // Attributes are deduplicated over the vertices rather than the corners,
+  // so each is hashed once however many corners share its vertex.
+  template <typename V>
+    void objFromIndexedMeshImp(const shared_ptr<Mesh<V> > mesh, obj::ModelPtr& model)
+    {
+      typedef typename ObjCorner<V>::type I;
+      Range<I> is = allocateRange<I>(model->_faceIndices, mesh->indices().size());
+      uint32_t slot = 0;
+      ObjAttrib<typename V::Attrib0>::writeIndexed(*mesh, *model, is, slot);
+      ObjAttrib<typename V::Attrib1>::writeIndexed(*mesh, *model, is, slot);
+      ObjAttrib<typename V::Attrib2>::writeIndexed(*mesh, *model, is, slot);
+      ObjAttrib<typename V::Attrib3>::writeIndexed(*mesh, *model, is, slot);
+      adaptGroupsToObj<V, I>(mesh, model);
+    }
 
-  //! Make an obj-model from a Mesh.
+  //! Make an obj-model from a Mesh. Each attribute is deduplicated on its
+  //! own, so vertices that differ only in, say, normal share a position. 
+  //! An indexed mesh's attributes are read per vertex, not per corner.
   template <typename V>
     obj::ModelPtr objFromMesh(const shared_ptr<Mesh<V> > mesh)
     {
-      assert(mesh->_indices.empty());
       obj::ModelPtr model(new obj::Model());
-      objFromMeshImp(mesh, model);
+      if (mesh->_indices.empty()) objFromMeshImp(mesh, model);
+      else objFromIndexedMeshImp(mesh, model);
       model->_materials.insert(mesh->materials().begin(), mesh->materials().end());
       return model;
     }
@@ -0,0 +1,696 @@
+#include "ObjIndex.h"
+#include "CompressedStream.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+namespace lap {
+namespace obj {
+
+  namespace
+  {
+    const uint32_t kInherit = ObjFaceRun::kNoGroup - 1; // Group set before the chunk.
+    const uint32_t kBucketSize = 1 << kObjBucketBits;
+    const uint64_t kRunBytes = 4 << 20;
+    const uint64_t kChunkBytes = 16 << 20;
+
+    bool mapFile(const std::string& filename, boost::iostreams::mapped_file_source& file)
+    {
+      if (compressionForPath(filename) != kUncompressed) return false;
+      try
+      {
+        file.open(filename);
+      }
+      catch (const std::exception&)
+      {
+        return false;
+      }
+      return file.is_open();
+    }
+
+    // The part of an OBJ file between two line starts, with group ids local
+    // to it or kInherit.
+    struct ChunkIndex
+    {
+      uint32_t counts[kObjAttributeMax];
+      std::vector<ObjAttributeBlock> blocks[kObjAttributeMax]; // First indices local.
+      std::vector<std::string> geometryNames;
+      std::vector<std::string> materialNames;
+      std::vector<ObjFaceRun> runs;
+      uint32_t geometryGroup; // Current at the chunk's end.
+      uint32_t materialGroup;
+      std::string mtllib;
+    };
+
+    inline bool tokenIs(const char* token, uint32_t length, const char* keyword)
+    {
+      return strncmp(token, keyword, length) == 0 && keyword[length] == '\0';
+    }
+
+    inline uint32_t parseIndex(const char*& p, const char* end)
+    {
+      uint32_t i = 0;
+      while (p < end && *p >= '0' && *p <= '9') i = i * 10 + (*p++ - '0');
+      return i;
+    }
+
+    // Triangles a face line fans into, recording the buckets its corners
+    // use. Corners are read v/vt/vn by position, as ObjTranslator does.
+    uint32_t scanFace(const char* p, const char* eol, ObjFaceRun& run)
+    {
+      uint32_t corners = 0;
+      while (p < eol)
+      {
+        while (p < eol && *p == ' ') ++p;
+        if (p == eol) break;
+        bool found = false;
+        for (int k = 0; k < kObjAttributeMax; ++k)
+        {
+          const uint32_t i = parseIndex(p, eol);
+          if (i > 0)
+          {
+            std::vector<uint32_t>& buckets = run.buckets[k];
+            const uint32_t bucket = (i - 1) >> kObjBucketBits;
+            if (buckets.empty() || buckets.back() != bucket) buckets.push_back(bucket);
+            found = true;
+          }
+          if (p == eol || *p != '/') break;
+          ++p;
+        }
+        if (found) ++corners;
+        while (p < eol && *p != ' ') ++p;
+      }
+      return corners < 3 ? 0 : corners - 2;
+    }
+
+    uint32_t nameId(std::map<std::string, uint32_t>& ids, std::vector<std::string>& names,
+        const std::string& name)
+    {
+      std::pair<std::map<std::string, uint32_t>::iterator, bool> pib =
+        ids.insert(std::make_pair(name, names.size()));
+      if (pib.second) names.push_back(name);
+      return pib.first->second;
+    }
+
+    void closeRun(ChunkIndex& chunk, bool& open)
+    {
+      if (!open) return;
+      ObjFaceRun& run = chunk.runs.back();
+      for (int k = 0; k < kObjAttributeMax; ++k)
+      {
+        std::sort(run.buckets[k].begin(), run.buckets[k].end());
+        run.buckets[k].erase(std::unique(run.buckets[k].begin(), run.buckets[k].end()),
+            run.buckets[k].end());
+      }
+      open = false;
+    }
+
+    // Split lines as ObjTranslator::parseLine does: the token ends at the
+    // first space and the value is the rest of the line after it.
+    void scanChunk(const char* data, uint64_t begin, uint64_t end, ChunkIndex& chunk)
+    {
+      std::map<std::string, uint32_t> geometryIds;
+      std::map<std::string, uint32_t> materialIds;
+      for (int k = 0; k < kObjAttributeMax; ++k) chunk.counts[k] = 0;
+      chunk.geometryGroup = kInherit;
+      chunk.materialGroup = kInherit;
+      bool open = false;
+
+      for (uint64_t line = begin; line < end; )
+      {
+        const char* p = data + line;
+        const char* eol = std::find(p, data + end, '\n');
+        const uint64_t next = eol - data + (eol < data + end ? 1 : 0);
+        while (p < eol && *p == ' ') ++p;
+        const char* token = p;
+        while (p < eol && *p != ' ') ++p;
+        const uint32_t length = p - token;
+        const char* value = p < eol ? p + 1 : eol;
+
+        int attribute = -1;
+        if (tokenIs(token, length, "v")) attribute = kObjPosition;
+        else if (tokenIs(token, length, "vt")) attribute = kObjUV;
+        else if (tokenIs(token, length, "vn")) attribute = kObjNormal;
+
+        if (attribute >= 0)
+        {
+          std::vector<ObjAttributeBlock>& blocks = chunk.blocks[attribute];
+          if (blocks.empty() || blocks.back().end != line || blocks.back().count == kBucketSize)
+          {
+            const ObjAttributeBlock block = { chunk.counts[attribute], 0, line, line };
+            blocks.push_back(block);
+          }
+          ++blocks.back().count;
+          blocks.back().end = next;
+          ++chunk.counts[attribute];
+        }
+        else if (tokenIs(token, length, "f"))
+        {
+          if (open && chunk.runs.back().end - chunk.runs.back().begin >= kRunBytes)
+          {
+            closeRun(chunk, open);
+          }
+          if (!open)
+          {
+            ObjFaceRun run;
+            run.begin = line;
+            run.triangles = 0;
+            run.geometryGroup = chunk.geometryGroup;
+            run.materialGroup = chunk.materialGroup;
+            chunk.runs.push_back(run);
+            open = true;
+          }
+          ObjFaceRun& run = chunk.runs.back();
+          run.triangles += scanFace(value, eol, run);
+          run.end = next;
+        }
+        else if (tokenIs(token, length, "g") && value < eol)
+        {
+          const std::string name = normalizeGroupName(std::string(value, eol));
+          if (name != "default")
+          {
+            closeRun(chunk, open);
+            chunk.geometryGroup = nameId(geometryIds, chunk.geometryNames, name);
+          }
+        }
+        else if (tokenIs(token, length, "usemtl") && value < eol)
+        {
+          closeRun(chunk, open);
+          chunk.materialGroup = nameId(materialIds, chunk.materialNames,
+              normalizeMaterialName(std::string(value, eol)));
+        }
+        else if (tokenIs(token, length, "mtllib") && value < eol)
+        {
+          chunk.mtllib.assign(value, eol);
+        }
+        line = next;
+      }
+      closeRun(chunk, open);
+    }
+
+    struct ScanChunks
+    {
+      const char* data;
+      const uint64_t* bounds;
+      ChunkIndex* chunks;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t c = begin; c < end; ++c) scanChunk(data, bounds[c], bounds[c + 1], chunks[c]);
+      }
+    };
+
+    uint32_t globalGroup(uint32_t local, const std::vector<uint32_t>& ids, uint32_t current)
+    {
+      if (local == kInherit) return current;
+      return local == ObjFaceRun::kNoGroup ? local : ids[local];
+    }
+
+    // Append chunk to index, resolving its local and inherited groups.
+    void mergeChunk(ChunkIndex& chunk, ObjIndex& index,
+        std::map<std::string, uint32_t>& geometryIds,
+        std::map<std::string, uint32_t>& materialIds,
+        uint32_t& geometry, uint32_t& material)
+    {
+      for (int k = 0; k < kObjAttributeMax; ++k)
+      {
+        for (std::vector<ObjAttributeBlock>::iterator b = chunk.blocks[k].begin();
+            b != chunk.blocks[k].end(); ++b)
+        {
+          b->first += index.counts[k];
+          index.blocks[k].push_back(*b);
+        }
+        index.counts[k] += chunk.counts[k];
+      }
+
+      std::vector<uint32_t> geometryMap;
+      std::vector<uint32_t> materialMap;
+      for (uint32_t i = 0; i < chunk.geometryNames.size(); ++i)
+      {
+        geometryMap.push_back(nameId(geometryIds, index.geometryNames, chunk.geometryNames[i]));
+      }
+      for (uint32_t i = 0; i < chunk.materialNames.size(); ++i)
+      {
+        materialMap.push_back(nameId(materialIds, index.materialNames, chunk.materialNames[i]));
+      }
+      for (std::vector<ObjFaceRun>::iterator r = chunk.runs.begin(); r != chunk.runs.end(); ++r)
+      {
+        r->geometryGroup = globalGroup(r->geometryGroup, geometryMap, geometry);
+        r->materialGroup = globalGroup(r->materialGroup, materialMap, material);
+        index.runs.push_back(ObjFaceRun());
+        std::swap(index.runs.back(), *r);
+      }
+      geometry = globalGroup(chunk.geometryGroup, geometryMap, geometry);
+      material = globalGroup(chunk.materialGroup, materialMap, material);
+      if (!chunk.mtllib.empty()) index.mtllib = chunk.mtllib;
+    }
+  }
+
+  bool buildObjIndex(const std::string& filename, ObjIndex& index)
+  {
+    boost::iostreams::mapped_file_source file;
+    if (!mapFile(filename, file)) return false;
+    const char* data = file.data();
+    const uint64_t size = file.size();
+
+    // Chunks start on line starts so each is scanned independently.
+    const uint64_t chunkCount = std::max<uint64_t>(1,
+        std::min<uint64_t>(workerCount() * 4, size / kChunkBytes));
+    std::vector<uint64_t> bounds(1, 0);
+    for (uint64_t c = 1; c < chunkCount; ++c)
+    {
+      uint64_t b = std::max(size * c / chunkCount, bounds.back());
+      const char* eol = std::find(data + b, data + size, '\n');
+      b = std::min<uint64_t>(eol - data + 1, size);
+      bounds.push_back(b);
+    }
+    bounds.push_back(size);
+
+    std::vector<ChunkIndex> chunks(chunkCount);
+    ScanChunks scan = { data, &bounds[0], &chunks[0] };
+    parallelFor(chunkCount, scan, 1);
+
+    index = ObjIndex();
+    index.fileSize = size;
+    boost::system::error_code ec;
+    index.modified = boost::filesystem::last_write_time(filename, ec);
+    for (int k = 0; k < kObjAttributeMax; ++k) index.counts[k] = 0;
+    std::map<std::string, uint32_t> geometryIds;
+    std::map<std::string, uint32_t> materialIds;
+    uint32_t geometry = ObjFaceRun::kNoGroup;
+    uint32_t material = ObjFaceRun::kNoGroup;
+    for (std::vector<ChunkIndex>::iterator c = chunks.begin(); c != chunks.end(); ++c)
+    {
+      mergeChunk(*c, index, geometryIds, materialIds, geometry, material);
+    }
+    return true;
+  }
+
+  std::string objIndexFile(const std::string& filename)
+  {
+    return filename + ".lapidx";
+  }
+
+  namespace
+  {
+    void writeNames(std::ostream& os, const char* label, const std::vector<std::string>& names)
+    {
+      os << label << ' ' << names.size() << '\n';
+      for (std::vector<std::string>::const_iterator n = names.begin(); n != names.end(); ++n)
+      {
+        os << *n << '\n';
+      }
+    }
+
+    bool readNames(std::istream& is, const char* label, uint64_t limit,
+        std::vector<std::string>& names)
+    {
+      std::string token;
+      uint32_t count = 0;
+      if (!(is >> token >> count) || token != label || count > limit) return false;
+      is.ignore(1);
+      names.resize(count);
+      for (uint32_t i = 0; i < count; ++i) std::getline(is, names[i]);
+      return is;
+    }
+
+    uint32_t bucketCount(uint32_t count)
+    {
+      return (uint32_t)(((uint64_t)count + kBucketSize - 1) >> kObjBucketBits);
+    }
+
+    bool validRange(uint64_t begin, uint64_t end, uint64_t size)
+    {
+      return begin <= end && end <= size;
+    }
+
+    bool validGroup(uint32_t group, const std::vector<std::string>& names)
+    {
+      return group == ObjFaceRun::kNoGroup || group < names.size();
+    }
+
+    // Every index and byte range the importer follows stays in bounds.
+    bool validObjIndex(const ObjIndex& index)
+    {
+      for (int k = 0; k < kObjAttributeMax; ++k)
+      {
+        for (std::vector<ObjAttributeBlock>::const_iterator b = index.blocks[k].begin();
+            b != index.blocks[k].end(); ++b)
+        {
+          if (!b->count || b->count > index.counts[k] || b->first > index.counts[k] - b->count ||
+              !validRange(b->begin, b->end, index.fileSize))
+          {
+            return false;
+          }
+        }
+      }
+      for (std::vector<ObjFaceRun>::const_iterator r = index.runs.begin(); r != index.runs.end(); ++r)
+      {
+        if (!validRange(r->begin, r->end, index.fileSize) ||
+            !validGroup(r->geometryGroup, index.geometryNames) ||
+            !validGroup(r->materialGroup, index.materialNames))
+        {
+          return false;
+        }
+        for (int k = 0; k < kObjAttributeMax; ++k)
+        {
+          const uint32_t buckets = bucketCount(index.counts[k]);
+          for (uint32_t i = 0; i < r->buckets[k].size(); ++i)
+          {
+            if (r->buckets[k][i] >= buckets) return false;
+          }
+        }
+      }
+      return true;
+    }
+  }
+
+  // A text file of sections, each a label, a count and that many lines.
+  bool writeObjIndex(const std::string& filename, const ObjIndex& index)
+  {
+    std::ofstream os(filename.c_str());
+    if (!os) return false;
+    os << "lapidx 1\n";
+    os << "source " << index.fileSize << ' ' << (int64_t)index.modified << '\n';
+    os << "mtllib " << index.mtllib << '\n';
+    for (int k = 0; k < kObjAttributeMax; ++k)
+    {
+      os << "blocks " << index.counts[k] << ' ' << index.blocks[k].size() << '\n';
+      for (std::vector<ObjAttributeBlock>::const_iterator b = index.blocks[k].begin();
+          b != index.blocks[k].end(); ++b)
+      {
+        os << b->first << ' ' << b->count << ' ' << b->begin << ' ' << b->end << '\n';
+      }
+    }
+    writeNames(os, "geometry", index.geometryNames);
+    writeNames(os, "material", index.materialNames);
+    os << "runs " << index.runs.size() << '\n';
+    for (std::vector<ObjFaceRun>::const_iterator r = index.runs.begin(); r != index.runs.end(); ++r)
+    {
+      os << r->begin << ' ' << r->end << ' ' << r->triangles << ' ' <<
+        r->geometryGroup << ' ' << r->materialGroup;
+      for (int k = 0; k < kObjAttributeMax; ++k)
+      {
+        os << ' ' << r->buckets[k].size();
+        for (uint32_t i = 0; i < r->buckets[k].size(); ++i) os << ' ' << r->buckets[k][i];
+      }
+      os << '\n';
+    }
+    return os;
+  }
+
+  bool readObjIndex(const std::string& filename, ObjIndex& index)
+  {
+    std::ifstream is(filename.c_str());
+    std::string token;
+    uint32_t version = 0;
+    if (!(is >> token >> version) || token != "lapidx" || version != 1) return false;
+
+    index = ObjIndex();
+    int64_t modified = 0;
+    if (!(is >> token >> index.fileSize >> modified) || token != "source") return false;
+    index.modified = modified;
+    if (!(is >> token) || token != "mtllib") return false;
+    is.ignore(1);
+    std::getline(is, index.mtllib);
+    for (int k = 0; k < kObjAttributeMax; ++k)
+    {
+      uint32_t count = 0;
+      if (!(is >> token >> index.counts[k] >> count) || token != "blocks" ||
+          count > index.fileSize)
+      {
+        return false;
+      }
+      index.blocks[k].resize(count);
+      for (uint32_t i = 0; i < count; ++i)
+      {
+        ObjAttributeBlock& b = index.blocks[k][i];
+        is >> b.first >> b.count >> b.begin >> b.end;
+      }
+    }
+    if (!readNames(is, "geometry", index.fileSize, index.geometryNames) ||
+        !readNames(is, "material", index.fileSize, index.materialNames))
+    {
+      return false;
+    }
+    uint32_t runs = 0;
+    if (!(is >> token >> runs) || token != "runs" || runs > index.fileSize) return false;
+    index.runs.resize(runs);
+    for (uint32_t i = 0; i < runs && is; ++i)
+    {
+      ObjFaceRun& r = index.runs[i];
+      is >> r.begin >> r.end >> r.triangles >> r.geometryGroup >> r.materialGroup;
+      for (int k = 0; k < kObjAttributeMax; ++k)
+      {
+        uint32_t count = 0;
+        if (!(is >> count) || count > bucketCount(index.counts[k])) return false;
+        r.buckets[k].resize(count);
+        for (uint32_t j = 0; j < count; ++j) is >> r.buckets[k][j];
+      }
+    }
+    return is && validObjIndex(index);
+  }
+
+  bool loadObjIndex(const std::string& filename, ObjIndex& index)
+  {
+    boost::system::error_code sizeError;
+    boost::system::error_code timeError;
+    const uint64_t size = boost::filesystem::file_size(filename, sizeError);
+    const std::time_t modified = boost::filesystem::last_write_time(filename, timeError);
+    const std::string sidecar = objIndexFile(filename);
+    if (!sizeError && !timeError && readObjIndex(sidecar, index) &&
+        index.fileSize == size && index.modified == modified)
+    {
+      return true;
+    }
+    if (!buildObjIndex(filename, index)) return false;
+    if (!writeObjIndex(sidecar, index)) std::cerr << "error writing " << sidecar << std::endl;
+    return true;
+  }
+
+  namespace
+  {
+    const uint32_t kUnloaded = ~0u;
+
+    // Whole lines copied out of the mapping and parsed as an import would.
+    ModelPtr parseRange(const char* data, uint64_t begin, uint64_t end)
+    {
+      std::vector<char> text(data + begin, data + end);
+      if (text.empty() || text.back() != '\n') text.push_back('\n');
+      return ObjTranslator().parseBlock(&text[0], &text[0] + text.size());
+    }
+
+    struct LoadGroups
+    {
+      const char* data;
+      const ObjIndex* index;
+      const std::vector<std::pair<int, uint32_t> >* blocks; // Attribute and block.
+      const std::vector<uint32_t>* runs;
+      const std::vector<uint32_t>* ranks; // Per attribute, each bucket's rank if loaded.
+      float3* positions;
+      float2* uvs;
+      float3* normals;
+      std::vector<uint32_t>* faces; // Per run.
+      char* invalid; // Per run, set if its faces don't fit the attributes.
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t w = begin; w < end; ++w)
+        {
+          if (w < blocks->size()) loadBlock((*blocks)[w].first, (*blocks)[w].second);
+          else loadRun(w - blocks->size());
+        }
+      }
+
+      // Loaded buckets are packed in order and all but the last are full.
+      uint32_t local(int attribute, uint32_t i)const
+      {
+        const std::vector<uint32_t>& r = ranks[attribute];
+        const uint32_t bucket = i >> kObjBucketBits;
+        if (i >= index->counts[attribute] || r[bucket] == kUnloaded) return kUnloaded;
+        return r[bucket] << kObjBucketBits | (i & (kBucketSize - 1));
+      }
+
+      template <typename T>
+        void place(int attribute, uint32_t first, const std::vector<T>& src, T* dst)const
+        {
+          for (uint32_t i = 0; i < src.size(); ++i)
+          {
+            const uint32_t l = local(attribute, first + i);
+            if (l != kUnloaded) dst[l] = src[i];
+          }
+        }
+
+      void loadBlock(int attribute, uint32_t b)const
+      {
+        const ObjAttributeBlock& block = index->blocks[attribute][b];
+        ModelPtr parsed = parseRange(data, block.begin, block.end);
+        if (attribute == kObjPosition) place(attribute, block.first, parsed->positions(), positions);
+        else if (attribute == kObjUV) place(attribute, block.first, parsed->uvs(), uvs);
+        else place(attribute, block.first, parsed->normals(), normals);
+      }
+
+      void loadRun(uint32_t r)const
+      {
+        const ObjFaceRun& run = index->runs[(*runs)[r]];
+        ModelPtr parsed = parseRange(data, run.begin, run.end);
+        std::vector<uint32_t>& out = faces[r];
+        out.swap(parsed->_faceIndices);
+
+        // Corners must hold a v, vt and vn index for each attribute the file
+        // has, the layout the model's vertexFormat() implies. The parser 
+        // packs whatever a corner gives, so a corner missing one shows as
+        // a short run.
+        const bool hasUVs = index->counts[kObjUV] > 0;
+        const uint32_t components = 1 + hasUVs + (index->counts[kObjNormal] > 0);
+        if (out.size() != (uint64_t)run.triangles * 3 * components)
+        {
+          invalid[r] = true;
+          return;
+        }
+        for (uint32_t i = 0; i < out.size(); ++i)
+        {
+          const uint32_t k = i % components;
+          const int attribute = k == 0 ? kObjPosition : (k == 1 && hasUVs ? kObjUV : kObjNormal);
+          out[i] = local(attribute, out[i]);
+          if (out[i] == kUnloaded)
+          {
+            // Past the file's attributes; a loaded bucket covers the rest.
+            invalid[r] = true;
+            return;
+          }
+        }
+      }
+    };
+
+    void extendGroup(std::vector<Group>& groups, const std::string& name,
+        uint32_t begin, uint32_t count)
+    {
+      if (!groups.empty() && groups.back().name() == name && groups.back().end() == begin)
+      {
+        groups.back().setCount(groups.back().count() + count);
+      }
+      else
+      {
+        groups.push_back(Group(name, begin, count));
+      }
+    }
+
+    std::vector<char> selectedNames(const std::vector<std::string>& names,
+        const std::vector<std::string>& selected)
+    {
+      const std::set<std::string> wanted(selected.begin(), selected.end());
+      std::vector<char> flags(names.size());
+      for (uint32_t i = 0; i < names.size(); ++i) flags[i] = wanted.count(names[i]) > 0;
+      return flags;
+    }
+  }
+
+  ModelPtr importObjGroups(const std::string& filename, const ObjIndex& index,
+      const std::vector<std::string>& geometryGroups,
+      const std::vector<std::string>& materialGroups)
+  {
+    boost::iostreams::mapped_file_source file;
+    if (!mapFile(filename, file) || file.size() != index.fileSize) return ModelPtr();
+
+    const std::vector<char> geometry = selectedNames(index.geometryNames, geometryGroups);
+    const std::vector<char> material = selectedNames(index.materialNames, materialGroups);
+    std::vector<uint32_t> runs;
+    std::vector<uint32_t> buckets[kObjAttributeMax];
+    for (uint32_t r = 0; r < index.runs.size(); ++r)
+    {
+      const ObjFaceRun& run = index.runs[r];
+      if (!(run.geometryGroup != ObjFaceRun::kNoGroup && geometry[run.geometryGroup]) &&
+          !(run.materialGroup != ObjFaceRun::kNoGroup && material[run.materialGroup]))
+      {
+        continue;
+      }
+      runs.push_back(r);
+      for (int k = 0; k < kObjAttributeMax; ++k)
+      {
+        buckets[k].insert(buckets[k].end(), run.buckets[k].begin(), run.buckets[k].end());
+      }
+    }
+
+    std::vector<uint32_t> ranks[kObjAttributeMax];
+    std::vector<std::pair<int, uint32_t> > blocks;
+    uint32_t loaded[kObjAttributeMax];
+    for (int k = 0; k < kObjAttributeMax; ++k)
+    {
+      std::sort(buckets[k].begin(), buckets[k].end());
+      buckets[k].erase(std::unique(buckets[k].begin(), buckets[k].end()), buckets[k].end());
+      ranks[k].assign((index.counts[k] + kBucketSize - 1) >> kObjBucketBits, kUnloaded);
+      loaded[k] = 0;
+      for (uint32_t i = 0; i < buckets[k].size(); ++i)
+      {
+        const uint32_t b = buckets[k][i];
+        if (b >= ranks[k].size()) break;
+        ranks[k][b] = i;
+        loaded[k] = i * kBucketSize + std::min(kBucketSize, index.counts[k] - b * kBucketSize);
+      }
+      for (uint32_t b = 0; b < index.blocks[k].size(); ++b)
+      {
+        const ObjAttributeBlock& block = index.blocks[k][b];
+        const uint32_t last = (block.first + block.count - 1) >> kObjBucketBits;
+        for (uint32_t bucket = block.first >> kObjBucketBits; bucket <= last; ++bucket)
+        {
+          if (ranks[k][bucket] == kUnloaded) continue;
+          blocks.push_back(std::make_pair(k, b));
+          break;
+        }
+      }
+    }
+
+    std::vector<float3> positions(loaded[kObjPosition]);
+    std::vector<float2> uvs(loaded[kObjUV]);
+    std::vector<float3> normals(loaded[kObjNormal]);
+    std::vector<std::vector<uint32_t> > faces(runs.size());
+    std::vector<char> invalid(runs.size(), false);
+    LoadGroups load = { file.data(), &index, &blocks, &runs, ranks,
+      positions.empty() ? NULL : &positions[0], uvs.empty() ? NULL : &uvs[0],
+      normals.empty() ? NULL : &normals[0], faces.empty() ? NULL : &faces[0],
+      invalid.empty() ? NULL : &invalid[0] };
+    parallelFor(blocks.size() + runs.size(), load, 1);
+    if (std::find(invalid.begin(), invalid.end(), true) != invalid.end())
+    {
+      std::cerr << "error importing " << filename << 
+        ": a face refers to a missing attribute or lacks one the file has" << std::endl;
+      return ModelPtr();
+    }
+
+    ModelPtr model(new Model());
+    for (std::vector<float3>::const_iterator p = positions.begin(); p != positions.end(); ++p)
+    {
+      model->addPosition(*p);
+    }
+    for (std::vector<float2>::const_iterator t = uvs.begin(); t != uvs.end(); ++t) model->addUV(*t);
+    for (std::vector<float3>::const_iterator n = normals.begin(); n != normals.end(); ++n)
+    {
+      model->addNormal(*n);
+    }
+    for (uint32_t i = 0; i < runs.size(); ++i)
+    {
+      const ObjFaceRun& run = index.runs[runs[i]];
+      const uint32_t begin = model->_faceIndices.size();
+      model->_faceIndices.insert(model->_faceIndices.end(), faces[i].begin(), faces[i].end());
+      if (run.geometryGroup != ObjFaceRun::kNoGroup)
+      {
+        extendGroup(model->_geometryGroups, index.geometryNames[run.geometryGroup],
+            begin, faces[i].size());
+      }
+      if (run.materialGroup != ObjFaceRun::kNoGroup)
+      {
+        extendGroup(model->_materialGroups, index.materialNames[run.materialGroup],
+            begin, faces[i].size());
+      }
+    }
+    if (!resolveMaterials(*model, filename, index.mtllib)) return ModelPtr();
+    return model;
+  }
+}
+}
@@ -0,0 +1,95 @@
+#ifndef LAP_OBJ_INDEX_H
+#define LAP_OBJ_INDEX_H
+
+#include <ctime>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ObjModel.h"
+
+namespace lap {
+namespace obj {
+
+  enum ObjAttribute
+  {
+    kObjPosition,
+    kObjUV,
+    kObjNormal,
+    kObjAttributeMax
+  };
+
+  //! Attributes are loaded in buckets of 1 << kObjBucketBits consecutive
+  //! indices.
+  const uint32_t kObjBucketBits = 12;
+
+  //! Byte range of consecutive lines of one attribute and the file-global
+  //! index of the first.
+  struct ObjAttributeBlock
+  {
+    uint32_t first;
+    uint32_t count;
+    uint64_t begin;
+    uint64_t end;
+  };
+
+  //! Byte range of face lines sharing one geometry and material group. It
+  //! may span other lines but no g or usemtl.
+  struct ObjFaceRun
+  {
+    static const uint32_t kNoGroup = ~0u;
+
+    uint64_t begin;
+    uint64_t end;
+    uint32_t triangles;
+    uint32_t geometryGroup; // Index into ObjIndex::geometryNames or kNoGroup.
+    uint32_t materialGroup; // Index into ObjIndex::materialNames or kNoGroup.
+    std::vector<uint32_t> buckets[kObjAttributeMax]; // Sorted buckets its corners use.
+  };
+
+  //! Where an OBJ file's records are, enough to load some of its groups
+  //! without parsing the rest. Stale once the file's size or modification
+  //! time changes.
+  struct ObjIndex
+  {
+    uint64_t fileSize;
+    std::time_t modified;
+    std::string mtllib;
+    uint32_t counts[kObjAttributeMax];
+    std::vector<ObjAttributeBlock> blocks[kObjAttributeMax];
+    std::vector<std::string> geometryNames;
+    std::vector<std::string> materialNames;
+    std::vector<ObjFaceRun> runs; // In file order.
+  };
+
+  //! Index filename by scanning its mapped bytes in parallel chunks. False
+  //! if it can't be mapped; compressed files aren't supported.
+  bool buildObjIndex(const std::string& filename, ObjIndex& index);
+
+  //! Sidecar index file of an OBJ file, <filename>.lapidx.
+  std::string objIndexFile(const std::string& filename);
+
+  bool writeObjIndex(const std::string& filename, const ObjIndex& index);
+
+  //! False if filename can't be parsed or any group, bucket or byte range
+  //! in it is out of bounds of its name tables, attribute counts or 
+  //! source size.
+  bool readObjIndex(const std::string& filename, ObjIndex& index);
+
+  //! filename's index from its sidecar, rebuilt and rewritten if the
+  //! sidecar is missing, stale or corrupt. False if the OBJ can't be indexed.
+  bool loadObjIndex(const std::string& filename, ObjIndex& index);
+
+  //! Import the faces of the named geometry groups and of the named
+  //! material groups, parsing only their face runs and the attribute
+  //! buckets those use, in parallel from the mapped file. Indices are
+  //! renumbered into the loaded attributes, so unused ones are dropped a
+  //! bucket at a time. Null if the file doesn't match index, if a face 
+  //! refers past the file's attributes or if a corner lacks one of the 
+  //! attributes the file has.
+  ModelPtr importObjGroups(const std::string& filename, const ObjIndex& index,
+      const std::vector<std::string>& geometryGroups,
+      const std::vector<std::string>& materialGroups = std::vector<std::string>());
+}
+}
+
+#endif
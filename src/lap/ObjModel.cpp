@@ -1,9 +1,13 @@
 #include "ObjModel.h"
+#include "ObjPipeline.h"
+#include "CompressedStream.h"
+#include "Parallel.h"
 #include <sstream>
 #include <fstream>
 #include <cassert>
 #include <iostream>
 #include <iterator>
+#include <map>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem/operations.hpp> // includes boost/filesystem/path.hpp
 #include <boost/filesystem/fstream.hpp>    // ditto
@@ -11,6 +15,7 @@
 #include <boost/lambda/lambda.hpp>
 #include <boost/lambda/bind.hpp>
 #include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 
 using namespace boost::lambda;
 using namespace boost;
@@ -31,87 +36,213 @@ namespace obj {
     return replace_all_copy(group, " ", "_");
   }
 
-  void MtlTranslator::parseLine(char* line)
+  void Model::append(const Model& next)
   {
-    char* context;
-    char* token = strtok_r(line, " ", &context);
-    if (token == NULL) return;
-
-    if (token[0] == '#') return;
-
-    if (CStringEqual(token, "newmtl"))
+    const uint32_t base = _faceIndices.size();
+    const uint32_t count = next._faceIndices.size();
+    _faceIndices.insert(_faceIndices.end(), next._faceIndices.begin(), 
+        next._faceIndices.end());
+    _positions.insert(_positions.end(), next._positions.begin(), next._positions.end());
+    _uvs.insert(_uvs.end(), next._uvs.begin(), next._uvs.end());
+    _normals.insert(_normals.end(), next._normals.begin(), next._normals.end());
+    _materials.insert(next._materials.begin(), next._materials.end());
+
+    const std::vector<Group>* theirs[] = { &next._geometryGroups, &next._materialGroups };
+    std::vector<Group>* ours[] = { &_geometryGroups, &_materialGroups };
+    for (int i = 0; i < 2; ++i)
     {
-      _working = normalizeMaterialName(strtok_r(NULL,"\n",&context));
-      (*_materials)[_working] = Material(_working);
-    }
-    else if (CStringEqual(token, "illum"))
-    {
-      //      std::cerr << "illum unsupported - skipping" << std::endl;
+      const uint32_t leading = theirs[i]->empty() ? count : theirs[i]->front().begin();
+      if (!ours[i]->empty()) ours[i]->back().setCount(ours[i]->back().count() + leading);
+      for (std::vector<Group>::const_iterator g = theirs[i]->begin(); 
+          g != theirs[i]->end(); ++g)
+      {
+        ours[i]->push_back(Group(g->name(), base + g->begin(), g->count()));
+      }
     }
-    else if (CStringEqual(token, "Kd"))
+  }
+
+  namespace
+  {
+    inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    inline const char* skipBlanks(const char* p, const char* end)
     {
-      working().Kd = parseVec<3>(context);
+      while (p < end && isBlank(*p)) ++p;
+      return p;
     }
-    else if (CStringEqual(token, "Ka"))
+
+    // The rest of the line without surrounding blanks.
+    inline std::string lineValue(const char* p, const char* end)
     {
-      working().Ka = parseVec<3>(context);
+      p = skipBlanks(p, end);
+      while (end > p && isBlank(end[-1])) --end;
+      return std::string(p, end);
     }
-    else if (CStringEqual(token, "Tf"))
+
+    // Floats on the line, missing ones left at zero. The text must be 
+    // terminated after end so strtof can't overrun.
+    template <int N>
+      vec<float, N> lineVec(const char* p, const char* end)
+      {
+        vec<float, N> v;
+        for (int i = 0; i < N && p < end; ++i)
+        {
+          char* next;
+          const float f = strtof(p, &next);
+          if (next == p || next > end) break;
+          v[i] = f;
+          p = next;
+        }
+        return v;
+      }
+
+    inline bool tokenIs(const char* token, uint32_t length, const char* keyword)
     {
-      working().Tf = parseVec<3>(context);
+      return strncmp(token, keyword, length) == 0 && keyword[length] == '\0';
     }
-    else if (CStringEqual(token, "Ni"))
+  }
+
+  void MtlTranslator::parseLine(const char* line, const char* end)
+  {
+    const char* token = skipBlanks(line, end);
+    const char* value = token;
+    while (value < end && !isBlank(*value)) ++value;
+    const uint32_t length = value - token;
+    if (length == 0 || token[0] == '#') return;
+
+    if (tokenIs(token, length, "newmtl"))
     {
-      working().Ni = strtof(strtok_r(NULL, "\n", &context), NULL);
+      _working = normalizeMaterialName(lineValue(value, end));
+      (*_materials)[_working] = Material(_working);
+      return;
     }
-    else if (CStringEqual(token, "Ns"))
+    if (_materials->find(_working) == _materials->end()) return;
+
+    if (tokenIs(token, length, "Kd")) working().Kd = lineVec<3>(value, end);
+    else if (tokenIs(token, length, "Ka")) working().Ka = lineVec<3>(value, end);
+    else if (tokenIs(token, length, "Ks")) working().Ks = lineVec<3>(value, end);
+    else if (tokenIs(token, length, "Tf")) working().Tf = lineVec<3>(value, end);
+    else if (tokenIs(token, length, "Ni")) working().Ni = lineVec<1>(value, end)[0];
+    else if (tokenIs(token, length, "Ns")) working().Ns = lineVec<1>(value, end)[0];
+    else if (tokenIs(token, length, "d")) working().d = lineVec<1>(value, end)[0];
+    else if (tokenIs(token, length, "Tr")) working().d = 1.0f - lineVec<1>(value, end)[0];
+    else if (tokenIs(token, length, "map_Ka")) working().map_Ka = lineValue(value, end);
+    else if (tokenIs(token, length, "map_Kd")) working().map_Kd = lineValue(value, end);
+    else if (tokenIs(token, length, "map_Ks")) working().map_Ks = lineValue(value, end);
+    else if (tokenIs(token, length, "illum")) {} // unsupported
+    else _unrecognised.insert(std::string(token, length));
+  }
+
+  bool MtlTranslator::importFile(const std::string& filename, MaterialMap* found)
+  {
+    IStreamPtr in = openInput(filename);
+    if (!in || !found) return false;
+    _materials = found;
+    _working.clear();
+    _unrecognised.clear();
+
+    std::ostringstream buffer;
+    buffer << in->rdbuf();
+    const std::string text = buffer.str();
+    const char* end = text.c_str() + text.size();
+    for (const char* line = text.c_str(); line < end; )
     {
-      working().Ns = strtof(strtok_r(NULL, "\n", &context), NULL);
+      const char* eol = std::find(line, end, '\n');
+      parseLine(line, eol);
+      line = eol + 1;
     }
-    else if (CStringEqual(token, "Ks"))
+
+    if (!_unrecognised.empty())
     {
-      working().Ks = parseVec<3>(context);
+      std::cerr << "ObjMaterial import: ignored tokens";
+      for (set<std::string>::const_iterator i = _unrecognised.begin(); 
+          i != _unrecognised.end(); ++i) std::cerr << " '" << *i << "'";
+      std::cerr << " in " << filename << '\n';
     }
-    else if (CStringEqual(token, "map_Ka"))
+    return true;
+  }
+
+  namespace
+  {
+    struct MaterialLibrary
     {
-      working().map_Ka = strtok_r(NULL, "\n", &context);
-    }
-    else if (CStringEqual(token, "map_Kd"))
+      boost::mutex mutex; // Held while parsing so each version is parsed once.
+      std::time_t modified;
+      MaterialMapPtr materials;
+      uint64_t lastUse; // Guarded by librariesMutex
+    };
+
+    typedef std::map<std::string, std::tr1::shared_ptr<MaterialLibrary> > LibraryMap;
+
+    // Libraries are small, the bound only stops a long-running process that
+    // visits many directories from keeping every one it has seen.
+    const uint32_t kMaxLibraries = 64;
+
+    boost::mutex librariesMutex;
+    LibraryMap libraries;
+    uint64_t libraryUses = 0;
+
+    // Drop the least recently used library other than keep. Callers still
+    // holding its materials keep them.
+    void evictLibrary(LibraryMap::iterator keep)
     {
-      working().map_Kd = strtok_r(NULL, "\n", &context);
+      LibraryMap::iterator oldest = libraries.end();
+      for (LibraryMap::iterator i = libraries.begin(); i != libraries.end(); ++i)
+      {
+        if (i != keep && (oldest == libraries.end() || i->second->lastUse < oldest->second->lastUse))
+          oldest = i;
+      }
+      if (oldest != libraries.end()) libraries.erase(oldest);
     }
-    else if (CStringEqual(token, "map_Ks"))
+  }
+
+  MaterialMapPtr loadMaterialLibrary(const std::string& filename)
+  {
+    boost::system::error_code error;
+    const std::time_t modified = boost::filesystem::last_write_time(filename, error);
+    if (error) return MaterialMapPtr();
+    boost::filesystem::path key = boost::filesystem::canonical(filename, error);
+    if (error) key = filename;
+
+    std::tr1::shared_ptr<MaterialLibrary> library;
     {
-      working().map_Ks = strtok_r(NULL, "\n", &context);
+      boost::mutex::scoped_lock lock(librariesMutex);
+      LibraryMap::iterator entry = libraries.find(key.string());
+      if (entry == libraries.end())
+      {
+        entry = libraries.insert(std::make_pair(key.string(), 
+              std::tr1::shared_ptr<MaterialLibrary>(new MaterialLibrary()))).first;
+        if (libraries.size() > kMaxLibraries) evictLibrary(entry);
+      }
+      entry->second->lastUse = ++libraryUses;
+      library = entry->second;
     }
-    else
+
+    boost::mutex::scoped_lock lock(library->mutex);
+    if (!library->materials || library->modified != modified)
     {
-      std::cerr << "ObjMaterial import error: unrecognised token '" 
-        << token << "'\n";
+      std::tr1::shared_ptr<MaterialMap> materials(new MaterialMap());
+      if (!MtlTranslator().importFile(filename, materials.get())) return MaterialMapPtr();
+      library->materials = materials;
+      library->modified = modified;
     }
+    return library->materials;
   }
 
-  bool MtlTranslator::importFile(const std::string& filename, MaterialMap* found)
+  void clearMaterialLibraries()
   {
-    std::fstream fs (filename.c_str(), std::fstream::in);
-    if (!fs.is_open() || !found) return false;
-    _materials = found;
-
-    char line[256];
-    while (fs.getline(line, 256))
-    {
-      parseLine(line);
-    }
-    fs.close();
-    return true;
+    boost::mutex::scoped_lock lock(librariesMutex);
+    libraries.clear();
   }
 
   bool MtlTranslator::exportFile(const ModelPtr& model, const std::string& filename)
   {
     if (!model) return false;
-    std::fstream fs(filename.c_str(), std::fstream::out);
+    OStreamPtr out = openOutput(filename);
+    if (!out) return false;
+    std::ostream& os = *out;
     for_each(model->materials().begin(), model->materials().end(), 
-        fs << constant("newmtl ") << bind(&MaterialMap::value_type::second, cref(_1)));
+        os << constant("newmtl ") << bind(&MaterialMap::value_type::second, cref(_1)));
     return true;
   }
 
@@ -119,19 +250,21 @@ namespace obj {
   {
     if (!model) return false;
 
-    boost::filesystem::path outPath(filename);
-    std::fstream fs(filename.c_str(), std::fstream::out);
+    // The mtl is tiny, keep it plain so other tools can read it.
+    boost::filesystem::path outPath(stripCompressionExtension(filename));
+    OStreamPtr out = openOutput(filename);
+    if (!out) return false;
 
-    fs << "mtllib " << outPath.stem().string() << ".mtl\n";
-    fs << *model;
-    fs.close();
+    *out << "mtllib " << outPath.stem().string() << ".mtl\n";
+    *out << *model;
+    out.reset();
 
     MtlTranslator mt;
     outPath.replace_extension(".mtl");
     return mt.exportFile(model, outPath.string());
   }
 
-  int ObjTranslator::parseCluster(std::istream& cluster)
+  uint32_t ObjTranslator::parseCluster(const char* cluster, uint32_t* corner)
   {
     // Faces can be:
     // a) Vertex only (f V)
@@ -140,16 +273,15 @@ namespace obj {
     // d) Vertex, UV and Normal (f V/T/N)
     // We ignore the ordering here because it's dependent on 
     // what vertex data has been parsed.
-    char buffer[128];
-    int found = 0;
-    while (cluster.getline(buffer, 128, '/'))
+    uint32_t found = 0;
+    const char* p = cluster;
+    while (found < 3)
     {
-      uint32_t idx = strtol(buffer, NULL, 10);
-      if (idx > 0) 
-      {
-        _model->_faceIndices.push_back(idx-1);
-        ++found;
-      }
+      char* end;
+      uint32_t idx = strtol(p, &end, 10);
+      if (idx > 0) corner[found++] = idx-1;
+      if (*end != '/') break;
+      p = end + 1;
     }
     return found;
   }
@@ -193,75 +325,222 @@ namespace obj {
     else if (CStringEqual(token, "f"))
     {
       uint32_t indicesAdded = parseFace(context);
+      _indexCount += indicesAdded;
       if (materialGroup()) materialGroup()->setCount(materialGroup()->count() + indicesAdded);
       if (geometryGroup()) geometryGroup()->setCount(geometryGroup()->count() + indicesAdded);
     }
   } 
 
+  uint32_t ObjTranslator::emitCorner(const uint32_t* corner, uint32_t components)
+  {
+    if (_sink)
+    {
+      _sink(corner, components);
+    }
+    else
+    {
+      _model->_faceIndices.insert(_model->_faceIndices.end(), 
+          corner, corner + components);
+    }
+    return components;
+  }
+
+  uint32_t ObjTranslator::emitTriangle(uint32_t a, uint32_t b, uint32_t c)
+  {
+    return emitCorner(&_corners[a][0], _cornerSizes[a]) + 
+      emitCorner(&_corners[b][0], _cornerSizes[b]) +
+      emitCorner(&_corners[c][0], _cornerSizes[c]);
+  }
+
+  inline float cross2(const float2& a, const float2& b, const float2& c)
+  {
+    return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+  }
+
+  uint32_t ObjTranslator::earClipFace()
+  {
+    const uint32_t n = _corners.size();
+    const std::vector<float3>& positions = _model->positions();
+
+    // Project onto the plane facing the Newell normal's largest axis.
+    float3 normal;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+      if (_corners[i][0] >= positions.size()) return 0;
+      const float3& p = positions[_corners[i][0]];
+      const float3& q = positions[_corners[(i + 1) % n][0]];
+      normal[0] += (p[1] - q[1]) * (p[2] + q[2]);
+      normal[1] += (p[2] - q[2]) * (p[0] + q[0]);
+      normal[2] += (p[0] - q[0]) * (p[1] + q[1]);
+    }
+    int axis = 0;
+    if (fabs(normal[1]) > fabs(normal[axis])) axis = 1;
+    if (fabs(normal[2]) > fabs(normal[axis])) axis = 2;
+    const int u = (axis + 1) % 3;
+    const int v = (axis + 2) % 3;
+    const float winding = normal[axis] < 0.0f ? -1.0f : 1.0f;
+
+    _projected.resize(n);
+    _next.resize(n);
+    _prev.resize(n);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+      const float3& p = positions[_corners[i][0]];
+      _projected[i][0] = p[u];
+      _projected[i][1] = p[v];
+      _next[i] = (i + 1) % n;
+      _prev[i] = (i + n - 1) % n;
+    }
+
+    uint32_t indicesAdded = 0;
+    uint32_t remaining = n;
+    uint32_t i = 0;
+    uint32_t misses = 0;
+    while (remaining > 3)
+    {
+      const uint32_t a = _prev[i];
+      const uint32_t c = _next[i];
+      const float2& pa = _projected[a];
+      const float2& pb = _projected[i];
+      const float2& pc = _projected[c];
+      bool ear = winding * cross2(pa, pb, pc) > 0.0f;
+      for (uint32_t j = _next[c]; ear && j != a; j = _next[j])
+      {
+        const float2& p = _projected[j];
+        ear = !(winding * cross2(pa, pb, p) >= 0.0f && 
+            winding * cross2(pb, pc, p) >= 0.0f && 
+            winding * cross2(pc, pa, p) >= 0.0f);
+      }
+
+      // A full lap without an ear means the face isn't simple; clip anyway.
+      if (ear || misses == remaining)
+      {
+        indicesAdded += emitTriangle(a, i, c);
+        _next[a] = c;
+        _prev[c] = a;
+        --remaining;
+        misses = 0;
+      }
+      else
+      {
+        ++misses;
+      }
+      i = c;
+    }
+    return indicesAdded + emitTriangle(_prev[i], i, _next[i]);
+  }
+
   uint32_t ObjTranslator::parseFace(char* context)
   {
-    int found = 0;
-    char* c = strtok_r(NULL, " ", &context);
-    int sizes[3] = {0,0,0};
-    uint32_t indicesBefore = _model->faceIndices().size();
-    while (c != NULL && found < 3) 
-    {
-      std::istringstream ss(c);
-      sizes[found] = parseCluster(ss);
-      c = strtok_r(NULL, " ", &context);
-      ++found;
-    }
-    // Face is a quad, triangulate it now.
-    if (c != NULL)
-    {
-      uint32_t faceSize = sizes[0]+sizes[1]+sizes[2];
-      // cluster parser will push the last vertex
-      _model->_faceIndices.resize(_model->faceIndices().size() + sizes[0] + sizes[1]);
-      uint32_t* p0 = &_model->_faceIndices[_model->faceIndices().size()] - faceSize -
-        sizes[0] - sizes[1];
-      uint32_t* p1 = p0 + sizes[0];
-      uint32_t* p2 = p1 + sizes[1];
-      uint32_t* p3 = p2 + sizes[2];
-      uint32_t* p4 = p3 + sizes[0];
-
-      std::copy(p0, p1, p3);
-      std::copy(p2, p3, p4);
-      std::istringstream ss(c);
-      parseCluster(ss);
-    }
-    uint32_t indicesAdded =  (_model->faceIndices().size() - indicesBefore);
+    // Gather the corners first so a sink never sees a partial face.
+    _corners.clear();
+    _cornerSizes.clear();
+    for (char* c = strtok_r(NULL, " ", &context); c != NULL; 
+        c = strtok_r(NULL, " ", &context))
+    {
+      uint3 corner;
+      uint32_t size = parseCluster(c, &corner[0]);
+      if (size == 0) continue;
+      _corners.push_back(corner);
+      _cornerSizes.push_back(size);
+    }
+    const uint32_t n = _corners.size();
+    if (n < 3) return 0;
+
+    if (n > 3 && _triangulation == kEarClipTriangulation)
+    {
+      uint32_t indicesAdded = earClipFace();
+      if (indicesAdded > 0) return indicesAdded;
+    }
+
+    uint32_t indicesAdded = 0;
+    for (uint32_t i = 1; i + 1 < n; ++i) indicesAdded += emitTriangle(0, i, i + 1);
     return indicesAdded;
   }
 
   ModelPtr ObjTranslator::importFile(const std::string& filename)
+  {
+    return importFile(filename, CornerSink());
+  }
+
+  ModelPtr ObjTranslator::importFile(const std::string& filename, CornerSink sink)
   {
     _model = ModelPtr(new Model());
-    boost::filesystem::path objPath(filename);
-    std::fstream fs (filename.c_str(), std::fstream::in);
-    if (!fs.is_open()) return ModelPtr();
-    char line[256];
-    while (fs.getline(line, 256))
+    _sink = sink;
+    _indexCount = 0;
+    if (_pipelined && !sink && _triangulation == kFanTriangulation)
     {
-      parseLine(line);
+      ModelAssembler assembler;
+      if (!pipeObj(filename, assembler)) return ModelPtr();
+      _model = assembler.model();
+      mtllib = assembler.materialLibrary();
+      _indexCount = _model->_faceIndices.size();
+      return finishImport(filename);
     }
-    fs.close();
-    std::sort(_model->_geometryGroups.begin(), _model->_geometryGroups.end());
-    std::sort(_model->_materialGroups.begin(), _model->_materialGroups.end());
 
-    _model->_name = objPath.stem().string();
+    IStreamPtr in = openInput(filename);
+    if (!in) return ModelPtr();
+    std::string line;
+    while (std::getline(*in, line))
+    {
+      if (!line.empty()) parseLine(&line[0]);
+    }
+    if (in->bad())
+    {
+      std::cerr << "error reading " << filename << std::endl;
+      return ModelPtr();
+    }
+    return finishImport(filename);
+  }
+
+  ModelPtr ObjTranslator::parseBlock(char* begin, char* end)
+  {
+    _model = ModelPtr(new Model());
+    _sink = CornerSink();
+    _indexCount = 0;
+    mtllib.clear();
+    for (char* line = begin; line < end; )
+    {
+      char* eol = std::find(line, end, '\n');
+      if (eol == end) break;
+      *eol = '\0';
+      if (eol != line) parseLine(line);
+      line = eol + 1;
+    }
+    return _model;
+  }
+
+  bool resolveMaterials(Model& model, const std::string& filename, 
+      const std::string& mtllib)
+  {
+    boost::filesystem::path objPath(stripCompressionExtension(filename));
+    model._name = objPath.stem().string();
+    // Without an mtllib every used material gets defaults.
     boost::filesystem::path mtlPath(objPath.parent_path() / mtllib);
-    MtlTranslator mt;
-    MaterialMap importedMaterials;
-    if (!mt.importFile(mtlPath.string(), &importedMaterials))
+    MaterialMapPtr library = mtllib.empty() ? MaterialMapPtr(new MaterialMap()) : 
+      loadMaterialLibrary(mtlPath.string());
+    if (!library)
     {
       std::cerr << "error importing mtl " << mtlPath << std::endl;
-      return ModelPtr();
+      return false;
     }
-    for (std::vector<Group>::const_iterator i = _model->_materialGroups.begin();
-        i != _model->_materialGroups.end(); ++i)
+    // Copies rather than a shared library: models and meshes hold their
+    // MaterialMap by value and slices, tiles and merges build subsets and
+    // renamed maps from it. Only the materials the groups use are copied.
+    for (std::vector<Group>::const_iterator i = model._materialGroups.begin();
+        i != model._materialGroups.end(); ++i)
     {
-      _model->addMaterial(importedMaterials[i->name()]);
+      MaterialMap::const_iterator found = library->find(i->name());
+      model.addMaterial(found == library->end() ? Material(i->name()) : found->second);
     }
+    return true;
+  }
+
+  ModelPtr ObjTranslator::finishImport(const std::string& filename)
+  {
+    std::sort(_model->_geometryGroups.begin(), _model->_geometryGroups.end());
+    std::sort(_model->_materialGroups.begin(), _model->_materialGroups.end());
+    if (!resolveMaterials(*_model, filename, mtllib)) return ModelPtr();
     return _model;
   }
 
@@ -334,18 +613,90 @@ namespace obj {
     }
   }
 
+  namespace
+  {
+    // A piece of an OBJ file that can be formatted on its own: literal text
+    // or a range of an attribute array or of the face indices.
+    struct ObjSection
+    {
+      enum Kind { kText, kPositions, kUVs, kNormals, kFaces };
+
+      Kind kind;
+      uint32_t begin;
+      uint32_t end;
+      std::string text;
+    };
+
+    void addSections(std::vector<ObjSection>& sections, ObjSection::Kind kind,
+        uint32_t begin, uint32_t end, uint32_t step)
+    {
+      for (uint32_t b = begin; b < end; b += step)
+      {
+        ObjSection section = { kind, b, std::min(b + step, end), std::string() };
+        sections.push_back(section);
+      }
+    }
+
+    void addText(std::vector<ObjSection>& sections, const std::string& text)
+    {
+      ObjSection section = { ObjSection::kText, 0, 0, text };
+      sections.push_back(section);
+    }
+
+    struct FormatSections
+    {
+      const Model* model;
+      const std::ostream* target;
+      ObjSection* sections;
+
+      void operator()(uint32_t begin, uint32_t end)const
+      {
+        for (uint32_t i = begin; i < end; ++i) format(sections[i]);
+      }
+
+      // Through an ostream formatted like the target so numbers match a 
+      // serial write exactly.
+      void format(ObjSection& s)const
+      {
+        if (s.kind == ObjSection::kText) return;
+        std::ostringstream os;
+        os.flags(target->flags());
+        os.precision(target->precision());
+        os.fill(target->fill());
+        os.imbue(target->getloc());
+        for (uint32_t i = s.begin; i < s.end && s.kind == ObjSection::kPositions; ++i)
+        {
+          writeVec<float,3>(os, model->positions()[i], "v ", "\n");
+        }
+        for (uint32_t i = s.begin; i < s.end && s.kind == ObjSection::kUVs; ++i)
+        {
+          writeVec<float,2>(os, model->uvs()[i], "vt ", "\n");
+        }
+        for (uint32_t i = s.begin; i < s.end && s.kind == ObjSection::kNormals; ++i)
+        {
+          writeVec<float,3>(os, model->normals()[i], "vn ", "\n");
+        }
+        if (s.kind == ObjSection::kFaces)
+        {
+          writeFaces(os, model->vertexFormat(), &model->faceIndices()[0] + s.begin, 
+              s.end - s.begin);
+        }
+        s.text = os.str();
+      }
+    };
+  }
+
   std::ostream& operator<<(std::ostream& os, const Model& rhs)
   {
     if (rhs.positions().empty()) return os;
 
-    if (!rhs._geometryGroups.empty()) os << "g default\n";
+    std::vector<ObjSection> sections;
+    if (!rhs._geometryGroups.empty()) addText(sections, "g default\n");
 
-    std::for_each(rhs.positions().begin(), rhs.positions().end(), 
-        bind(writeVec<float,3>, ref(os), cref(_1), "v ", "\n"));
-    std::for_each(rhs.uvs().begin(), rhs.uvs().end(), 
-        bind(writeVec<float,2>, ref(os), cref(_1), "vt ", "\n"));
-    std::for_each(rhs.normals().begin(), rhs.normals().end(), 
-        bind(writeVec<float,3>, ref(os), cref(_1), "vn ", "\n"));
+    const uint32_t kLines = 1 << 14;
+    addSections(sections, ObjSection::kPositions, 0, rhs.positions().size(), kLines);
+    addSections(sections, ObjSection::kUVs, 0, rhs.uvs().size(), kLines);
+    addSections(sections, ObjSection::kNormals, 0, rhs.normals().size(), kLines);
 
     std::vector<Group> groups;
     groups.reserve(rhs._geometryGroups.size() + rhs._materialGroups.size());
@@ -355,18 +706,34 @@ namespace obj {
         back_inserter(groups), bind(styleObjMaterial, ref(_1)));
     sort(groups.begin(), groups.end());
 
-    VertexFormat vf = rhs.vertexFormat();
+    // Face chunks are whole triangles.
+    const VertexFormat vf = rhs.vertexFormat();
+    const uint32_t faceStep = kLines * 3 * (vf == kPositionUVNormal ? 3 : vf == kPosition ? 1 : 2);
     for (std::vector<Group>::const_iterator g = groups.begin();
         g != groups.end(); ++g)
     {
       uint32_t count = (g+1) == groups.end() ? g->count() : (g+1)->begin() - g->begin();
-      os << g->name() << '\n';
-      writeFaces(os, vf, &rhs.faceIndices()[0] + g->begin(), count);
+      addText(sections, g->name() + '\n');
+      addSections(sections, ObjSection::kFaces, g->begin(), g->begin() + count, faceStep);
     }
 
     if (groups.empty())
     {
-      writeFaces(os, vf, &rhs.faceIndices()[0], rhs.faceIndices().size());
+      addSections(sections, ObjSection::kFaces, 0, rhs.faceIndices().size(), faceStep);
+    }
+
+    // Format a wave of sections in parallel, then write it in order.
+    const uint32_t wave = workerCount() * 4;
+    for (uint32_t w = 0; w < sections.size(); w += wave)
+    {
+      const uint32_t end = std::min<uint32_t>(w + wave, sections.size());
+      FormatSections fn = { &rhs, &os, &sections[w] };
+      parallelFor(end - w, fn, 1);
+      for (uint32_t i = w; i < end; ++i)
+      {
+        os.write(sections[i].text.data(), sections[i].text.size());
+        std::string().swap(sections[i].text);
+      }
     }
     return os;
   }
@@ -380,6 +747,7 @@ namespace obj {
       case kPositionUV: os << "kPositionUV"; break;
       case kPositionNormal: os << "kPositionNormal"; break;
       case kPositionUVNormal: os << "kPositionUVNormal"; break;
+      case kPositionUVNormalTangent: os << "kPositionUVNormalTangent"; break;
       case kVertexFormatMax: os << "kVertexFormatMax"; break;
       default: os << "Invalid"; break;
     }
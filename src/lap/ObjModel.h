@@ -1,6 +1,7 @@
 #ifndef OBJ_IMPORT_HPP
 #define OBJ_IMPORT_HPP
 
+#include <boost/function.hpp>
 #include <iosfwd>
 #include <set>
 #include <stdint.h>
@@ -26,6 +27,7 @@ namespace lap {
       kPositionUV,
       kPositionNormal,
       kPositionUVNormal,
+      kPositionUVNormalTangent, // Only from PLY files, see plyVertexFormat.
       kVertexFormatMax
     };
 
@@ -73,6 +75,11 @@ namespace lap {
 
         void addMaterial(const Material& m) { _materials[m.name()] = m; }
 
+        //! Append a model parsed from the text following this one's: its
+        //! attributes and faces go after ours, faces before its first group 
+        //! extend our last group.
+        void append(const Model& next);
+
         std::vector<uint32_t> _faceIndices;
         std::vector<Group> _geometryGroups;
         std::vector<Group> _materialGroups;
@@ -95,32 +102,104 @@ namespace lap {
 
     std::ostream& operator<<(std::ostream& os, VertexFormat vf);
 
+    //! Write rhs as OBJ text. Attribute arrays and group face ranges are
+    //! formatted in parallel chunks and written in order, so the output
+    //! doesn't depend on the thread count.
     std::ostream& operator<<(std::ostream& os, const Model& rhs);
 
     class MtlTranslator
     {
       public:
+        //! Parse filename into found. Unrecognised tokens are reported once
+        //! per file.
         bool importFile(const std::string& filename, MaterialMap* found);
         bool exportFile(const ModelPtr& model, const std::string& filename);
       private:
-        void parseLine(char* line);
+        void parseLine(const char* line, const char* end);
 
         std::string _working;
         Material& working() { return (*_materials)[_working]; }
         MaterialMap* _materials;
+        set<std::string> _unrecognised;
+  };
+
+    typedef std::tr1::shared_ptr<const MaterialMap> MaterialMapPtr;
+
+    //! The materials in an mtl file, parsed once per process and shared by
+    //! every caller until the file's modification time changes. The 64 most
+    //! recently used libraries are kept. Thread-safe. Returns null if the 
+    //! file can't be read.
+    MaterialMapPtr loadMaterialLibrary(const std::string& filename);
+
+    //! Forget every cached material library.
+    void clearMaterialLibraries();
+
+    //! Name model after filename and add the materials its material groups
+    //! use from mtllib, found beside filename. Materials the library lacks
+    //! get defaults. False if the library can't be read.
+    bool resolveMaterials(Model& model, const std::string& filename, 
+        const std::string& mtllib);
+
+  enum Triangulation
+  {
+    kFanTriangulation, // Fan from the first corner, for convex faces.
+    kEarClipTriangulation // Ear clipping, for concave planar faces.
   };
 
   class ObjTranslator
   {
     public:
+      ObjTranslator(): 
+        _triangulation(kFanTriangulation),
+        _pipelined(false),
+        _indexCount(0)
+      {}
+
+      //! How faces with more than three corners are split.
+      void setTriangulation(Triangulation t) { _triangulation = t; }
+
+      //! Read, parse and assemble blocks concurrently (see ObjPipeline.h). 
+      //! Ear clipping needs every position up front, so it always imports 
+      //! serially.
+      void setPipelined(bool pipelined) { _pipelined = pipelined; }
+
+      //! Receives each triangle corner (v, vt, vn indices) as it's parsed.
+      typedef boost::function<void (const uint32_t* corner, uint32_t components)> 
+        CornerSink;
+
       ModelPtr importFile(const std::string& filename);
+
+      //! Import streaming face corners to sink instead of Model::_faceIndices.
+      ModelPtr importFile(const std::string& filename, CornerSink sink);
       bool exportFile(const ModelPtr& model, const std::string& filename);
 
+      //! Parse a block of whole lines into a new model, leaving groups in file 
+      //! order and materials unresolved. The block is modified.
+      ModelPtr parseBlock(char* begin, char* end);
+
+      //! The mtllib named by the last import or parseBlock.
+      const std::string& materialLibrary()const { return mtllib; }
+
     private:
-      int parseCluster(std::istream& cluster);
+      ModelPtr finishImport(const std::string& filename);
+      uint32_t parseCluster(const char* cluster, uint32_t* corner);
       void parseLine(char* line);
       uint32_t parseFace(char* context);
+      uint32_t emitCorner(const uint32_t* corner, uint32_t components);
+      uint32_t emitTriangle(uint32_t a, uint32_t b, uint32_t c);
+      uint32_t earClipFace();
       ModelPtr _model;
+      CornerSink _sink;
+      Triangulation _triangulation;
+      bool _pipelined;
+      uint32_t _indexCount; // Face-indices parsed so far, also counted with a sink.
+
+      // Scratch for the face being parsed, reused so faces don't allocate.
+      std::vector<uint3> _corners;
+      std::vector<uint32_t> _cornerSizes;
+      std::vector<float2> _projected;
+      std::vector<uint32_t> _next;
+      std::vector<uint32_t> _prev;
       std::string mtllib; // Obj-format token for a Obj-material file.
 
       Group* geometryGroup() 
@@ -135,17 +214,13 @@ namespace lap {
 
       void addGeometryGroup(const std::string& name)
       {
-        uint32_t start = _model->_geometryGroups.empty() ? 0 : 
-          _model->_geometryGroups.back().end();
-        _model->_geometryGroups.push_back(Group(name, start));
+        _model->_geometryGroups.push_back(Group(name, _indexCount));
       }
 
       void addMaterialGroup(const std::string& material)
       {
-        uint32_t start = _model->_materialGroups.empty() ? 0 : 
-          _model->_materialGroups.back().end();
         _model->_materialGroups.push_back(
-            Group(normalizeMaterialName(material), start));
+            Group(normalizeMaterialName(material), _indexCount));
       }
   };
 }
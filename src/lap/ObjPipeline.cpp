@@ -0,0 +1,161 @@
+#include "ObjPipeline.h"
+#include "BoundedQueue.h"
+#include "CompressedStream.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <boost/thread/thread.hpp>
+
+namespace lap {
+namespace obj {
+
+  using std::tr1::shared_ptr;
+
+  namespace
+  {
+    struct Block
+    {
+      uint32_t sequence;
+      shared_ptr<std::vector<char> > text;
+    };
+
+    typedef BoundedQueue<Block> BlockQueue;
+    typedef BoundedQueue<ObjChunk> ChunkQueue;
+
+    struct ReadBlocks
+    {
+      std::istream* in;
+      uint32_t blockSize;
+      BlockQueue* blocks;
+      SequenceWindow* window;
+      bool* failed;
+
+      void operator()()const
+      {
+        std::vector<char> carry;
+        uint32_t sequence = 0;
+        bool last = false;
+        while (!last)
+        {
+          shared_ptr<std::vector<char> > text(new std::vector<char>());
+          text->reserve(carry.size() + blockSize + 1);
+          text->assign(carry.begin(), carry.end());
+          carry.clear();
+
+          const size_t kept = text->size();
+          text->resize(kept + blockSize);
+          in->read(&(*text)[kept], blockSize);
+          text->resize(kept + in->gcount());
+          last = !*in;
+          if (in->bad())
+          {
+            // A failed read isn't the end of the file; drop the rest.
+            *failed = true;
+            break;
+          }
+
+          if (!last)
+          {
+            // Hold back the partial line; a block without one keeps growing.
+            std::vector<char>::iterator cut = 
+              std::find(text->rbegin(), text->rend(), '\n').base();
+            carry.assign(cut, text->end());
+            text->erase(cut, text->end());
+          }
+          else if (!text->empty() && text->back() != '\n')
+          {
+            text->push_back('\n');
+          }
+          if (text->empty()) continue;
+
+          window->acquire(sequence);
+          Block block = { sequence++, text };
+          blocks->push(block);
+        }
+        blocks->producerDone();
+      }
+    };
+
+    struct ParseBlocks
+    {
+      BlockQueue* blocks;
+      ChunkQueue* chunks;
+
+      void operator()()const
+      {
+        ObjTranslator translator;
+        Block block;
+        while (blocks->pop(block))
+        {
+          char* begin = &(*block.text)[0];
+          ObjChunk chunk;
+          chunk.sequence = block.sequence;
+          chunk.model = translator.parseBlock(begin, begin + block.text->size());
+          chunk.mtllib = translator.materialLibrary();
+          block.text.reset();
+          chunks->push(chunk);
+        }
+        chunks->producerDone();
+      }
+    };
+  }
+
+  PipelineOptions::PipelineOptions():
+    blockSize(4 << 20),
+    parsers(workerCount()),
+    queueDepth(4)
+  {}
+
+  bool pipeObj(const std::string& filename, ChunkSink sink, 
+      const PipelineOptions& options)
+  {
+    IStreamPtr in = openInput(filename);
+    if (!in) return false;
+
+    const uint32_t parsers = std::max(options.parsers, 1u);
+    const uint32_t depth = std::max(options.queueDepth, 1u);
+    BlockQueue blocks(depth);
+    ChunkQueue chunks(depth + parsers, parsers);
+    // Blocks between the reader and the sink, including those waiting on an
+    // earlier block to finish parsing.
+    SequenceWindow window(depth + parsers);
+    bool failed = false;
+
+    boost::thread_group threads;
+    ReadBlocks reader = { in.get(), std::max(options.blockSize, 1u), &blocks, &window, &failed };
+    threads.create_thread(reader);
+    for (uint32_t i = 0; i < parsers; ++i)
+    {
+      ParseBlocks parser = { &blocks, &chunks };
+      threads.create_thread(parser);
+    }
+
+    // Parsers finish out of order; hold chunks until their turn.
+    std::map<uint32_t, ObjChunk> pending;
+    uint32_t next = 0;
+    ObjChunk chunk;
+    while (chunks.pop(chunk))
+    {
+      pending[chunk.sequence] = chunk;
+      for (std::map<uint32_t, ObjChunk>::iterator i = pending.find(next); 
+          i != pending.end(); i = pending.find(++next))
+      {
+        sink(i->second);
+        pending.erase(i);
+        window.release();
+      }
+    }
+    threads.join_all();
+    if (failed) std::cerr << "error reading " << filename << std::endl;
+    return !failed;
+  }
+
+  void ModelAssembler::operator()(const ObjChunk& chunk)const
+  {
+    _model->append(*chunk.model);
+    if (!chunk.mtllib.empty()) *_mtllib = chunk.mtllib;
+  }
+}
+}
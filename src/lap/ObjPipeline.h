@@ -0,0 +1,64 @@
+#ifndef LAP_OBJ_PIPELINE_H
+#define LAP_OBJ_PIPELINE_H
+
+#include <stdint.h>
+#include <string>
+#include <boost/function.hpp>
+#include "ObjModel.h"
+
+namespace lap {
+namespace obj {
+
+  //! The model parsed from one block of an OBJ file. Face indices are 
+  //! file-global, groups start relative to the block and faces before the 
+  //! first group continue the previous block's group (see Model::append).
+  struct ObjChunk
+  {
+    uint32_t sequence;
+    ModelPtr model;
+    std::string mtllib;
+  };
+
+  typedef boost::function<void (const ObjChunk&)> ChunkSink;
+
+  struct PipelineOptions
+  {
+    PipelineOptions();
+
+    uint32_t blockSize; // Bytes read per block, rounded to whole lines.
+    uint32_t parsers; // Parser threads, defaults to workerCount().
+    uint32_t queueDepth; // Blocks queued between each stage.
+  };
+
+  //! Import filename in three overlapped stages: a reader thread cuts the file
+  //! into blocks of whole lines, parser threads turn blocks into chunks and 
+  //! the calling thread hands chunks to sink in file order. Memory is bounded
+  //! by queueDepth + parsers blocks rather than the file size: the reader 
+  //! doesn't start a block until the sink is that close behind. gzip and zstd
+  //! files are decompressed by the reader thread. Returns false if the file 
+  //! can't be opened or a read fails before the end.
+  bool pipeObj(const std::string& filename, ChunkSink sink, 
+      const PipelineOptions& options = PipelineOptions());
+
+  //! ChunkSink that appends each chunk to one model. Copies share the model.
+  class ModelAssembler
+  {
+    public:
+      ModelAssembler(): 
+        _model(new Model()),
+        _mtllib(new std::string())
+    {}
+
+      void operator()(const ObjChunk& chunk)const;
+
+      const ModelPtr& model()const { return _model; }
+      const std::string& materialLibrary()const { return *_mtllib; }
+
+    private:
+      ModelPtr _model;
+      std::tr1::shared_ptr<std::string> _mtllib;
+  };
+}
+}
+
+#endif
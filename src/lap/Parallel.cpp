@@ -0,0 +1,77 @@
+#include "Parallel.h"
+#include <algorithm>
+#include <cstdlib>
+#include <boost/thread/thread.hpp>
+
+namespace lap
+{
+  namespace
+  {
+    typedef boost::function<void (uint32_t, uint32_t, uint32_t)> ChunkFn;
+    typedef boost::function<void (uint32_t, uint32_t)> RangeFn;
+
+    class ChunkTask
+    {
+      public:
+        ChunkTask(const ChunkFn& fn, uint32_t chunk, uint32_t begin, uint32_t end):
+          _fn(fn),
+          _chunk(chunk),
+          _begin(begin),
+          _end(end)
+      {}
+        void operator()() { _fn(_chunk, _begin, _end); }
+      private:
+        ChunkFn _fn;
+        uint32_t _chunk;
+        uint32_t _begin;
+        uint32_t _end;
+    };
+
+    class RangeTask
+    {
+      public:
+        RangeTask(const RangeFn& fn): _fn(fn) {}
+        void operator()(uint32_t, uint32_t begin, uint32_t end) { _fn(begin, end); }
+      private:
+        RangeFn _fn;
+    };
+  }
+
+  uint32_t workerCount()
+  {
+    const char* env = getenv("LAP_THREADS");
+    long requested = env ? strtol(env, NULL, 10) : 0;
+    if (requested > 0) return requested;
+    return std::max(1u, boost::thread::hardware_concurrency());
+  }
+
+  uint32_t chunkCount(uint32_t count, uint32_t grain)
+  {
+    uint32_t chunks = std::min(workerCount(), count / std::max(1u, grain));
+    return std::max(1u, chunks);
+  }
+
+  void parallelChunks(uint32_t count, uint32_t chunks, ChunkFn fn)
+  {
+    if (chunks <= 1)
+    {
+      fn(0, 0, count);
+      return;
+    }
+
+    // The calling thread takes the last chunk.
+    boost::thread_group threads;
+    for (uint32_t c = 0; c + 1 < chunks; ++c)
+    {
+      threads.create_thread(ChunkTask(fn, c, 
+            chunkBegin(count, chunks, c), chunkBegin(count, chunks, c + 1)));
+    }
+    fn(chunks - 1, chunkBegin(count, chunks, chunks - 1), count);
+    threads.join_all();
+  }
+
+  void parallelFor(uint32_t count, RangeFn fn, uint32_t grain)
+  {
+    parallelChunks(count, chunkCount(count, grain), RangeTask(fn));
+  }
+}
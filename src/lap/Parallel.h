@@ -0,0 +1,32 @@
+#ifndef LAP_PARALLEL_H
+#define LAP_PARALLEL_H
+
+#include <stdint.h>
+#include <boost/function.hpp>
+
+namespace lap
+{
+  //! Threads used by parallel passes; LAP_THREADS overrides the hardware count.
+  uint32_t workerCount();
+
+  //! Number of chunks to split count items into, each at least grain items.
+  uint32_t chunkCount(uint32_t count, uint32_t grain);
+
+  //! Start of chunk within [0, count) split into chunks equal parts.
+  inline uint32_t chunkBegin(uint32_t count, uint32_t chunks, uint32_t chunk)
+  {
+    return (uint64_t)count * chunk / chunks;
+  }
+
+  //! Runs fn(chunk, begin, end) for each of chunks ranges over [0, count),
+  //! one thread per chunk. Boundaries depend only on count and chunks, so 
+  //! per-chunk results can be combined deterministically.
+  void parallelChunks(uint32_t count, uint32_t chunks,
+      boost::function<void (uint32_t, uint32_t, uint32_t)> fn);
+
+  //! Runs fn(begin, end) over [0, count) in ranges of at least grain items.
+  void parallelFor(uint32_t count, boost::function<void (uint32_t, uint32_t)> fn,
+      uint32_t grain = 4096);
+}
+
+#endif
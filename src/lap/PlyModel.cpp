@@ -0,0 +1,681 @@
+#include "PlyModel.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+namespace lap
+{
+  namespace
+  {
+    enum PlyType
+    {
+      kPlyInvalid,
+      kPlyInt8,
+      kPlyUint8,
+      kPlyInt16,
+      kPlyUint16,
+      kPlyInt32,
+      kPlyUint32,
+      kPlyFloat32,
+      kPlyFloat64
+    };
+
+    struct PlyProperty
+    {
+      std::string name;
+      PlyType type; // Item type for lists
+      PlyType countType; // kPlyInvalid unless a list
+      uint32_t offset; // Within the record, for fixed-size records
+    };
+
+    struct PlyElement
+    {
+      std::string name;
+      uint32_t count;
+      std::vector<PlyProperty> properties;
+      uint32_t recordSize; // 0 if the element has lists
+    };
+
+    struct PlyHeader
+    {
+      PlyFormat format;
+      std::vector<PlyElement> elements;
+      size_t dataOffset;
+    };
+
+    // Attribute slots gathered from vertex properties.
+    enum 
+    { 
+      kSlotX, kSlotY, kSlotZ, kSlotNX, kSlotNY, kSlotNZ, kSlotS, kSlotT, 
+      kSlotTX, kSlotTY, kSlotTZ, kSlotTW, kSlotCount 
+    };
+    const char* const kSlotNames[kSlotCount] = 
+    { 
+      "x", "y", "z", "nx", "ny", "nz", "s", "t", "tx", "ty", "tz", "tw" 
+    };
+
+    inline bool hostIsBigEndian()
+    {
+      const uint16_t probe = 1;
+      return *reinterpret_cast<const uint8_t*>(&probe) == 0;
+    }
+
+    inline uint32_t swap32(uint32_t v)
+    {
+      return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+    }
+
+    PlyType parseType(const std::string& s)
+    {
+      if (s == "char" || s == "int8") return kPlyInt8;
+      if (s == "uchar" || s == "uint8") return kPlyUint8;
+      if (s == "short" || s == "int16") return kPlyInt16;
+      if (s == "ushort" || s == "uint16") return kPlyUint16;
+      if (s == "int" || s == "int32") return kPlyInt32;
+      if (s == "uint" || s == "uint32") return kPlyUint32;
+      if (s == "float" || s == "float32") return kPlyFloat32;
+      if (s == "double" || s == "float64") return kPlyFloat64;
+      return kPlyInvalid;
+    }
+
+    uint32_t typeSize(PlyType type)
+    {
+      switch (type)
+      {
+        case kPlyInt8: case kPlyUint8: return 1;
+        case kPlyInt16: case kPlyUint16: return 2;
+        case kPlyInt32: case kPlyUint32: case kPlyFloat32: return 4;
+        case kPlyFloat64: return 8;
+        default: return 0;
+      }
+    }
+
+    // Uv properties go by several names.
+    std::string canonicalName(const std::string& name)
+    {
+      if (name == "u" || name == "texture_u" || name == "texture_s") return "s";
+      if (name == "v" || name == "texture_v" || name == "texture_t") return "t";
+      return name;
+    }
+
+    template <typename T>
+      inline T loadRaw(const char* p, bool swap)
+      {
+        T value;
+        if (swap)
+        {
+          char bytes[sizeof(T)];
+          std::reverse_copy(p, p + sizeof(T), bytes);
+          memcpy(&value, bytes, sizeof(T));
+        }
+        else
+        {
+          memcpy(&value, p, sizeof(T));
+        }
+        return value;
+      }
+
+    inline float loadFloat(const char* p, PlyType type, bool swap)
+    {
+      switch (type)
+      {
+        case kPlyInt8: return loadRaw<int8_t>(p, swap);
+        case kPlyUint8: return loadRaw<uint8_t>(p, swap);
+        case kPlyInt16: return loadRaw<int16_t>(p, swap);
+        case kPlyUint16: return loadRaw<uint16_t>(p, swap);
+        case kPlyInt32: return loadRaw<int32_t>(p, swap);
+        case kPlyUint32: return loadRaw<uint32_t>(p, swap);
+        case kPlyFloat32: return loadRaw<float>(p, swap);
+        case kPlyFloat64: return loadRaw<double>(p, swap);
+        default: return 0.0f;
+      }
+    }
+
+    // Negative indices wrap to values no vertex count reaches.
+    inline uint32_t loadIndex(const char* p, PlyType type, bool swap)
+    {
+      switch (type)
+      {
+        case kPlyInt8: return loadRaw<int8_t>(p, swap);
+        case kPlyUint8: return loadRaw<uint8_t>(p, swap);
+        case kPlyInt16: return loadRaw<int16_t>(p, swap);
+        case kPlyUint16: return loadRaw<uint16_t>(p, swap);
+        case kPlyInt32: return loadRaw<int32_t>(p, swap);
+        case kPlyUint32: return loadRaw<uint32_t>(p, swap);
+        default: return ~0u;
+      }
+    }
+
+    bool parseHeader(const char* data, size_t size, PlyHeader& header)
+    {
+      const char* end = data + size;
+      const char* line = data;
+      bool first = true;
+      bool ended = false;
+      header.format = kPlyAscii;
+      while (line < end && !ended)
+      {
+        const char* eol = std::find(line, end, '\n');
+        if (eol == end) return false;
+        std::string text(line, eol);
+        if (!text.empty() && text[text.size() - 1] == '\r') text.erase(text.size() - 1);
+        line = eol + 1;
+
+        std::istringstream is(text);
+        std::string keyword;
+        is >> keyword;
+        if (first)
+        {
+          if (keyword != "ply") return false;
+          first = false;
+        }
+        else if (keyword == "format")
+        {
+          std::string format;
+          is >> format;
+          if (format == "ascii") header.format = kPlyAscii;
+          else if (format == "binary_little_endian") header.format = kPlyBinaryLittleEndian;
+          else if (format == "binary_big_endian") header.format = kPlyBinaryBigEndian;
+          else return false;
+        }
+        else if (keyword == "element")
+        {
+          PlyElement element;
+          element.count = 0;
+          element.recordSize = 0;
+          is >> element.name >> element.count;
+          header.elements.push_back(element);
+        }
+        else if (keyword == "property")
+        {
+          if (header.elements.empty()) return false;
+          PlyProperty property;
+          std::string type;
+          is >> type;
+          if (type == "list")
+          {
+            std::string countType, itemType;
+            is >> countType >> itemType;
+            property.countType = parseType(countType);
+            property.type = parseType(itemType);
+            if (property.countType == kPlyInvalid || property.countType == kPlyFloat32 ||
+                property.countType == kPlyFloat64) return false;
+          }
+          else
+          {
+            property.countType = kPlyInvalid;
+            property.type = parseType(type);
+          }
+          if (property.type == kPlyInvalid) return false;
+          is >> property.name;
+          property.offset = 0;
+          header.elements.back().properties.push_back(property);
+        }
+        else if (keyword == "end_header")
+        {
+          header.dataOffset = line - data;
+          ended = true;
+        }
+      }
+      if (!ended) return false;
+
+      for (std::vector<PlyElement>::iterator e = header.elements.begin();
+          e != header.elements.end(); ++e)
+      {
+        uint32_t offset = 0;
+        bool fixed = true;
+        for (std::vector<PlyProperty>::iterator p = e->properties.begin();
+            p != e->properties.end(); ++p)
+        {
+          p->offset = offset;
+          offset += typeSize(p->type);
+          fixed = fixed && p->countType == kPlyInvalid;
+        }
+        e->recordSize = fixed ? offset : 0;
+      }
+      return true;
+    }
+
+    // Step over one record of an element with lists, or return NULL if the
+    // data runs out.
+    const char* skipRecord(const PlyElement& e, const char* p, const char* end, bool swap)
+    {
+      for (std::vector<PlyProperty>::const_iterator i = e.properties.begin();
+          i != e.properties.end(); ++i)
+      {
+        if (i->countType == kPlyInvalid)
+        {
+          p += typeSize(i->type);
+        }
+        else
+        {
+          if (p + typeSize(i->countType) > end) return NULL;
+          const uint32_t count = loadIndex(p, i->countType, swap);
+          p += typeSize(i->countType) + (uint64_t)count * typeSize(i->type);
+        }
+        if (p > end) return NULL;
+      }
+      return p;
+    }
+
+    const char* skipElement(const PlyElement& e, const char* p, const char* end, bool swap)
+    {
+      if (e.recordSize > 0 || e.properties.empty())
+      {
+        const uint64_t bytes = (uint64_t)e.count * e.recordSize;
+        return bytes > (uint64_t)(end - p) ? NULL : p + bytes;
+      }
+      for (uint32_t i = 0; i < e.count && p != NULL; ++i) p = skipRecord(e, p, end, swap);
+      return p;
+    }
+
+    inline float3 slots3(const float* f)
+    {
+      float3 v;
+      v[0] = f[0]; v[1] = f[1]; v[2] = f[2];
+      return v;
+    }
+
+    inline float2 slots2(const float* f)
+    {
+      float2 v;
+      v[0] = f[0]; v[1] = f[1];
+      return v;
+    }
+
+    inline float4 slots4(const float* f)
+    {
+      float4 v;
+      v[0] = f[0]; v[1] = f[1]; v[2] = f[2]; v[3] = f[3];
+      return v;
+    }
+
+    template <typename V> V plyVertex(const float* f);
+
+    template <> VertexP plyVertex(const float* f)
+    {
+      return VertexP(slots3(f + kSlotX));
+    }
+
+    template <> VertexPN plyVertex(const float* f)
+    {
+      return VertexPN(slots3(f + kSlotX), slots3(f + kSlotNX));
+    }
+
+    template <> VertexPT plyVertex(const float* f)
+    {
+      return VertexPT(slots3(f + kSlotX), slots2(f + kSlotS));
+    }
+
+    template <> VertexPTN plyVertex(const float* f)
+    {
+      return VertexPTN(slots3(f + kSlotX), slots2(f + kSlotS), slots3(f + kSlotNX));
+    }
+
+    template <> VertexPTNT plyVertex(const float* f)
+    {
+      return VertexPTNT(slots3(f + kSlotX), slots2(f + kSlotS), slots3(f + kSlotNX), 
+          slots4(f + kSlotTX));
+    }
+
+    // Float properties in the order of V's members, as exportPly writes them.
+    template <typename V> const char* plyLayout();
+    template <> const char* plyLayout<VertexP>() { return "x y z"; }
+    template <> const char* plyLayout<VertexPN>() { return "x y z nx ny nz"; }
+    template <> const char* plyLayout<VertexPT>() { return "x y z s t"; }
+    template <> const char* plyLayout<VertexPTN>() { return "x y z s t nx ny nz"; }
+    template <> const char* plyLayout<VertexPTNT>() { return "x y z s t nx ny nz tx ty tz tw"; }
+
+    template <typename V>
+      struct DecodeVertices
+      {
+        const char* data;
+        uint32_t recordSize;
+        const PlyProperty* slots[kSlotCount];
+        bool swap;
+        V* out;
+
+        void operator()(uint32_t begin, uint32_t end)const
+        {
+          float f[kSlotCount];
+          for (uint32_t i = begin; i < end; ++i)
+          {
+            const char* record = data + (uint64_t)i * recordSize;
+            for (uint32_t s = 0; s < kSlotCount; ++s)
+            {
+              f[s] = slots[s] ? loadFloat(record + slots[s]->offset, slots[s]->type, swap) : 0.0f;
+            }
+            out[i] = plyVertex<V>(f);
+          }
+        }
+      };
+
+    template <typename V>
+      bool decodeVertices(const PlyElement& e, const char* data, bool swap,
+          std::vector<V>& vertices)
+      {
+        if (e.recordSize == 0) return false;
+        vertices.resize(e.count);
+        if (vertices.empty()) return true;
+
+        std::string layout;
+        bool allFloat = true;
+        DecodeVertices<V> decode = { data, e.recordSize, {}, swap, &vertices[0] };
+        for (std::vector<PlyProperty>::const_iterator p = e.properties.begin();
+            p != e.properties.end(); ++p)
+        {
+          const std::string name = canonicalName(p->name);
+          layout += (layout.empty() ? "" : " ") + name;
+          allFloat = allFloat && p->type == kPlyFloat32;
+          for (uint32_t s = 0; s < kSlotCount; ++s)
+          {
+            if (name == kSlotNames[s]) decode.slots[s] = &*p;
+          }
+        }
+        if (!decode.slots[kSlotX] || !decode.slots[kSlotY] || !decode.slots[kSlotZ]) return false;
+
+        if (!swap && allFloat && layout == plyLayout<V>() && e.recordSize == sizeof(V))
+        {
+          memcpy(static_cast<void*>(&vertices[0]), data, (size_t)e.count * sizeof(V));
+          return true;
+        }
+        parallelFor(e.count, decode);
+        return true;
+      }
+
+    // Reads the face element at p, leaving p after it.
+    bool decodeFaces(const PlyElement& e, const char*& p, const char* end, bool swap,
+        uint32_t vertexCount, std::vector<uint32_t>& indices)
+    {
+      uint32_t list = e.properties.size();
+      for (uint32_t i = 0; i < e.properties.size(); ++i)
+      {
+        const std::string& name = e.properties[i].name;
+        if (e.properties[i].countType != kPlyInvalid &&
+            (name == "vertex_indices" || name == "vertex_index")) list = i;
+      }
+      if (list == e.properties.size()) return false;
+      const PlyProperty& property = e.properties[list];
+      const uint32_t countSize = typeSize(property.countType);
+      const uint32_t indexSize = typeSize(property.type);
+      if (property.type == kPlyFloat32 || property.type == kPlyFloat64) return false;
+
+      indices.reserve((size_t)e.count * 3);
+      const bool bulk = e.properties.size() == 1 && countSize == 1 && indexSize == 4 && !swap;
+      std::vector<uint32_t> corners;
+      for (uint32_t f = 0; f < e.count; ++f)
+      {
+        if (bulk)
+        {
+          // Triangles are copied as they lie, one uchar count then 3 ints.
+          if (p >= end) return false;
+          const uint32_t n = *reinterpret_cast<const uint8_t*>(p);
+          if (p + 1 + n * 4 > end) return false;
+          if (n == 3)
+          {
+            const size_t at = indices.size();
+            indices.resize(at + 3);
+            memcpy(&indices[at], p + 1, 12);
+            p += 13;
+            continue;
+          }
+        }
+
+        const char* record = p;
+        p = skipRecord(e, record, end, swap);
+        if (p == NULL) return false;
+        for (uint32_t i = 0; i < list; ++i)
+        {
+          const PlyProperty& skipped = e.properties[i];
+          if (skipped.countType == kPlyInvalid) record += typeSize(skipped.type);
+          else record += typeSize(skipped.countType) +
+            loadIndex(record, skipped.countType, swap) * typeSize(skipped.type);
+        }
+        const uint32_t n = loadIndex(record, property.countType, swap);
+        record += countSize;
+        corners.resize(n);
+        for (uint32_t i = 0; i < n; ++i) corners[i] = loadIndex(record + i * indexSize, property.type, swap);
+        for (uint32_t i = 1; i + 1 < n; ++i)
+        {
+          indices.push_back(corners[0]);
+          indices.push_back(corners[i]);
+          indices.push_back(corners[i + 1]);
+        }
+      }
+      return indices.empty() || *std::max_element(indices.begin(), indices.end()) < vertexCount;
+    }
+
+    template <typename V>
+      shared_ptr<Mesh<V> > readPly(const std::string& filename)
+      {
+        boost::iostreams::mapped_file_source file;
+        try
+        {
+          file.open(filename);
+        }
+        catch (const std::exception&)
+        {
+          return shared_ptr<Mesh<V> >();
+        }
+        if (!file.is_open()) return shared_ptr<Mesh<V> >();
+
+        const char* data = file.data();
+        const char* end = data + file.size();
+        PlyHeader header;
+        if (!parseHeader(data, file.size(), header))
+        {
+          std::cerr << "ply import error: bad header in " << filename << std::endl;
+          return shared_ptr<Mesh<V> >();
+        }
+        if (header.format == kPlyAscii)
+        {
+          std::cerr << "ply import error: ascii ply unsupported " << filename << std::endl;
+          return shared_ptr<Mesh<V> >();
+        }
+        const bool swap = (header.format == kPlyBinaryBigEndian) != hostIsBigEndian();
+
+        shared_ptr<Mesh<V> > mesh(new Mesh<V>());
+        bool haveVertices = false;
+        bool haveFaces = false;
+        const char* p = data + header.dataOffset;
+        for (std::vector<PlyElement>::const_iterator e = header.elements.begin();
+            e != header.elements.end() && p != NULL; ++e)
+        {
+          if (e->name == "face")
+          {
+            if (!haveVertices ||
+                !decodeFaces(*e, p, end, swap, mesh->_vertices.size(), mesh->_indices))
+            {
+              haveVertices = false;
+              break;
+            }
+            haveFaces = true;
+            continue;
+          }
+          const char* next = skipElement(*e, p, end, swap);
+          if (e->name == "vertex")
+          {
+            if (next == NULL || !decodeVertices(*e, p, swap, mesh->_vertices)) break;
+            haveVertices = true;
+          }
+          p = next;
+        }
+        if (!haveVertices)
+        {
+          std::cerr << "ply import error: bad vertex or face data in " << filename << std::endl;
+          return shared_ptr<Mesh<V> >();
+        }
+        // A point cloud isn't a mesh, and every mesh function takes empty
+        // indices for a flat mesh.
+        if (!haveFaces || mesh->_indices.empty())
+        {
+          std::cerr << "ply import error: no faces in " << filename << std::endl;
+          return shared_ptr<Mesh<V> >();
+        }
+
+        mesh->_geometryGroups.push_back(Group("default", 0, mesh->_indices.size()));
+        mesh->_materialGroups.push_back(Group("default", 0, mesh->_indices.size()));
+        mesh->_materials["default"] = Material("default");
+        return mesh;
+      }
+
+    template <typename V>
+      bool writePly(shared_ptr<Mesh<V> > mesh, const std::string& filename, PlyFormat format)
+      {
+        if (!mesh || format == kPlyAscii) return false;
+        if (mesh->_indices.empty()) mesh = indexedMeshFromMesh(mesh);
+
+        std::ofstream os(filename.c_str(), std::ios::out | std::ios::binary);
+        if (!os.is_open()) return false;
+
+        os << "ply\nformat " << (format == kPlyBinaryBigEndian ?
+            "binary_big_endian" : "binary_little_endian") << " 1.0\n";
+        os << "comment lap\n";
+        os << "element vertex " << mesh->_vertices.size() << '\n';
+        std::istringstream layout(plyLayout<V>());
+        std::string name;
+        while (layout >> name) os << "property float " << name << '\n';
+        os << "element face " << mesh->_indices.size() / 3 << '\n';
+        os << "property list uchar uint vertex_indices\n";
+        os << "end_header\n";
+
+        const bool swap = (format == kPlyBinaryBigEndian) != hostIsBigEndian();
+        const uint32_t kWindow = 1 << 14;
+        const uint32_t words = mesh->_vertices.size() * sizeof(V) / 4;
+        const uint32_t* vertexWords = mesh->_vertices.empty() ? NULL :
+          reinterpret_cast<const uint32_t*>(&mesh->_vertices[0]);
+        if (!swap && words > 0)
+        {
+          os.write(reinterpret_cast<const char*>(vertexWords), words * 4);
+        }
+        else
+        {
+          std::vector<uint32_t> window(kWindow);
+          for (uint32_t begin = 0; begin < words; begin += kWindow)
+          {
+            const uint32_t count = std::min(kWindow, words - begin);
+            for (uint32_t i = 0; i < count; ++i) window[i] = swap32(vertexWords[begin + i]);
+            os.write(reinterpret_cast<const char*>(&window[0]), count * 4);
+          }
+        }
+
+        const std::vector<uint32_t>& indices = mesh->_indices;
+        const uint32_t faces = indices.size() / 3;
+        std::vector<char> records(kWindow * 13);
+        for (uint32_t begin = 0; begin < faces; begin += kWindow)
+        {
+          const uint32_t count = std::min(kWindow, faces - begin);
+          char* r = &records[0];
+          for (uint32_t f = begin; f < begin + count; ++f, r += 13)
+          {
+            uint32_t corners[3] = { indices[3*f], indices[3*f+1], indices[3*f+2] };
+            if (swap) std::transform(corners, corners + 3, corners, swap32);
+            r[0] = 3;
+            memcpy(r + 1, corners, 12);
+          }
+          os.write(&records[0], count * 13);
+        }
+        return os.good();
+      }
+  }
+
+  obj::VertexFormat plyVertexFormat(const std::string& filename)
+  {
+    std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!in.is_open()) return obj::kNone;
+    std::string text;
+    std::string line;
+    while (std::getline(in, line))
+    {
+      text += line + '\n';
+      if (line.compare(0, 10, "end_header") == 0) break;
+    }
+    PlyHeader header;
+    if (!parseHeader(text.data(), text.size(), header)) return obj::kNone;
+
+    bool positions = false, uvs = false, normals = false, tangents = false;
+    for (std::vector<PlyElement>::const_iterator e = header.elements.begin();
+        e != header.elements.end(); ++e)
+    {
+      if (e->name != "vertex") continue;
+      for (std::vector<PlyProperty>::const_iterator p = e->properties.begin();
+          p != e->properties.end(); ++p)
+      {
+        const std::string name = canonicalName(p->name);
+        positions = positions || name == "x";
+        uvs = uvs || name == "s";
+        normals = normals || name == "nx";
+        tangents = tangents || name == "tx";
+      }
+    }
+    if (!positions) return obj::kNone;
+    if (uvs && normals && tangents) return obj::kPositionUVNormalTangent;
+    if (uvs && normals) return obj::kPositionUVNormal;
+    if (normals) return obj::kPositionNormal;
+    if (uvs) return obj::kPositionUV;
+    return obj::kPosition;
+  }
+
+  template <>
+  shared_ptr<Mesh<VertexP> > importPly(const std::string& filename)
+  {
+    return readPly<VertexP>(filename);
+  }
+
+  template <>
+  shared_ptr<Mesh<VertexPN> > importPly(const std::string& filename)
+  {
+    return readPly<VertexPN>(filename);
+  }
+
+  template <>
+  shared_ptr<Mesh<VertexPT> > importPly(const std::string& filename)
+  {
+    return readPly<VertexPT>(filename);
+  }
+
+  template <>
+  shared_ptr<Mesh<VertexPTN> > importPly(const std::string& filename)
+  {
+    return readPly<VertexPTN>(filename);
+  }
+
+  template <>
+  shared_ptr<Mesh<VertexPTNT> > importPly(const std::string& filename)
+  {
+    return readPly<VertexPTNT>(filename);
+  }
+
+  template <>
+  bool exportPly(MeshPPtr mesh, const std::string& filename, PlyFormat format)
+  {
+    return writePly(mesh, filename, format);
+  }
+
+  template <>
+  bool exportPly(MeshPNPtr mesh, const std::string& filename, PlyFormat format)
+  {
+    return writePly(mesh, filename, format);
+  }
+
+  template <>
+  bool exportPly(MeshPTPtr mesh, const std::string& filename, PlyFormat format)
+  {
+    return writePly(mesh, filename, format);
+  }
+
+  template <>
+  bool exportPly(MeshPTNPtr mesh, const std::string& filename, PlyFormat format)
+  {
+    return writePly(mesh, filename, format);
+  }
+
+  template <>
+  bool exportPly(MeshPTNTPtr mesh, const std::string& filename, PlyFormat format)
+  {
+    return writePly(mesh, filename, format);
+  }
+}
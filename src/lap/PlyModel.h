@@ -0,0 +1,62 @@
+#ifndef LAP_PLY_MODEL_H
+#define LAP_PLY_MODEL_H
+
+#include <string>
+#include "MeshAsset.h"
+#include "ObjAdapt.h"
+
+namespace lap
+{
+  enum PlyFormat
+  {
+    kPlyAscii,
+    kPlyBinaryLittleEndian,
+    kPlyBinaryBigEndian
+  };
+
+  //! The vertex type matching a PLY file's vertex properties: nx/ny/nz give
+  //! normals, s/t (or u/v, texture_u/texture_v) give uvs, and tx/ty/tz/tw
+  //! alongside both give tangents. kNone if the file can't be read.
+  obj::VertexFormat plyVertexFormat(const std::string& filename);
+
+  //! dispatchVertexFormat for plyVertexFormat's result, which may also be
+  //! kPositionUVNormalTangent.
+  template <typename F>
+    bool dispatchPlyVertexFormat(obj::VertexFormat format, const F& f)
+    {
+      if (format != obj::kPositionUVNormalTangent) return dispatchVertexFormat(format, f);
+      f.template apply<VertexPTNT>();
+      return true;
+    }
+
+  //! Import a binary PLY as an indexed mesh with one "default" group.
+  //! The file is memory mapped and the mesh copied out of the mapping:
+  //! vertices laid out exactly like V in the host's byte order in one 
+  //! block, others converted per property in parallel. Faces are decoded 
+  //! serially, polygons fanned into triangles. tx/ty/tz/tw give 
+  //! VertexPTNT's tangents. Returns null for ascii or malformed files, and
+  //! for files without faces.
+  template <typename V>
+    shared_ptr<Mesh<V> > importPly(const std::string& filename);
+
+  template <> shared_ptr<Mesh<VertexP> > importPly(const std::string& filename);
+  template <> shared_ptr<Mesh<VertexPN> > importPly(const std::string& filename);
+  template <> shared_ptr<Mesh<VertexPT> > importPly(const std::string& filename);
+  template <> shared_ptr<Mesh<VertexPTN> > importPly(const std::string& filename);
+  template <> shared_ptr<Mesh<VertexPTNT> > importPly(const std::string& filename);
+
+  //! Export mesh as binary PLY with float properties in V's layout, so
+  //! vertices in the host's byte order are written in one block. Tangents
+  //! are written as tx/ty/tz/tw. Flat meshes are indexed first.
+  template <typename V>
+    bool exportPly(shared_ptr<Mesh<V> > mesh, const std::string& filename,
+        PlyFormat format = kPlyBinaryLittleEndian);
+
+  template <> bool exportPly(MeshPPtr mesh, const std::string& filename, PlyFormat format);
+  template <> bool exportPly(MeshPNPtr mesh, const std::string& filename, PlyFormat format);
+  template <> bool exportPly(MeshPTPtr mesh, const std::string& filename, PlyFormat format);
+  template <> bool exportPly(MeshPTNPtr mesh, const std::string& filename, PlyFormat format);
+  template <> bool exportPly(MeshPTNTPtr mesh, const std::string& filename, PlyFormat format);
+}
+
+#endif
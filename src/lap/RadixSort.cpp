@@ -0,0 +1,137 @@
+#include "RadixSort.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <boost/lambda/bind.hpp>
+#include <boost/lambda/lambda.hpp>
+
+using namespace boost::lambda;
+
+namespace lap
+{
+  namespace
+  {
+    const uint32_t kDigitBits = 8;
+    const uint32_t kBuckets = 1 << kDigitBits;
+
+    // One digit pass: each chunk counts its digits, then scatters to 
+    // offsets reserved for it, which keeps the sort stable.
+    struct RadixPass
+    {
+      const uint64_t* keys;
+      const uint32_t* values;
+      uint64_t* keysOut;
+      uint32_t* valuesOut;
+      uint32_t shift;
+      std::vector<uint32_t> offsets; // kBuckets per chunk
+
+      uint32_t digit(uint64_t key)const { return (key >> shift) & (kBuckets - 1); }
+
+      void countDigits(uint32_t chunk, uint32_t begin, uint32_t end)
+      {
+        uint32_t* histogram = &offsets[chunk * kBuckets];
+        for (uint32_t i = begin; i < end; ++i) ++histogram[digit(keys[i])];
+      }
+
+      void scatter(uint32_t chunk, uint32_t begin, uint32_t end)
+      {
+        uint32_t* next = &offsets[chunk * kBuckets];
+        for (uint32_t i = begin; i < end; ++i)
+        {
+          uint32_t dst = next[digit(keys[i])]++;
+          keysOut[dst] = keys[i];
+          valuesOut[dst] = values[i];
+        }
+      }
+    };
+
+    struct BucketOffsets
+    {
+      const uint64_t* keys;
+      uint32_t* offsets;
+
+      // Each item starting a new bucket closes the gap of empty buckets before it.
+      void operator()(uint32_t begin, uint32_t end)
+      {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+          uint64_t lower = i == 0 ? 0 : keys[i-1] + 1;
+          for (uint64_t b = lower; b <= keys[i]; ++b) offsets[b] = i;
+        }
+      }
+    };
+  }
+
+  uint32_t bitsFor(uint64_t count)
+  {
+    uint32_t bits = 0;
+    while (bits < 64 && (count - 1) >> bits) ++bits;
+    return count > 1 ? bits : 0;
+  }
+
+  void radixSortPairs(std::vector<uint64_t>& keys, std::vector<uint32_t>& values,
+      uint32_t keyBits)
+  {
+    assert(keys.size() == values.size());
+    const uint32_t count = keys.size();
+    if (count < 2) return;
+
+    std::vector<uint64_t> keysTmp(count);
+    std::vector<uint32_t> valuesTmp(count);
+    const uint32_t chunks = chunkCount(count, 1 << 16);
+
+    for (uint32_t shift = 0; shift < keyBits; shift += kDigitBits)
+    {
+      RadixPass pass;
+      pass.keys = &keys[0];
+      pass.values = &values[0];
+      pass.keysOut = &keysTmp[0];
+      pass.valuesOut = &valuesTmp[0];
+      pass.shift = shift;
+      pass.offsets.assign(chunks * kBuckets, 0);
+
+      parallelChunks(count, chunks, 
+          bind(&RadixPass::countDigits, &pass, _1, _2, _3));
+
+      // Skip digits that are identical across all keys.
+      uint32_t d = pass.digit(keys[0]);
+      uint32_t sameDigit = 0;
+      for (uint32_t c = 0; c < chunks; ++c) sameDigit += pass.offsets[c * kBuckets + d];
+      if (sameDigit == count) continue;
+
+      // Turn the per-chunk histograms into exclusive scatter offsets, 
+      // bucket-major so earlier chunks stay ahead of later ones.
+      uint32_t running = 0;
+      for (uint32_t b = 0; b < kBuckets; ++b)
+      {
+        for (uint32_t c = 0; c < chunks; ++c)
+        {
+          uint32_t n = pass.offsets[c * kBuckets + b];
+          pass.offsets[c * kBuckets + b] = running;
+          running += n;
+        }
+      }
+
+      parallelChunks(count, chunks, 
+          bind(&RadixPass::scatter, &pass, _1, _2, _3));
+      keys.swap(keysTmp);
+      values.swap(valuesTmp);
+    }
+  }
+
+  void bucketItems(const std::vector<uint32_t>& buckets, uint32_t bucketCount,
+      std::vector<uint32_t>& sorted, std::vector<uint32_t>& offsets)
+  {
+    const uint32_t count = buckets.size();
+    std::vector<uint64_t> keys(buckets.begin(), buckets.end());
+    sorted.resize(count);
+    for (uint32_t i = 0; i < count; ++i) sorted[i] = i;
+    radixSortPairs(keys, sorted, bitsFor(bucketCount));
+
+    offsets.resize(bucketCount + 1);
+    BucketOffsets bo = { count ? &keys[0] : NULL, &offsets[0] };
+    parallelFor(count, bo);
+    const uint32_t firstEmpty = count ? keys.back() + 1 : 0;
+    for (uint32_t b = firstEmpty; b <= bucketCount; ++b) offsets[b] = count;
+  }
+}
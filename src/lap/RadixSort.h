@@ -0,0 +1,24 @@
+#ifndef LAP_RADIX_SORT_H
+#define LAP_RADIX_SORT_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace lap
+{
+  //! Number of bits needed to represent values in [0, count).
+  uint32_t bitsFor(uint64_t count);
+
+  //! Stable LSD radix sort of keys, carrying values along. Only the low 
+  //! keyBits of each key are examined. Histograms and scatters run in 
+  //! parallel over contiguous chunks.
+  void radixSortPairs(std::vector<uint64_t>& keys, std::vector<uint32_t>& values,
+      uint32_t keyBits = 64);
+
+  //! Groups items by bucket: sorted receives the item indices stably ordered
+  //! by bucket, and bucket b covers sorted[offsets[b]] up to sorted[offsets[b+1]].
+  void bucketItems(const std::vector<uint32_t>& buckets, uint32_t bucketCount,
+      std::vector<uint32_t>& sorted, std::vector<uint32_t>& offsets);
+}
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef LAP_VERTEX_LAYOUT_H
+#define LAP_VERTEX_LAYOUT_H
+
+#include <cstring>
+#include <ostream>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_base_of.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include "MeshMath.h"
+
+namespace lap
+{
+  // Vertex attributes. Each holds one named member so a Vertex built from
+  // them keeps v.position, v.uv and so on.
+  struct Position
+  {
+    typedef float3 value_type;
+    enum { kBytes = sizeof(value_type) };
+    Position() {}
+    Position(const value_type& p): position(p) {}
+    bool attribEquals(const Position& rhs)const { return position.equals(rhs.position); }
+    void print(std::ostream& os)const { os << position; }
+
+    float3 position;
+  };
+
+  struct TexCoord
+  {
+    typedef float2 value_type;
+    enum { kBytes = sizeof(value_type) };
+    TexCoord() {}
+    TexCoord(const value_type& t): uv(t) {}
+    bool attribEquals(const TexCoord& rhs)const { return uv.equals(rhs.uv); }
+    void print(std::ostream& os)const { os << uv; }
+
+    float2 uv;
+  };
+
+  struct Normal
+  {
+    typedef float3 value_type;
+    enum { kBytes = sizeof(value_type) };
+    Normal() {}
+    Normal(const value_type& n): normal(n) {}
+    bool attribEquals(const Normal& rhs)const { return normal.equals(rhs.normal); }
+    void print(std::ostream& os)const { os << normal; }
+
+    float3 normal;
+  };
+
+  struct Tangent
+  {
+    typedef float4 value_type;
+    enum { kBytes = sizeof(value_type) };
+    Tangent() {}
+    Tangent(const value_type& t): tangent(t) {}
+    bool attribEquals(const Tangent& rhs)const { return tangent.equals(rhs.tangent); }
+    void print(std::ostream& os)const { os << tangent; }
+
+    float4 tangent; // xyz tangent, w bitangent sign (bitangent = w * normal x tangent)
+  };
+
+  struct NoValue {};
+
+  //! An unused attribute slot. Each slot has its own type so the empty
+  //! bases take no space.
+  template <int N>
+    struct NoAttribute
+    {
+      typedef NoValue value_type;
+      enum { kBytes = 0 };
+      NoAttribute() {}
+      NoAttribute(const value_type&) {}
+      bool attribEquals(const NoAttribute&)const { return true; }
+      void print(std::ostream&)const {}
+    };
+
+  //! A packed vertex of up to four attributes, laid out in order with
+  //! compile-time stride and offsets.
+  template <typename A0, typename A1 = NoAttribute<1>,
+           typename A2 = NoAttribute<2>, typename A3 = NoAttribute<3> >
+    struct Vertex : public A0, public A1, public A2, public A3
+    {
+      typedef A0 Attrib0;
+      typedef A1 Attrib1;
+      typedef A2 Attrib2;
+      typedef A3 Attrib3;
+
+      enum
+      {
+        kOffset0 = 0,
+        kOffset1 = kOffset0 + A0::kBytes,
+        kOffset2 = kOffset1 + A1::kBytes,
+        kOffset3 = kOffset2 + A2::kBytes,
+        kStride = kOffset3 + A3::kBytes,
+        kAttributes = (A0::kBytes > 0) + (A1::kBytes > 0) + (A2::kBytes > 0) + (A3::kBytes > 0)
+      };
+
+      Vertex()
+      {
+        BOOST_STATIC_ASSERT(sizeof(Vertex) == kStride);
+      }
+
+      Vertex(const typename A0::value_type& a0,
+          const typename A1::value_type& a1 = typename A1::value_type(),
+          const typename A2::value_type& a2 = typename A2::value_type(),
+          const typename A3::value_type& a3 = typename A3::value_type()):
+        A0(a0), A1(a1), A2(a2), A3(a3)
+      {
+        BOOST_STATIC_ASSERT(sizeof(Vertex) == kStride);
+      }
+
+      bool equals(const Vertex& rhs)const
+      {
+        return A0::attribEquals(rhs) && A1::attribEquals(rhs) &&
+          A2::attribEquals(rhs) && A3::attribEquals(rhs);
+      }
+    };
+
+  typedef Vertex<Position> VertexP;
+  typedef Vertex<Position, Normal> VertexPN;
+  typedef Vertex<Position, TexCoord> VertexPT;
+  typedef Vertex<Position, TexCoord, Normal> VertexPTN;
+  typedef Vertex<Position, TexCoord, Normal, Tangent> VertexPTNT;
+
+  template <typename A0, typename A1, typename A2, typename A3>
+    std::ostream& operator<<(std::ostream& os, const Vertex<A0, A1, A2, A3>& v)
+    {
+      const bool bracket = Vertex<A0, A1, A2, A3>::kAttributes > 1;
+      if (bracket) os << '[';
+      static_cast<const A0&>(v).print(os);
+      if (A1::kBytes != 0) { os << ", "; static_cast<const A1&>(v).print(os); }
+      if (A2::kBytes != 0) { os << ", "; static_cast<const A2&>(v).print(os); }
+      if (A3::kBytes != 0) { os << ", "; static_cast<const A3&>(v).print(os); }
+      if (bracket) os << ']';
+      return os;
+    }
+
+  template <typename A, typename V>
+    struct HasAttribute
+    {
+      enum { value = boost::is_base_of<A, V>::value };
+    };
+
+  template <typename A, typename V, bool Has = HasAttribute<A, V>::value>
+    struct AttributeOf
+    {
+      static A* get(V&) { return NULL; }
+    };
+
+  template <typename A, typename V>
+    struct AttributeOf<A, V, true>
+    {
+      static A* get(V& v) { return &v; }
+    };
+
+  //! v's attribute A, or null if V has none.
+  template <typename A, typename V>
+    A* attributePtr(V& v)
+    {
+      return AttributeOf<A, V>::get(v);
+    }
+
+  template <typename A> struct IsNoAttribute { enum { value = false }; };
+  template <int N> struct IsNoAttribute<NoAttribute<N> > { enum { value = true }; };
+
+  //! True when To's attributes lead From's in the same order, so a To is
+  //! the first sizeof(To) bytes of a From.
+  template <typename To, typename From>
+    struct IsLayoutPrefix
+    {
+      template <typename A, typename B> struct Slot
+      {
+        enum { value = boost::is_same<A, B>::value || IsNoAttribute<A>::value };
+      };
+
+      enum
+      {
+        value = Slot<typename To::Attrib0, typename From::Attrib0>::value &&
+          Slot<typename To::Attrib1, typename From::Attrib1>::value &&
+          Slot<typename To::Attrib2, typename From::Attrib2>::value &&
+          Slot<typename To::Attrib3, typename From::Attrib3>::value
+      };
+    };
+
+  //! V with attribute A in its first free slot.
+  template <typename V, typename A> struct AppendAttribute;
+
+  template <typename A0, typename A>
+    struct AppendAttribute<Vertex<A0, NoAttribute<1>, NoAttribute<2>, NoAttribute<3> >, A>
+    {
+      typedef Vertex<A0, A> type;
+    };
+
+  template <typename A0, typename A1, typename A>
+    struct AppendAttribute<Vertex<A0, A1, NoAttribute<2>, NoAttribute<3> >, A>
+    {
+      typedef Vertex<A0, A1, A> type;
+    };
+
+  template <typename A0, typename A1, typename A2, typename A>
+    struct AppendAttribute<Vertex<A0, A1, A2, NoAttribute<3> >, A>
+    {
+      typedef Vertex<A0, A1, A2, A> type;
+    };
+
+  template <typename A, bool Has>
+    struct CopyAttribute
+    {
+      template <typename To, typename From> static void apply(To&, const From&) {}
+    };
+
+  template <typename A>
+    struct CopyAttribute<A, true>
+    {
+      template <typename To, typename From>
+        static void apply(To& to, const From& from)
+        {
+          static_cast<A&>(to) = static_cast<const A&>(from);
+        }
+    };
+
+  template <typename To, typename From, bool Prefix = IsLayoutPrefix<To, From>::value>
+    struct ConvertVertex
+    {
+      static To apply(const From& from)
+      {
+        To to;
+        CopyAttribute<typename To::Attrib0, HasAttribute<typename To::Attrib0, From>::value>::apply(to, from);
+        CopyAttribute<typename To::Attrib1, HasAttribute<typename To::Attrib1, From>::value>::apply(to, from);
+        CopyAttribute<typename To::Attrib2, HasAttribute<typename To::Attrib2, From>::value>::apply(to, from);
+        CopyAttribute<typename To::Attrib3, HasAttribute<typename To::Attrib3, From>::value>::apply(to, from);
+        return to;
+      }
+    };
+
+  template <typename To, typename From>
+    struct ConvertVertex<To, From, true>
+    {
+      static To apply(const From& from)
+      {
+        To to;
+        memcpy(static_cast<void*>(&to), static_cast<const void*>(&from), sizeof(To));
+        return to;
+      }
+    };
+
+  //! Copy the attributes To shares with From, leaving the rest defaulted.
+  //! Layout prefixes (eg. PTN to PT) are a plain memcpy.
+  template <typename To, typename From>
+    To convertVertex(const From& from)
+    {
+      return ConvertVertex<To, From>::apply(from);
+    }
+}
+
+#endif
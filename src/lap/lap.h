@@ -4,4 +4,21 @@
 #include "ObjModel.h"
 #include "MeshAsset.h"
 #include "ObjAdapt.h"
+#include "MeshNormals.h"
+#include "MeshTangents.h"
+#include "MeshTopology.h"
+#include "MeshComponents.h"
+#include "ObjPipeline.h"
+#include "ObjIndex.h"
+#include "CompressedStream.h"
+#include "GltfExport.h"
+#include "PlyModel.h"
+#include "MeshTransform.h"
+#include "MeshTiles.h"
+#include "MeshMerge.h"
+#include "MeshInstances.h"
+#include "ModelCache.h"
+#include "MeshWeld.h"
+#include "MeshReorder.h"
+#include "MeshStats.h"
 #endif
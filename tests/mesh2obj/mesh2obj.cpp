@@ -9,18 +9,21 @@ using namespace std;
 using namespace std::tr1;
 
   template <typename V>
-void doMesh(shared_ptr<V> mesh, const std::string& outFile)
+void doMesh(shared_ptr<V> indexed, const std::string& outFile)
 { 
-  shared_ptr<V> flat =
-    meshFromIndexedMesh(
-      indexedMeshFromMesh(
-        mesh->flatten()));
-
-  obj::ModelPtr model = objFromMesh(flat);
+  obj::ModelPtr model = objFromMesh(indexed);
   obj::ObjTranslator ot;
   ot.exportFile(model, outFile);
 }
 
+struct RoundTrip
+{
+  WeldedObjPtr welded;
+  string outFile;
+
+  template <typename V> void apply()const { doMesh(indexedMeshFromWeldedObj<V>(welded), outFile); }
+};
+
 int main(int argc, char **argv)
 {
   if (argc < 3)
@@ -31,20 +34,16 @@ int main(int argc, char **argv)
   const string modelFile = argv[1];
   const string outFile = argv[2];
 
-  obj::ModelPtr model = obj::ObjTranslator().importFile(modelFile);
-  if (!model)
+  // Corners are welded as they're parsed, so no flat mesh is built.
+  WeldedObjPtr welded = importWeldedObj(modelFile);
+  if (!welded)
   {
     cerr << "Error importing " << modelFile << endl;
     return 1;
   }
-  cout << "vertexFormat: " << model->vertexFormat() << endl;
-  switch (model->vertexFormat())
-  {
-    case obj::kPosition: doMesh(meshFromObj<VertexP>(model), outFile); break;
-    case obj::kPositionUV: doMesh(meshFromObj<VertexPT>(model), outFile); break;
-    case obj::kPositionNormal: doMesh(meshFromObj<VertexPN>(model), outFile); break;
-    case obj::kPositionUVNormal: doMesh(meshFromObj<VertexPTN>(model), outFile); break;
-    default: cerr << "Invalid vertex format" << endl; break;
-  }
+  const obj::VertexFormat vertexFormat = welded->model->vertexFormat();
+  cout << "vertexFormat: " << vertexFormat << endl;
+  const RoundTrip job = { welded, outFile };
+  if (!dispatchVertexFormat(vertexFormat, job)) cerr << "Invalid vertex format" << endl;
   return 0;
 }
@@ -0,0 +1,67 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <lap/lap.h>
+
+using namespace lap;
+using namespace std;
+
+// Vertex cache misses per triangle with a FIFO cache of size entries. A 
+// vertex is cached while fewer than size misses followed its own.
+double cacheMissRatio(const vector<uint32_t>& indices, uint32_t vertexCount, uint32_t size)
+{
+  if (indices.size() < 3) return 0.0;
+  vector<uint64_t> missedAt(vertexCount, 0); // Miss count after the vertex's miss, 0 if never.
+  uint64_t misses = 0;
+  for (vector<uint32_t>::const_iterator i = indices.begin(); i != indices.end(); ++i)
+  {
+    if (missedAt[*i] != 0 && misses - missedAt[*i] < size) continue;
+    missedAt[*i] = ++misses;
+  }
+  return (double)misses / (indices.size() / 3);
+}
+
+// Mean distance between the first indices of consecutive triangles.
+double meanIndexDistance(const vector<uint32_t>& indices)
+{
+  const uint32_t triangles = indices.size() / 3;
+  if (triangles < 2) return 0.0;
+  double sum = 0.0;
+  for (uint32_t t = 0; t + 1 < triangles; ++t)
+  {
+    sum += fabs((double)indices[3 * t + 3] - (double)indices[3 * t]);
+  }
+  return sum / (triangles - 1);
+}
+
+void report(const string& label, const Mesh<VertexP>& mesh, uint32_t cacheSize)
+{
+  cout << label << " acmr " << cacheMissRatio(mesh._indices, mesh._vertices.size(), cacheSize) <<
+    " index-distance " << meanIndexDistance(mesh._indices) << endl;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    cerr << "Usage: meshlocality <objfile> [cache-size]\n"
+      "Vertex cache misses per triangle (FIFO, 32 entries by default) and mean\n"
+      "index distance between consecutive triangles, before and after\n"
+      "reorderMorton, of the file's positions.\n";
+    return 1;
+  }
+  const uint32_t cacheSize = argc > 2 ? atoi(argv[2]) : 32;
+  obj::ObjTranslator translator;
+  translator.setPipelined(true);
+  obj::ModelPtr model = translator.importFile(argv[1]);
+  if (!model)
+  {
+    cerr << "Error importing " << argv[1] << endl;
+    return 1;
+  }
+  const MeshPPtr indexed = indexedMeshFromObj<VertexP>(model);
+  report("before", *indexed, cacheSize);
+  report("after", *reorderMorton(indexed), cacheSize);
+  return 0;
+}
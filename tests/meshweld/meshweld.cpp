@@ -0,0 +1,202 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <lap/lap.h>
+
+using namespace lap;
+using namespace std;
+
+// A run of corners of the flat mesh: a strip of quads, in a geometry group
+// unless name is empty.
+struct Strip
+{
+  string name;
+  uint32_t quads;
+  float height;
+};
+
+VertexPTN gridVertex(uint32_t x, uint32_t y, float height)
+{
+  VertexPTN v;
+  v.position[0] = x; v.position[1] = y * height; v.position[2] = x * height;
+  v.uv[0] = x / 16.0f; v.uv[1] = y;
+  v.normal[1] = 1.0f;
+  return v;
+}
+
+// Strips one after the other, with material groups crossing them.
+MeshPTNPtr flatMesh(const vector<Strip>& strips)
+{
+  MeshPTNPtr mesh(new Mesh<VertexPTN>());
+  for (vector<Strip>::const_iterator s = strips.begin(); s != strips.end(); ++s)
+  {
+    const uint32_t begin = mesh->_vertices.size();
+    for (uint32_t x = 0; x < s->quads; ++x)
+    {
+      const VertexPTN a = gridVertex(x, 0, s->height), b = gridVertex(x + 1, 0, s->height);
+      const VertexPTN c = gridVertex(x + 1, 1, s->height), d = gridVertex(x, 1, s->height);
+      const VertexPTN quad[6] = { a, b, c, a, c, d };
+      mesh->_vertices.insert(mesh->_vertices.end(), quad, quad + 6);
+    }
+    if (!s->name.empty())
+    {
+      mesh->_geometryGroups.push_back(Group(s->name, begin, mesh->_vertices.size() - begin));
+    }
+  }
+  const uint32_t corners = mesh->_vertices.size();
+  const uint32_t third = corners / 9 * 3;
+  mesh->_materialGroups.push_back(Group("red", 0, third));
+  mesh->_materialGroups.push_back(Group("blue", third, corners - third));
+  mesh->_materials["red"] = Material();
+  mesh->_materials["blue"] = Material();
+  return mesh;
+}
+
+bool fail(const string& step, const string& what)
+{
+  cerr << step << ": " << what << '\n';
+  return false;
+}
+
+bool sameGroups(const vector<Group>& a, const vector<Group>& b)
+{
+  if (a.size() != b.size()) return false;
+  for (uint32_t i = 0; i < a.size(); ++i)
+  {
+    if (a[i].name() != b[i].name() || a[i].begin() != b[i].begin() ||
+        a[i].count() != b[i].count())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Name of the group holding corner c, empty if none.
+string groupAt(const vector<Group>& groups, uint32_t c)
+{
+  for (GroupConstIter g = groups.begin(); g != groups.end(); ++g)
+  {
+    if (g->begin() <= c && c < g->end()) return g->name();
+  }
+  return string();
+}
+
+// Before compacting: every group's corners weld to the flat mesh's, with
+// the same material, and slots outside the groups are degenerate.
+bool matchesFlat(const string& step, const IncrementalWeld<VertexPTN>& weld,
+    const Mesh<VertexPTN>& flat)
+{
+  const Mesh<VertexPTN>& mesh = *weld.mesh();
+  if (mesh._geometryGroups.size() != flat._geometryGroups.size()) return fail(step, "group count");
+  vector<bool> covered(mesh._indices.size());
+  for (uint32_t g = 0; g < flat._geometryGroups.size(); ++g)
+  {
+    const Group& from = flat._geometryGroups[g];
+    const Group& to = mesh._geometryGroups[g];
+    if (from.name() != to.name() || from.count() != to.count()) return fail(step, "group " + from.name());
+    for (uint32_t c = 0; c < from.count(); ++c)
+    {
+      covered[to.begin() + c] = true;
+      const VertexPTN& v = mesh._vertices[mesh._indices[to.begin() + c]];
+      if (!v.equals(flat._vertices[from.begin() + c])) return fail(step, "corner of " + from.name());
+      if (groupAt(mesh._materialGroups, to.begin() + c) != groupAt(flat._materialGroups, from.begin() + c))
+      {
+        return fail(step, "material of " + from.name());
+      }
+    }
+  }
+  // Other slots hold the corners between groups, or are degenerate.
+  uint32_t degenerate = 0;
+  for (uint32_t t = 0; t < mesh._indices.size(); t += 3)
+  {
+    const uint32_t* i = &mesh._indices[t];
+    if (!covered[t] && i[0] == i[1] && i[1] == i[2]) degenerate += 3;
+  }
+  if (degenerate < weld.unusedCorners()) return fail(step, "unused slots aren't degenerate");
+  return true;
+}
+
+// After compacting: the same mesh as welding the flat one from scratch.
+bool matchesFullWeld(const string& step, IncrementalWeld<VertexPTN>& weld,
+    const MeshPTNPtr& flat)
+{
+  weld.compact();
+  IncrementalWeld<VertexPTN> full(flat);
+  full.compact();
+  const Mesh<VertexPTN>& a = *weld.mesh();
+  const Mesh<VertexPTN>& b = *full.mesh();
+  if (a._indices != b._indices) return fail(step, "indices differ from a full weld");
+  if (a._vertices.size() != b._vertices.size()) return fail(step, "vertex count differs from a full weld");
+  for (uint32_t i = 0; i < a._vertices.size(); ++i)
+  {
+    if (!a._vertices[i].equals(b._vertices[i])) return fail(step, "vertices differ from a full weld");
+  }
+  vector<Group> materials = flat->_materialGroups;
+  sort(materials.begin(), materials.end());
+  if (!sameGroups(a._geometryGroups, flat->_geometryGroups)) return fail(step, "geometry groups");
+  if (!sameGroups(a._materialGroups, materials)) return fail(step, "material groups");
+  if (weld.unusedCorners() != 0) return fail(step, "compacted mesh has slack");
+  return true;
+}
+
+bool check(const string& step, IncrementalWeld<VertexPTN>& weld, const MeshPTNPtr& flat,
+    const MeshPTNPtr& held, bool expected, bool updated)
+{
+  if (weld.mesh() != held) return fail(step, "mesh was replaced");
+  if (updated != expected) return fail(step, "unexpected update result");
+  return matchesFlat(step, weld, *flat);
+}
+
+int main()
+{
+  Strip initial[] = { { "a", 40, 1.0f }, { "", 8, 1.0f }, { "b", 30, 1.0f },
+    { "c", 50, 1.0f }, { "d", 20, 1.0f } };
+  vector<Strip> strips(initial, initial + 5);
+  MeshPTNPtr flat = flatMesh(strips);
+  IncrementalWeld<VertexPTN> weld(flat);
+  const MeshPTNPtr held = weld.mesh();
+  bool ok = matchesFlat("initial", weld, *flat);
+  vector<uint32_t> changed(1);
+
+  // Same corners, moved vertices.
+  strips[2].height = 2.0f;
+  flat = flatMesh(strips);
+  changed[0] = 1;
+  ok = check("move", weld, flat, held, true, weld.update(flat, changed)) && ok;
+
+  // Grown past its index slots, so it moves to the end.
+  strips[3].quads = 90;
+  flat = flatMesh(strips);
+  changed[0] = 2;
+  ok = check("grow", weld, flat, held, true, weld.update(flat, changed)) && ok;
+  if (weld.unusedCorners() == 0) ok = fail("grow", "group wasn't moved");
+
+  // Shrunk in place.
+  strips[0].quads = 25;
+  flat = flatMesh(strips);
+  changed[0] = 0;
+  ok = check("shrink", weld, flat, held, true, weld.update(flat, changed)) && ok;
+
+  // Grown within its slack.
+  strips[3].quads = 95;
+  flat = flatMesh(strips);
+  changed[0] = 2;
+  ok = check("regrow", weld, flat, held, true, weld.update(flat, changed)) && ok;
+  ok = matchesFullWeld("compact", weld, flat) && ok;
+
+  // A new group re-welds everything into the same mesh.
+  Strip added = { "e", 10, 3.0f };
+  strips.push_back(added);
+  flat = flatMesh(strips);
+  changed[0] = 4;
+  ok = check("restructure", weld, flat, held, false, weld.update(flat, changed)) && ok;
+  strips[4].height = 0.5f;
+  flat = flatMesh(strips);
+  changed[0] = 3;
+  ok = check("after restructure", weld, flat, held, true, weld.update(flat, changed)) && ok;
+  ok = matchesFullWeld("final", weld, flat) && ok;
+
+  cout << (ok ? "meshweld: ok" : "meshweld: FAILED") << endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <lap/lap.h>
+
+using namespace lap;
+using namespace std;
+
+// A grid of quads with every attribute, big enough that the writer splits
+// each attribute and the faces into several sections. Material groups cut
+// across the geometry groups.
+obj::ModelPtr gridModel(uint32_t side)
+{
+  obj::ModelPtr model(new obj::Model());
+  for (uint32_t y = 0; y <= side; ++y)
+  {
+    for (uint32_t x = 0; x <= side; ++x)
+    {
+      float3 p;
+      p[0] = x / 3.0f; p[1] = y / 7.0f; p[2] = (x * y) / 11.0f;
+      float2 uv;
+      uv[0] = x / (float)side; uv[1] = y / (float)side;
+      float3 n;
+      n[1] = 1.0f / 3.0f; n[2] = 2.0f / 3.0f;
+      model->addPosition(p);
+      model->addUV(uv);
+      model->addNormal(n);
+    }
+  }
+  for (uint32_t y = 0; y < side; ++y)
+  {
+    for (uint32_t x = 0; x < side; ++x)
+    {
+      const uint32_t a = y * (side + 1) + x;
+      const uint32_t quad[6] = { a, a + 1, a + side + 2, a, a + side + 2, a + side + 1 };
+      for (int c = 0; c < 6; ++c)
+      {
+        for (int k = 0; k < 3; ++k) model->_faceIndices.push_back(quad[c]);
+      }
+    }
+  }
+  const uint32_t indices = model->_faceIndices.size();
+  const uint32_t half = indices / 18 / 2 * 9;
+  model->_geometryGroups.push_back(Group("first", 0, half));
+  model->_geometryGroups.push_back(Group("second", half, indices - half));
+  const uint32_t third = indices / 27 * 9;
+  model->_materialGroups.push_back(Group("red", 9, third));
+  model->_materialGroups.push_back(Group("blue", 9 + third, indices - 9 - third));
+  return model;
+}
+
+void formatLike(ostream& os)
+{
+  os.precision(9);
+  os.setf(ios::scientific, ios::floatfield);
+}
+
+// The OBJ text written one line at a time on a single stream.
+string serialObj(const obj::Model& model)
+{
+  ostringstream os;
+  formatLike(os);
+  os << "g default\n";
+  for (uint32_t i = 0; i < model.positions().size(); ++i) writeVec(os, model.positions()[i], "v ", "\n");
+  for (uint32_t i = 0; i < model.uvs().size(); ++i) writeVec(os, model.uvs()[i], "vt ", "\n");
+  for (uint32_t i = 0; i < model.normals().size(); ++i) writeVec(os, model.normals()[i], "vn ", "\n");
+
+  vector<Group> groups;
+  for (GroupConstIter g = model._geometryGroups.begin(); g != model._geometryGroups.end(); ++g)
+  {
+    groups.push_back(Group("g " + g->name(), g->begin(), g->count()));
+  }
+  for (GroupConstIter g = model._materialGroups.begin(); g != model._materialGroups.end(); ++g)
+  {
+    groups.push_back(Group("usemtl " + g->name(), g->begin(), g->count()));
+  }
+  sort(groups.begin(), groups.end());
+  const vector<uint32_t>& f = model.faceIndices();
+  for (uint32_t g = 0; g < groups.size(); ++g)
+  {
+    os << groups[g].name() << '\n';
+    const uint32_t end = g + 1 < groups.size() ? groups[g + 1].begin() : groups[g].end();
+    for (uint32_t i = groups[g].begin(); i < end; i += 9)
+    {
+      os << "f " << f[i] + 1 << '/' << f[i + 1] + 1 << '/' << f[i + 2] + 1 <<
+        ' ' << f[i + 3] + 1 << '/' << f[i + 4] + 1 << '/' << f[i + 5] + 1 <<
+        ' ' << f[i + 6] + 1 << '/' << f[i + 7] + 1 << '/' << f[i + 8] + 1 << '\n';
+    }
+  }
+  return os.str();
+}
+
+string writtenObj(const obj::Model& model, const char* threads)
+{
+  setenv("LAP_THREADS", threads, 1);
+  ostringstream os;
+  formatLike(os);
+  os << model;
+  return os.str();
+}
+
+bool check(const string& name, const string& expected, const string& actual)
+{
+  if (expected == actual) return true;
+  string::size_type at = 0;
+  while (at < expected.size() && at < actual.size() && expected[at] == actual[at]) ++at;
+  const string::size_type line = expected.rfind('\n', at) == string::npos ? 0 : expected.rfind('\n', at) + 1;
+  cerr << name << " differs from the serial text at byte " << at << ":\n  expected '" <<
+    expected.substr(line, expected.find('\n', line) - line) << "'\n  actual   '" <<
+    actual.substr(line, actual.find('\n', line) - line) << "'\n";
+  return false;
+}
+
+// Nine significant digits bring every float back exactly.
+bool roundTrips(const obj::Model& model, string text)
+{
+  obj::ObjTranslator translator;
+  const obj::ModelPtr read = translator.parseBlock(&text[0], &text[0] + text.size());
+  const bool same = read && read->positions() == model.positions() &&
+    read->uvs() == model.uvs() && read->normals() == model.normals() &&
+    read->faceIndices() == model.faceIndices();
+  if (!same) cerr << "the written text doesn't read back as the model\n";
+  return same;
+}
+
+// Indexed meshes deduplicate each attribute like flat ones, so both give
+// the same OBJ.
+bool indexedMatchesFlat(const obj::ModelPtr& model)
+{
+  const MeshPTNPtr flat = meshFromObj<VertexPTN>(model);
+  ostringstream fromFlat;
+  fromFlat << *objFromMesh(flat);
+  ostringstream fromIndexed;
+  fromIndexed << *objFromMesh(indexedMeshFromMesh(flat));
+  return check("indexed mesh", fromFlat.str(), fromIndexed.str());
+}
+
+int main()
+{
+  const obj::ModelPtr model = gridModel(150);
+  const string expected = serialObj(*model);
+  bool ok = check("1 thread", expected, writtenObj(*model, "1"));
+  ok = check("4 threads", expected, writtenObj(*model, "4")) && ok;
+  ok = check("7 threads", expected, writtenObj(*model, "7")) && ok;
+  ok = roundTrips(*model, expected) && ok;
+  ok = indexedMatchesFlat(model) && ok;
+  cout << (ok ? "objformat: ok" : "objformat: FAILED") << endl;
+  return ok ? 0 : 1;
+}